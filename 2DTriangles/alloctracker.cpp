@@ -0,0 +1,186 @@
+///////////////////////////////////////////////////////////////////////////////
+// alloctracker.cpp
+// ================
+// counts every C++ heap allocation of the program, per thread
+///////////////////////////////////////////////////////////////////////////////
+
+#include "alloctracker.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <execinfo.h>
+#endif
+
+namespace
+{
+	AllocTracker::Counters gCounters[AllocTracker::MAX_THREADS];
+	std::atomic<int> gThreadCount(0);
+
+	std::atomic<bool> gCapture(false);
+	std::atomic<int> gStackCount(0);
+	AllocTracker::Stack gStacks[AllocTracker::MAX_STACKS];
+
+	// Plain values only, these are read inside operator new so they must
+	// not need a constructor of their own
+	thread_local int tThread = -1;
+	thread_local bool tCapturing = false;
+
+	int ThreadSlot()
+	{
+		if (tThread < 0)
+			tThread = std::min(gThreadCount.fetch_add(1, std::memory_order_relaxed), AllocTracker::MAX_THREADS - 1);
+		return tThread;
+	}
+
+	void CaptureStack(size_t size, int thread)
+	{
+		int index = gStackCount.fetch_add(1, std::memory_order_relaxed);
+		if (index >= AllocTracker::MAX_STACKS)
+			return;
+
+		// capturing may allocate itself the first time it runs
+		tCapturing = true;
+		AllocTracker::Stack &stack = gStacks[index];
+#ifdef _WIN32
+		stack.depth = CaptureStackBackTrace(2, AllocTracker::STACK_DEPTH, stack.frames, NULL);
+#else
+		stack.depth = backtrace(stack.frames, AllocTracker::STACK_DEPTH);
+#endif
+		stack.size = size;
+		stack.thread = thread;
+		tCapturing = false;
+	}
+
+	void *Allocate(size_t size)
+	{
+		int thread = ThreadSlot();
+		gCounters[thread].allocations.fetch_add(1, std::memory_order_relaxed);
+		gCounters[thread].bytes.fetch_add(size, std::memory_order_relaxed);
+		if (gCapture.load(std::memory_order_relaxed) && !tCapturing)
+			CaptureStack(size, thread);
+
+		return std::malloc(size ? size : 1);
+	}
+
+	void Free(void *pointer)
+	{
+		if (!pointer)
+			return;
+
+		gCounters[ThreadSlot()].frees.fetch_add(1, std::memory_order_relaxed);
+		std::free(pointer);
+	}
+}
+
+///////////////////////////////////////////////////
+//	Global operator new and delete
+//
+//	Every form goes through Allocate and Free so
+//	arrays, nothrow and sized deletes all count.
+///////////////////////////////////////////////////
+void *operator new(size_t size)
+{
+	void *pointer = Allocate(size);
+	if (!pointer)
+		throw std::bad_alloc();
+	return pointer;
+}
+
+void *operator new[](size_t size)
+{
+	void *pointer = Allocate(size);
+	if (!pointer)
+		throw std::bad_alloc();
+	return pointer;
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+	return Allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+	return Allocate(size);
+}
+
+void operator delete(void *pointer) noexcept
+{
+	Free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+	Free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+	Free(pointer);
+}
+
+void operator delete[](void *pointer, size_t) noexcept
+{
+	Free(pointer);
+}
+
+void operator delete(void *pointer, const std::nothrow_t &) noexcept
+{
+	Free(pointer);
+}
+
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept
+{
+	Free(pointer);
+}
+
+void AllocTracker::UTotals(unsigned long long &allocations, unsigned long long &frees, unsigned long long &bytes)
+{
+	allocations = 0;
+	frees = 0;
+	bytes = 0;
+	for (const Counters &counters : gCounters)
+	{
+		allocations += counters.allocations.load(std::memory_order_relaxed);
+		frees += counters.frees.load(std::memory_order_relaxed);
+		bytes += counters.bytes.load(std::memory_order_relaxed);
+	}
+}
+
+unsigned long long AllocTracker::UThreadAllocations()
+{
+	return gCounters[ThreadSlot()].allocations.load(std::memory_order_relaxed);
+}
+
+void AllocTracker::UCaptureStacks(bool capture)
+{
+	if (capture)
+		gStackCount = 0;
+	gCapture = capture;
+}
+
+int AllocTracker::UPrintStacks(std::ostream &out)
+{
+	int count = std::min(gStackCount.load(), MAX_STACKS);
+	for (int i = 0; i < count; i++)
+	{
+		const Stack &stack = gStacks[i];
+		out << "Allocation of " << stack.size << " bytes on thread " << stack.thread << ":" << std::endl;
+#ifdef _WIN32
+		for (int frame = 0; frame < stack.depth; frame++)
+			out << "\t" << stack.frames[frame] << std::endl;
+#else
+		char **symbols = backtrace_symbols(stack.frames, stack.depth);
+		for (int frame = 0; frame < stack.depth; frame++)
+			out << "\t" << (symbols ? symbols[frame] : "?") << " " << stack.frames[frame] << std::endl;
+		std::free(symbols);
+#endif
+	}
+	return count;
+}
@@ -0,0 +1,61 @@
+///////////////////////////////////////////////////////////////////////////////
+// alloctracker.h
+// ==============
+// counts every C++ heap allocation of the program, per thread
+//
+// alloctracker.cpp replaces the global operator new and delete, so linking
+// it in is all it takes. Every thread counts into a slot of its own, which
+// makes counting a relaxed add without contention; the totals add the
+// slots up. Stack capture can be switched on to record where the next
+// few allocations come from, which is how a steady-state frame that
+// suddenly allocates is tracked down.
+//
+// Only operator new is seen. malloc calls made by C code, the GL driver
+// and GLFW included, are not counted.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <ostream>
+
+class AllocTracker
+{
+
+public:
+	// Threads past this many share the last slot
+	static const int MAX_THREADS = 64;
+
+	// Allocations recorded once capture is on, and frames kept of each
+	static const int MAX_STACKS = 8;
+	static const int STACK_DEPTH = 24;
+
+	struct Counters
+	{
+		std::atomic<unsigned long long> allocations{ 0 };
+		std::atomic<unsigned long long> frees{ 0 };
+		std::atomic<unsigned long long> bytes{ 0 };		// allocated, frees are not subtracted
+	};
+
+	struct Stack
+	{
+		void *frames[STACK_DEPTH];
+		int depth;
+		size_t size;	// bytes asked for
+		int thread;		// counter slot of the allocating thread
+	};
+
+public:
+	// Sums over every thread
+	static void UTotals(unsigned long long &allocations, unsigned long long &frees, unsigned long long &bytes);
+
+	// Allocations made by the calling thread so far
+	static unsigned long long UThreadAllocations();
+
+	// Record the stacks of the next MAX_STACKS allocations, on any thread
+	static void UCaptureStacks(bool capture);
+
+	// Write the recorded stacks, returns how many there were
+	static int UPrintStacks(std::ostream &out);
+};
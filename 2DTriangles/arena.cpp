@@ -0,0 +1,94 @@
+///////////////////////////////////////////////////////////////////////////////
+// arena.cpp
+// =========
+// linear arena for data that lives for one frame
+///////////////////////////////////////////////////////////////////////////////
+
+#include "arena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace
+{
+	unsigned char *Align(unsigned char *pointer, size_t alignment)
+	{
+		std::uintptr_t address = reinterpret_cast<std::uintptr_t>(pointer);
+		return pointer + ((alignment - address % alignment) % alignment);
+	}
+}
+
+void Arena::UCreateArena(FrameArena &arena, size_t capacity)
+{
+	arena.memory = new unsigned char[capacity];
+	arena.capacity = capacity;
+	arena.used = 0;
+	arena.heapBlocks = 1;
+}
+
+void Arena::UDestroyArena(FrameArena &arena)
+{
+	for (unsigned char *block : arena.spill)
+		delete[] block;
+	arena.spill.clear();
+	arena.spillBytes = 0;
+
+	delete[] arena.memory;
+	arena.memory = nullptr;
+	arena.capacity = 0;
+	arena.used = 0;
+}
+
+void *Arena::UAllocate(FrameArena &arena, size_t size, size_t alignment)
+{
+	arena.allocations.fetch_add(1, std::memory_order_relaxed);
+
+	size_t offset = arena.used.load(std::memory_order_relaxed);
+	while (arena.memory)
+	{
+		unsigned char *start = Align(arena.memory + offset, alignment);
+		size_t end = size_t(start - arena.memory) + size;
+		if (end > arena.capacity)
+			break;
+		if (arena.used.compare_exchange_weak(offset, end, std::memory_order_relaxed))
+			return start;
+	}
+
+	// out of memory for this frame, the next reset makes room
+	std::lock_guard<std::mutex> lock(arena.spillMutex);
+	unsigned char *block = new unsigned char[size + alignment];
+	arena.spill.push_back(block);
+	arena.spillBytes += size + alignment;
+	arena.heapBlocks++;
+	return Align(block, alignment);
+}
+
+///////////////////////////////////////////////////
+//	UReset(FrameArena&)
+//
+//	After a frame that spilled, the memory grows to
+//	at least twice its size so a slowly growing
+//	scene settles after a few frames.
+///////////////////////////////////////////////////
+bool Arena::UReset(FrameArena &arena)
+{
+	size_t bytes = arena.used + arena.spillBytes;
+	arena.lastBytes = bytes;
+	arena.lastAllocations = arena.allocations.exchange(0);
+	arena.peakBytes = std::max(arena.peakBytes, bytes);
+	arena.used = 0;
+
+	if (arena.spill.empty())
+		return false;
+
+	for (unsigned char *block : arena.spill)
+		delete[] block;
+	arena.spill.clear();
+	arena.spillBytes = 0;
+
+	delete[] arena.memory;
+	arena.capacity = std::max(arena.capacity * 2, arena.peakBytes);
+	arena.memory = new unsigned char[arena.capacity];
+	arena.heapBlocks++;
+	return true;
+}
@@ -0,0 +1,69 @@
+///////////////////////////////////////////////////////////////////////////////
+// arena.h
+// =======
+// linear arena for data that lives for one frame
+//
+// Allocating bumps an offset into one block of memory and freeing does
+// nothing; UReset() takes the whole block back at the start of the next
+// frame. The bump is atomic, so the jobs of a frame can allocate from the
+// arena of the thread that owns the frame. When the block runs out the
+// allocation is served from an extra heap block, and the next reset
+// replaces everything with one block large enough for that frame, so
+// after a few frames a steady scene allocates nothing from the heap.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+class Arena
+{
+
+public:
+	static const size_t DEFAULT_CAPACITY = 64 * 1024;
+
+	struct FrameArena
+	{
+		unsigned char *memory = nullptr;
+		size_t capacity = 0;
+		std::atomic<size_t> used{ 0 };
+
+		// blocks taken when memory ran out, folded into memory by UReset
+		std::mutex spillMutex;
+		std::vector<unsigned char *> spill;
+		size_t spillBytes = 0;
+
+		// counters
+		std::atomic<size_t> allocations{ 0 };	// this frame
+		size_t lastAllocations = 0;				// the frame before the last reset
+		size_t lastBytes = 0;
+		size_t peakBytes = 0;					// most any frame needed
+		unsigned long long heapBlocks = 0;		// blocks taken from the heap since creation
+	};
+
+public:
+	static void UCreateArena(FrameArena &arena, size_t capacity = DEFAULT_CAPACITY);
+	static void UDestroyArena(FrameArena &arena);
+
+	// size bytes aligned to alignment, a power of two. Never fails, may be
+	// called from any thread between resets.
+	static void *UAllocate(FrameArena &arena, size_t size, size_t alignment = alignof(std::max_align_t));
+
+	// count default constructed elements
+	template <typename T>
+	static T *UAllocateArray(FrameArena &arena, size_t count)
+	{
+		T *elements = static_cast<T *>(UAllocate(arena, count * sizeof(T), alignof(T)));
+		for (size_t i = 0; i < count; i++)
+			new (elements + i) T();
+		return elements;
+	}
+
+	// Take everything back for a new frame. Only the owner may call this,
+	// with no allocations in flight. Returns true when the last frame
+	// needed heap blocks beyond the arena's memory.
+	static bool UReset(FrameArena &arena);
+};
@@ -0,0 +1,443 @@
+///////////////////////////////////////////////////////////////////////////////
+// bvh.cpp
+// =======
+// bounding volume hierarchy over axis aligned boxes
+///////////////////////////////////////////////////////////////////////////////
+
+#include "bvh.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	const int binCount = 12;
+
+	// Below this depth the builder stops looking for good splits and halves
+	// the items instead, which bounds the traversal stack
+	const int maxSahDepth = 48;
+	const int maxStackDepth = maxSahDepth + 48;
+
+	// Relative cost of visiting a node against testing one item
+	const float traversalCost = 1.0f;
+
+	// Half the surface area, the constant factor cancels out in the heuristic
+	float HalfArea(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax)
+	{
+		glm::vec3 size = glm::max(boundsMax - boundsMin, glm::vec3(0.0f));
+		return size.x * size.y + size.y * size.z + size.z * size.x;
+	}
+
+	// Slab test, returns the distance where the ray enters the box or a
+	// negative value when it misses it within maxDistance
+	float RayBoxDistance(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax,
+		const glm::vec3 &origin, const glm::vec3 &inverseDirection, float maxDistance)
+	{
+		glm::vec3 t0 = (boundsMin - origin) * inverseDirection;
+		glm::vec3 t1 = (boundsMax - origin) * inverseDirection;
+		glm::vec3 tNear = glm::min(t0, t1);
+		glm::vec3 tFar = glm::max(t0, t1);
+		float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+		float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+		return enter <= exit ? enter : -1.0f;
+	}
+
+	struct Bin
+	{
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+		std::uint32_t count;
+	};
+}
+
+Bvh::Bvh() : mLastVisited(0)
+{
+}
+
+///////////////////////////////////////////////////
+//	Build(const glm::vec3*, const glm::vec3*, size_t)
+//
+//	Top down binned SAH build
+///////////////////////////////////////////////////
+void Bvh::Build(const glm::vec3 *boxMin, const glm::vec3 *boxMax, size_t count)
+{
+	mNodes.clear();
+	mParents.clear();
+	mSubtreeFirst.clear();
+	mSubtreeCount.clear();
+	mItemMin.assign(boxMin, boxMin + count);
+	mItemMax.assign(boxMax, boxMax + count);
+	mCentroids.resize(count);
+	mItems.resize(count);
+	mItemLeaves.resize(count);
+	if (count == 0)
+		return;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		mCentroids[i] = (boxMin[i] + boxMax[i]) * 0.5f;
+		mItems[i] = std::uint32_t(i);
+	}
+
+	// a binary tree with at most one item per leaf has fewer than 2n nodes
+	mNodes.reserve(2 * count);
+	mParents.reserve(2 * count);
+	UBuildNode(0, std::uint32_t(count), 0);
+	mParents[0] = 0;
+}
+
+std::uint32_t Bvh::UBuildNode(std::uint32_t first, std::uint32_t count, int depth)
+{
+	const std::uint32_t index = std::uint32_t(mNodes.size());
+	mNodes.push_back(Node());
+	mParents.push_back(0);
+	mSubtreeFirst.push_back(first);
+	mSubtreeCount.push_back(count);
+
+	// bounds of the items and of their centroids
+	glm::vec3 boundsMin = mItemMin[mItems[first]];
+	glm::vec3 boundsMax = mItemMax[mItems[first]];
+	glm::vec3 centroidMin = mCentroids[mItems[first]];
+	glm::vec3 centroidMax = centroidMin;
+	for (std::uint32_t i = first + 1; i < first + count; i++)
+	{
+		std::uint32_t item = mItems[i];
+		boundsMin = glm::min(boundsMin, mItemMin[item]);
+		boundsMax = glm::max(boundsMax, mItemMax[item]);
+		centroidMin = glm::min(centroidMin, mCentroids[item]);
+		centroidMax = glm::max(centroidMax, mCentroids[item]);
+	}
+	mNodes[index].boundsMin = boundsMin;
+	mNodes[index].boundsMax = boundsMax;
+
+	const float leafCost = float(count);
+	const float area = HalfArea(boundsMin, boundsMax);
+
+	// find the cheapest split plane between bins on every axis
+	int bestAxis = -1;
+	int bestSplit = 0;
+	float bestCost = 0.0f;
+	if (count > 1 && depth < maxSahDepth)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float extent = centroidMax[axis] - centroidMin[axis];
+			if (extent <= 0.0f)
+				continue;
+
+			Bin bins[binCount];
+			for (int b = 0; b < binCount; b++)
+			{
+				bins[b].boundsMin = glm::vec3(0.0f);
+				bins[b].boundsMax = glm::vec3(0.0f);
+				bins[b].count = 0;
+			}
+
+			const float scale = binCount / extent;
+			for (std::uint32_t i = first; i < first + count; i++)
+			{
+				std::uint32_t item = mItems[i];
+				int b = std::min(binCount - 1, int((mCentroids[item][axis] - centroidMin[axis]) * scale));
+				if (bins[b].count == 0)
+				{
+					bins[b].boundsMin = mItemMin[item];
+					bins[b].boundsMax = mItemMax[item];
+				}
+				else
+				{
+					bins[b].boundsMin = glm::min(bins[b].boundsMin, mItemMin[item]);
+					bins[b].boundsMax = glm::max(bins[b].boundsMax, mItemMax[item]);
+				}
+				bins[b].count++;
+			}
+
+			// sweep from the right, then from the left, to cost every split
+			float rightArea[binCount];
+			std::uint32_t rightCount[binCount];
+			glm::vec3 sweepMin(0.0f), sweepMax(0.0f);
+			std::uint32_t sweepCount = 0;
+			for (int b = binCount - 1; b > 0; b--)
+			{
+				if (bins[b].count > 0)
+				{
+					sweepMin = sweepCount ? glm::min(sweepMin, bins[b].boundsMin) : bins[b].boundsMin;
+					sweepMax = sweepCount ? glm::max(sweepMax, bins[b].boundsMax) : bins[b].boundsMax;
+					sweepCount += bins[b].count;
+				}
+				rightArea[b] = sweepCount ? HalfArea(sweepMin, sweepMax) : 0.0f;
+				rightCount[b] = sweepCount;
+			}
+
+			sweepCount = 0;
+			for (int b = 0; b < binCount - 1; b++)
+			{
+				if (bins[b].count > 0)
+				{
+					sweepMin = sweepCount ? glm::min(sweepMin, bins[b].boundsMin) : bins[b].boundsMin;
+					sweepMax = sweepCount ? glm::max(sweepMax, bins[b].boundsMax) : bins[b].boundsMax;
+					sweepCount += bins[b].count;
+				}
+				if (sweepCount == 0 || rightCount[b + 1] == 0)
+					continue;
+
+				float cost = traversalCost + (HalfArea(sweepMin, sweepMax) * sweepCount + rightArea[b + 1] * rightCount[b + 1]) / std::max(area, 1e-20f);
+				if (bestAxis < 0 || cost < bestCost)
+				{
+					bestAxis = axis;
+					bestSplit = b;
+					bestCost = cost;
+				}
+			}
+		}
+	}
+
+	// small nodes stay leaves when splitting does not pay off
+	if (count == 1 || (count <= MAX_LEAF_ITEMS && (bestAxis < 0 || bestCost >= leafCost)))
+	{
+		mNodes[index].offset = first;
+		mNodes[index].count = count;
+		for (std::uint32_t i = first; i < first + count; i++)
+			mItemLeaves[mItems[i]] = index;
+		return index;
+	}
+
+	std::uint32_t *begin = mItems.data() + first;
+	std::uint32_t *end = begin + count;
+	std::uint32_t *middle;
+	if (bestAxis >= 0)
+	{
+		const float scale = binCount / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+		const float axisMin = centroidMin[bestAxis];
+		const int axis = bestAxis;
+		const int split = bestSplit;
+		middle = std::partition(begin, end, [&](std::uint32_t item)
+		{
+			return std::min(binCount - 1, int((mCentroids[item][axis] - axisMin) * scale)) <= split;
+		});
+	}
+	else
+	{
+		// all centroids coincide, or the tree got too deep: halve along the longest axis
+		glm::vec3 extent = centroidMax - centroidMin;
+		int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+		middle = begin + count / 2;
+		std::nth_element(begin, middle, end, [&](std::uint32_t a, std::uint32_t b)
+		{
+			return mCentroids[a][axis] < mCentroids[b][axis];
+		});
+	}
+
+	const std::uint32_t leftCount = std::uint32_t(middle - begin);
+	std::uint32_t left = UBuildNode(first, leftCount, depth + 1);
+	std::uint32_t right = UBuildNode(first + leftCount, count - leftCount, depth + 1);
+	mParents[left] = index;
+	mParents[right] = index;
+	mNodes[index].offset = right;
+	mNodes[index].count = 0;
+	return index;
+}
+
+///////////////////////////////////////////////////
+//	Refit(size_t, const glm::vec3&, const glm::vec3&)
+//
+//	Recompute the leaf of the item, then its
+//	ancestors until one does not change
+///////////////////////////////////////////////////
+void Bvh::Refit(size_t item, const glm::vec3 &boxMin, const glm::vec3 &boxMax)
+{
+	if (item >= mItemMin.size() || mNodes.empty())
+		return;
+
+	mItemMin[item] = boxMin;
+	mItemMax[item] = boxMax;
+	mCentroids[item] = (boxMin + boxMax) * 0.5f;
+
+	std::uint32_t node = mItemLeaves[item];
+	for (;;)
+	{
+		glm::vec3 oldMin = mNodes[node].boundsMin;
+		glm::vec3 oldMax = mNodes[node].boundsMax;
+		URefitNode(node);
+		if (node == 0 || (mNodes[node].boundsMin == oldMin && mNodes[node].boundsMax == oldMax))
+			break;
+		node = mParents[node];
+	}
+}
+
+void Bvh::URefitNode(std::uint32_t index)
+{
+	Node &node = mNodes[index];
+	if (node.count > 0)
+	{
+		node.boundsMin = mItemMin[mItems[node.offset]];
+		node.boundsMax = mItemMax[mItems[node.offset]];
+		for (std::uint32_t i = node.offset + 1; i < node.offset + node.count; i++)
+		{
+			node.boundsMin = glm::min(node.boundsMin, mItemMin[mItems[i]]);
+			node.boundsMax = glm::max(node.boundsMax, mItemMax[mItems[i]]);
+		}
+	}
+	else
+	{
+		const Node &left = mNodes[index + 1];
+		const Node &right = mNodes[node.offset];
+		node.boundsMin = glm::min(left.boundsMin, right.boundsMin);
+		node.boundsMax = glm::max(left.boundsMax, right.boundsMax);
+	}
+}
+
+///////////////////////////////////////////////////
+//	Cull(const Frustum&, unsigned char*)
+//
+//	Depth first traversal with an explicit stack
+///////////////////////////////////////////////////
+size_t Bvh::Cull(const Frustum &frustum, unsigned char *visible) const
+{
+	mLastVisited = 0;
+	if (mItems.empty())
+		return 0;
+
+	std::memset(visible, 0, mItems.size());
+	if (mNodes.empty())
+		return 0;
+
+	size_t visibleCount = 0;
+	std::uint32_t stack[maxStackDepth];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		std::uint32_t index = stack[--stackSize];
+		const Node &node = mNodes[index];
+		mLastVisited++;
+
+		glm::vec3 center = (node.boundsMin + node.boundsMax) * 0.5f;
+		glm::vec3 extent = (node.boundsMax - node.boundsMin) * 0.5f;
+		Frustum::Containment containment = frustum.ClassifyBox(center, extent);
+		if (containment == Frustum::CONTAINMENT_OUTSIDE)
+			continue;
+
+		// the whole subtree is inside, accept every item below it
+		if (containment == Frustum::CONTAINMENT_INSIDE)
+		{
+			std::uint32_t first = mSubtreeFirst[index];
+			for (std::uint32_t i = first; i < first + mSubtreeCount[index]; i++)
+				visible[mItems[i]] = 1;
+			visibleCount += mSubtreeCount[index];
+			continue;
+		}
+
+		if (node.count > 0)
+		{
+			for (std::uint32_t i = node.offset; i < node.offset + node.count; i++)
+			{
+				std::uint32_t item = mItems[i];
+				if (frustum.IntersectsBox((mItemMin[item] + mItemMax[item]) * 0.5f, (mItemMax[item] - mItemMin[item]) * 0.5f))
+				{
+					visible[item] = 1;
+					visibleCount++;
+				}
+			}
+			continue;
+		}
+
+		// visit the left child first, it is next in memory
+		stack[stackSize++] = node.offset;
+		stack[stackSize++] = index + 1;
+	}
+	return visibleCount;
+}
+
+///////////////////////////////////////////////////
+//	Raycast(...)
+//
+//	Closest hit traversal: the nearer child is
+//	visited first and every box starting beyond
+//	the best hit so far is skipped
+///////////////////////////////////////////////////
+bool Bvh::Raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance,
+	ItemRayTest test, void *context, std::uint32_t &item, float &distance) const
+{
+	mLastVisited = 0;
+	if (mNodes.empty())
+		return false;
+
+	const glm::vec3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	bool hit = false;
+	float closest = maxDistance;
+
+	struct Entry
+	{
+		std::uint32_t node;
+		float distance;
+	};
+	Entry stack[maxStackDepth];
+	int stackSize = 0;
+
+	float rootDistance = RayBoxDistance(mNodes[0].boundsMin, mNodes[0].boundsMax, origin, inverseDirection, closest);
+	if (rootDistance < 0.0f)
+		return false;
+	stack[stackSize].node = 0;
+	stack[stackSize].distance = rootDistance;
+	stackSize++;
+
+	while (stackSize > 0)
+	{
+		Entry entry = stack[--stackSize];
+		if (entry.distance > closest)
+			continue;
+
+		const Node &node = mNodes[entry.node];
+		mLastVisited++;
+
+		if (node.count > 0)
+		{
+			for (std::uint32_t i = node.offset; i < node.offset + node.count; i++)
+			{
+				std::uint32_t candidate = mItems[i];
+				if (RayBoxDistance(mItemMin[candidate], mItemMax[candidate], origin, inverseDirection, closest) < 0.0f)
+					continue;
+
+				float t = test(context, candidate, origin, direction, closest);
+				if (t >= 0.0f && t <= closest)
+				{
+					closest = t;
+					item = candidate;
+					hit = true;
+				}
+			}
+			continue;
+		}
+
+		std::uint32_t left = entry.node + 1;
+		std::uint32_t right = node.offset;
+		float leftDistance = RayBoxDistance(mNodes[left].boundsMin, mNodes[left].boundsMax, origin, inverseDirection, closest);
+		float rightDistance = RayBoxDistance(mNodes[right].boundsMin, mNodes[right].boundsMax, origin, inverseDirection, closest);
+
+		// push the farther child first so the nearer one is popped next
+		if (leftDistance >= 0.0f && rightDistance >= 0.0f && leftDistance < rightDistance)
+		{
+			stack[stackSize].node = right;
+			stack[stackSize++].distance = rightDistance;
+			stack[stackSize].node = left;
+			stack[stackSize++].distance = leftDistance;
+		}
+		else
+		{
+			if (leftDistance >= 0.0f)
+			{
+				stack[stackSize].node = left;
+				stack[stackSize++].distance = leftDistance;
+			}
+			if (rightDistance >= 0.0f)
+			{
+				stack[stackSize].node = right;
+				stack[stackSize++].distance = rightDistance;
+			}
+		}
+	}
+
+	if (hit)
+		distance = closest;
+	return hit;
+}
@@ -0,0 +1,94 @@
+///////////////////////////////////////////////////////////////////////////////
+// bvh.h
+// =====
+// bounding volume hierarchy over axis aligned boxes
+//
+// The tree is built top down with the surface area heuristic and stored
+// flattened in depth first order: the left child of a node always follows
+// it in the array, so a traversal mostly walks forward through memory.
+// When items move the boxes are refit bottom up without rebuilding, which
+// keeps the topology but stays correct. Rebuild after large changes.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "frustum.h"
+
+class Bvh
+{
+
+public:
+	static const std::uint32_t MAX_LEAF_ITEMS = 4;
+
+	// One tree node (32 bytes). Interior nodes have count 0, their left
+	// child is the next node and their right child is at offset. Leaves
+	// cover items [offset, offset + count) of the item order.
+	struct Node
+	{
+		glm::vec3 boundsMin;
+		std::uint32_t offset;
+		glm::vec3 boundsMax;
+		std::uint32_t count;
+	};
+
+	// Exact test of a ray against one item, called for every item whose box
+	// the ray enters before maxDistance. Returns the hit distance along the
+	// ray, or a negative value on a miss.
+	typedef float (*ItemRayTest)(void *context, std::uint32_t item,
+		const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance);
+
+public:
+	Bvh();
+
+	// Build a new tree over count boxes
+	void Build(const glm::vec3 *boxMin, const glm::vec3 *boxMax, size_t count);
+
+	// Change the box of one item and grow or shrink its ancestors to match
+	void Refit(size_t item, const glm::vec3 &boxMin, const glm::vec3 &boxMax);
+
+	// Write 1 for items touching the frustum and 0 for the others. Subtrees
+	// entirely inside are accepted and subtrees outside rejected with one
+	// test. Returns the number of visible items.
+	size_t Cull(const Frustum &frustum, unsigned char *visible) const;
+
+	// Find the closest item hit by origin + t * direction, 0 <= t <= maxDistance.
+	// Children are visited front to back and boxes behind the closest hit so
+	// far are skipped. Returns false when nothing is hit.
+	bool Raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance,
+		ItemRayTest test, void *context, std::uint32_t &item, float &distance) const;
+
+	bool Empty() const { return mNodes.empty(); }
+	size_t NodeCount() const { return mNodes.size(); }
+	size_t ItemCount() const { return mItems.size(); }
+	const std::vector<Node> &Nodes() const { return mNodes; }
+
+	// Item stored at a position of the leaf order
+	std::uint32_t Item(size_t position) const { return mItems[position]; }
+
+	// Number of nodes visited by the last Cull() or Raycast()
+	size_t LastVisited() const { return mLastVisited; }
+
+private:
+	std::uint32_t UBuildNode(std::uint32_t first, std::uint32_t count, int depth);
+	void URefitNode(std::uint32_t node);
+
+	std::vector<Node> mNodes;
+	std::vector<std::uint32_t> mParents;		// parent of every node, the root points at itself
+	std::vector<std::uint32_t> mItems;			// item indices in leaf order
+	std::vector<std::uint32_t> mItemLeaves;		// leaf holding every item
+	std::vector<std::uint32_t> mSubtreeFirst;	// first item position below every node
+	std::vector<std::uint32_t> mSubtreeCount;	// number of items below every node
+
+	// Item boxes kept for refitting and for building
+	std::vector<glm::vec3> mItemMin;
+	std::vector<glm::vec3> mItemMax;
+	std::vector<glm::vec3> mCentroids;
+
+	mutable size_t mLastVisited;
+};
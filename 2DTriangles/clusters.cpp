@@ -0,0 +1,399 @@
+///////////////////////////////////////////////////////////////////////////////
+// clusters.cpp
+// ============
+// clustered forward lighting: point lights binned into a view space grid
+///////////////////////////////////////////////////////////////////////////////
+
+#include "clusters.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#ifndef GLSL
+#define GLSL(Version, Source) "#version " #Version " core \n" #Source
+#endif
+
+namespace
+{
+	const GLuint workGroupSize = 64;
+
+	/* Light assignment compute shader: one invocation per cluster, the
+	   lights are moved to view space once per work group in batches */
+	const GLchar *buildShaderSource = GLSL(440,
+		layout(local_size_x = 64) in;
+
+	struct PointLight
+	{
+		vec3 position;
+		float radius;
+		vec3 color;
+		float padding;
+	};
+
+	struct ClusterBounds
+	{
+		vec4 lower;
+		vec4 upper;
+	};
+
+	layout(std430, binding = 2) readonly buffer LightBuffer { PointLight lights[]; };
+	layout(std430, binding = 3) writeonly buffer ClusterBuffer { uvec2 clusters[]; };
+	layout(std430, binding = 4) writeonly buffer LightIndexBuffer { uint lightIndices[]; };
+	layout(std430, binding = 5) readonly buffer BoundsBuffer { ClusterBounds bounds[]; };
+
+	uniform mat4 view;
+	uniform uint lightCount;
+	uniform uint clusterCount;
+	uniform uint maxLightsPerCluster;
+
+	shared vec4 viewLights[64];
+
+	void main()
+	{
+		uint cluster = gl_GlobalInvocationID.x;
+		bool valid = cluster < clusterCount;
+		vec3 lower = valid ? bounds[cluster].lower.xyz : vec3(0.0);
+		vec3 upper = valid ? bounds[cluster].upper.xyz : vec3(0.0);
+		uint first = cluster * maxLightsPerCluster;
+		uint count = 0;
+
+		for (uint batch = 0; batch < lightCount; batch += 64)
+		{
+			uint load = batch + gl_LocalInvocationIndex;
+			if (load < lightCount)
+				viewLights[gl_LocalInvocationIndex] = vec4((view * vec4(lights[load].position, 1.0)).xyz, lights[load].radius);
+			barrier();
+
+			uint batchCount = min(64, lightCount - batch);
+			for (uint i = 0; valid && i < batchCount; i++)
+			{
+				vec4 light = viewLights[i];
+				vec3 offset = light.xyz - clamp(light.xyz, lower, upper);
+				if (dot(offset, offset) <= light.w * light.w && count < maxLightsPerCluster)
+				{
+					lightIndices[first + count] = batch + i;
+					count++;
+				}
+			}
+			barrier();
+		}
+
+		if (valid)
+			clusters[cluster] = uvec2(first, count);
+	}
+	);
+
+	// View space distance of the near side of a depth slice
+	float SliceDepth(float nearPlane, float farPlane, GLuint slice)
+	{
+		return nearPlane * std::pow(farPlane / nearPlane, float(slice) / Clusters::GRID_Z);
+	}
+
+	GLuint ClusterIndex(GLuint x, GLuint y, GLuint z)
+	{
+		return x + Clusters::GRID_X * (y + Clusters::GRID_Y * z);
+	}
+
+	// Have UBind bind the cluster and index buffers themselves
+	void BindWholeBuffers(Clusters::GLClusters &clusters)
+	{
+		clusters.gridRange.buffer = clusters.clusterBuffer;
+		clusters.gridRange.offset = 0;
+		clusters.gridRange.size = sizeof(glm::uvec2) * Clusters::CLUSTER_COUNT;
+		clusters.gridRange.pointer = nullptr;
+
+		clusters.indexRange.buffer = clusters.indexBuffer;
+		clusters.indexRange.offset = 0;
+		clusters.indexRange.size = sizeof(GLuint) * Clusters::CLUSTER_COUNT * Clusters::MAX_LIGHTS_PER_CLUSTER;
+		clusters.indexRange.pointer = nullptr;
+	}
+
+	///////////////////////////////////////////////////
+	//	UpdateBounds(GLClusters&, const glm::mat4&, float, float)
+	//
+	//	The corners of a cluster are where the rays
+	//	through its tile corners cross the view depth
+	//	of its slice, which works for orthographic
+	//	projections too
+	///////////////////////////////////////////////////
+	void UpdateBounds(Clusters::GLClusters &clusters, const glm::mat4 &projection, float nearPlane, float farPlane)
+	{
+		if (!clusters.bounds.empty() && clusters.boundsProjection == projection
+			&& clusters.nearPlane == nearPlane && clusters.farPlane == farPlane)
+			return;
+
+		clusters.boundsProjection = projection;
+		clusters.nearPlane = nearPlane;
+		clusters.farPlane = farPlane;
+		clusters.boundsUploaded = false;
+		clusters.bounds.resize(Clusters::CLUSTER_COUNT);
+
+		glm::mat4 inverseProjection = glm::inverse(projection);
+
+		for (GLuint z = 0; z < Clusters::GRID_Z; z++)
+		{
+			float depths[2] = { SliceDepth(nearPlane, farPlane, z), SliceDepth(nearPlane, farPlane, z + 1) };
+			for (GLuint y = 0; y < Clusters::GRID_Y; y++)
+			{
+				for (GLuint x = 0; x < Clusters::GRID_X; x++)
+				{
+					glm::vec3 lower(1e30f);
+					glm::vec3 upper(-1e30f);
+					for (int corner = 0; corner < 4; corner++)
+					{
+						float ndcX = -1.0f + 2.0f * float(x + (corner & 1)) / Clusters::GRID_X;
+						float ndcY = -1.0f + 2.0f * float(y + (corner >> 1)) / Clusters::GRID_Y;
+						glm::vec4 nearPoint = inverseProjection * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+						glm::vec4 farPoint = inverseProjection * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+						glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+						glm::vec3 direction = glm::vec3(farPoint) / farPoint.w - origin;
+						for (float depth : depths)
+						{
+							glm::vec3 point = origin + direction * ((-depth - origin.z) / direction.z);
+							lower = glm::min(lower, point);
+							upper = glm::max(upper, point);
+						}
+					}
+
+					Clusters::ClusterBounds &bounds = clusters.bounds[ClusterIndex(x, y, z)];
+					bounds.min = glm::vec4(lower, 0.0f);
+					bounds.max = glm::vec4(upper, 0.0f);
+				}
+			}
+		}
+	}
+}
+
+///////////////////////////////////////////////////
+//	UCreateClusters(GLClusters&)
+//
+//	Compile the build shader and allocate the
+//	buffers at their largest size
+///////////////////////////////////////////////////
+bool Clusters::UCreateClusters(GLClusters &clusters)
+{
+	int success = 0;
+	char infoLog[512];
+
+	clusters.program = glCreateProgram();
+	GLuint computeShaderId = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(computeShaderId, 1, &buildShaderSource, NULL);
+	glCompileShader(computeShaderId);
+	glGetShaderiv(computeShaderId, GL_COMPILE_STATUS, &success);
+	if (!success)
+	{
+		glGetShaderInfoLog(computeShaderId, sizeof(infoLog), NULL, infoLog);
+		std::cout << "ERROR::SHADER::COMPUTE::COMPILATION_FAILED\n" << infoLog << std::endl;
+		glDeleteShader(computeShaderId);
+		return false;
+	}
+
+	glAttachShader(clusters.program, computeShaderId);
+	glLinkProgram(clusters.program);
+	glDeleteShader(computeShaderId);
+	glGetProgramiv(clusters.program, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		glGetProgramInfoLog(clusters.program, sizeof(infoLog), NULL, infoLog);
+		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+		return false;
+	}
+
+	// every cluster starts out empty
+	clusters.grid.assign(CLUSTER_COUNT, glm::uvec2(0));
+
+	glGenBuffers(1, &clusters.lightBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusters.lightBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(PointLight), NULL, GL_DYNAMIC_DRAW);
+
+	glGenBuffers(1, &clusters.clusterBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusters.clusterBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(glm::uvec2) * CLUSTER_COUNT, clusters.grid.data(), GL_DYNAMIC_DRAW);
+
+	glGenBuffers(1, &clusters.indexBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusters.indexBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER, NULL, GL_DYNAMIC_DRAW);
+
+	glGenBuffers(1, &clusters.boundsBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusters.boundsBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(ClusterBounds) * CLUSTER_COUNT, NULL, GL_DYNAMIC_DRAW);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	BindWholeBuffers(clusters);
+	return true;
+}
+
+void Clusters::UDestroyClusters(GLClusters &clusters)
+{
+	glDeleteProgram(clusters.program);
+	glDeleteBuffers(1, &clusters.lightBuffer);
+	glDeleteBuffers(1, &clusters.clusterBuffer);
+	glDeleteBuffers(1, &clusters.indexBuffer);
+	glDeleteBuffers(1, &clusters.boundsBuffer);
+	clusters = GLClusters();
+}
+
+void Clusters::USetLights(GLClusters &clusters, const PointLight *lights, size_t count)
+{
+	clusters.lights.assign(lights, lights + count);
+
+	// keep at least one light allocated so the buffer can always be bound
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusters.lightBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(PointLight) * std::max<size_t>(count, 1), NULL, GL_DYNAMIC_DRAW);
+	if (count > 0)
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(PointLight) * count, lights);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+///////////////////////////////////////////////////
+//	UBuildCPU(GLClusters&, Jobs::Scheduler&, StreamBuffer::GLStreamBuffer&, const glm::mat4&, const glm::mat4&, float, float)
+//
+//	Every depth slice is a job: it keeps the lights
+//	overlapping its depth range, then tests them
+//	against each of its clusters. The per slice
+//	lists are joined into one index list at the end.
+///////////////////////////////////////////////////
+void Clusters::UBuildCPU(GLClusters &clusters, Jobs::Scheduler &jobs, StreamBuffer::GLStreamBuffer &stream, const glm::mat4 &view, const glm::mat4 &projection, float nearPlane, float farPlane)
+{
+	UpdateBounds(clusters, projection, nearPlane, farPlane);
+
+	const GLuint lightCount = GLuint(clusters.lights.size());
+	clusters.viewLights.resize(lightCount);
+	for (GLuint i = 0; i < lightCount; i++)
+	{
+		const PointLight &light = clusters.lights[i];
+		clusters.viewLights[i] = glm::vec4(glm::vec3(view * glm::vec4(light.position, 1.0f)), light.radius);
+	}
+
+	Jobs::UParallelFor(jobs, GRID_Z, 1, [&clusters, lightCount, nearPlane, farPlane](size_t slice)
+	{
+		GLuint z = GLuint(slice);
+		std::vector<GLuint> &candidates = clusters.sliceCandidates[z];
+		std::vector<GLuint> &indices = clusters.sliceIndices[z];
+		std::vector<GLuint> &counts = clusters.sliceCounts[z];
+		candidates.clear();
+		indices.clear();
+		counts.assign(GRID_X * GRID_Y, 0);
+
+		// lights reaching into this slice, view space looks down -z
+		float sliceNear = SliceDepth(nearPlane, farPlane, z);
+		float sliceFar = SliceDepth(nearPlane, farPlane, z + 1);
+		for (GLuint i = 0; i < lightCount; i++)
+		{
+			const glm::vec4 &light = clusters.viewLights[i];
+			if (-light.z + light.w >= sliceNear && -light.z - light.w <= sliceFar)
+				candidates.push_back(i);
+		}
+
+		for (GLuint tile = 0; tile < GRID_X * GRID_Y; tile++)
+		{
+			const ClusterBounds &bounds = clusters.bounds[z * GRID_X * GRID_Y + tile];
+			for (GLuint i : candidates)
+			{
+				const glm::vec4 &light = clusters.viewLights[i];
+				if (!USphereIntersectsBox(glm::vec3(light), light.w, glm::vec3(bounds.min), glm::vec3(bounds.max)))
+					continue;
+
+				if (counts[tile] < MAX_LIGHTS_PER_CLUSTER)
+					indices.push_back(i);
+				counts[tile]++;
+			}
+		}
+	});
+
+	// join the slices, counts past the limit were not stored
+	clusters.indices.clear();
+	clusters.droppedLights = 0;
+	for (GLuint z = 0; z < GRID_Z; z++)
+	{
+		const std::vector<GLuint> &counts = clusters.sliceCounts[z];
+		GLuint first = GLuint(clusters.indices.size());
+		for (GLuint tile = 0; tile < GRID_X * GRID_Y; tile++)
+		{
+			GLuint count = std::min(counts[tile], MAX_LIGHTS_PER_CLUSTER);
+			clusters.grid[z * GRID_X * GRID_Y + tile] = glm::uvec2(first, count);
+			clusters.droppedLights += counts[tile] - count;
+			first += count;
+		}
+		clusters.indices.insert(clusters.indices.end(), clusters.sliceIndices[z].begin(), clusters.sliceIndices[z].end());
+	}
+
+	// an empty list still gets one entry so the range can be bound
+	const GLsizeiptr gridSize = sizeof(glm::uvec2) * CLUSTER_COUNT;
+	const GLsizeiptr indexSize = sizeof(GLuint) * std::max<size_t>(clusters.indices.size(), 1);
+	if (clusters.indices.empty())
+		clusters.indices.push_back(0);
+	if (StreamBuffer::UWrite(stream, clusters.grid.data(), gridSize, stream.storageAlignment, clusters.gridRange) &&
+		StreamBuffer::UWrite(stream, clusters.indices.data(), indexSize, stream.storageAlignment, clusters.indexRange))
+		return;
+
+	BindWholeBuffers(clusters);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusters.clusterBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, gridSize, clusters.grid.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusters.indexBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, indexSize, clusters.indices.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+///////////////////////////////////////////////////
+//	UBuildGPU(GLClusters&, const glm::mat4&, const glm::mat4&, float, float)
+//
+//	Each cluster writes its list into its own fixed
+//	size slot of the index buffer, so no atomics
+///////////////////////////////////////////////////
+void Clusters::UBuildGPU(GLClusters &clusters, const glm::mat4 &view, const glm::mat4 &projection, float nearPlane, float farPlane)
+{
+	UpdateBounds(clusters, projection, nearPlane, farPlane);
+	BindWholeBuffers(clusters);
+	if (!clusters.boundsUploaded)
+	{
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusters.boundsBuffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(ClusterBounds) * CLUSTER_COUNT, clusters.bounds.data());
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		clusters.boundsUploaded = true;
+	}
+
+	GLint previousProgram = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+
+	glUseProgram(clusters.program);
+	glUniformMatrix4fv(glGetUniformLocation(clusters.program, "view"), 1, GL_FALSE, glm::value_ptr(view));
+	glUniform1ui(glGetUniformLocation(clusters.program, "lightCount"), GLuint(clusters.lights.size()));
+	glUniform1ui(glGetUniformLocation(clusters.program, "clusterCount"), CLUSTER_COUNT);
+	glUniform1ui(glGetUniformLocation(clusters.program, "maxLightsPerCluster"), MAX_LIGHTS_PER_CLUSTER);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_BINDING, clusters.lightBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_BINDING, clusters.clusterBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INDEX_BINDING, clusters.indexBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BOUNDS_BINDING, clusters.boundsBuffer);
+	glDispatchCompute((CLUSTER_COUNT + workGroupSize - 1) / workGroupSize, 1, 1);
+
+	// the fragment shader reads the lists next
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	glUseProgram(previousProgram);
+}
+
+void Clusters::UBind(const GLClusters &clusters, GLuint program, GLsizei width, GLsizei height)
+{
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_BINDING, clusters.lightBuffer);
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, CLUSTER_BINDING, clusters.gridRange.buffer, clusters.gridRange.offset, clusters.gridRange.size);
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, INDEX_BINDING, clusters.indexRange.buffer, clusters.indexRange.offset, clusters.indexRange.size);
+
+	// slice = log(depth) * scale + bias, the inverse of SliceDepth()
+	float logRatio = std::log(clusters.farPlane / clusters.nearPlane);
+	float scale = float(GRID_Z) / logRatio;
+	float bias = -scale * std::log(clusters.nearPlane);
+
+	glUniform3ui(glGetUniformLocation(program, "clusterGrid"), GRID_X, GRID_Y, GRID_Z);
+	glUniform2f(glGetUniformLocation(program, "clusterScreenSize"), float(width), float(height));
+	glUniform2f(glGetUniformLocation(program, "clusterDepthSlicing"), scale, bias);
+}
+
+bool Clusters::USphereIntersectsBox(const glm::vec3 &center, float radius, const glm::vec3 &boxMin, const glm::vec3 &boxMax)
+{
+	glm::vec3 offset = center - glm::clamp(center, boxMin, boxMax);
+	return glm::dot(offset, offset) <= radius * radius;
+}
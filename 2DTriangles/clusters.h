@@ -0,0 +1,116 @@
+///////////////////////////////////////////////////////////////////////////////
+// clusters.h
+// ==========
+// clustered forward lighting: point lights binned into a view space grid
+//
+// The view frustum is split into GRID_X x GRID_Y screen tiles and GRID_Z
+// depth slices spaced exponentially between the near and far planes. Every
+// frame each cluster gets the list of point lights whose sphere of influence
+// touches its view space bounding box, so the fragment shader only loops
+// over the lights of the cluster it falls in.
+//
+// Lights, cluster ranges and light index lists live in shader storage
+// buffers bound at LIGHT_BINDING, CLUSTER_BINDING and INDEX_BINDING. The
+// lists are built either on the CPU, one depth slice per job of the job
+// scheduler, or by a compute shader with one invocation per
+// cluster. The CPU lists are written into the stream buffer ring each
+// frame and bound by range, falling back to the cluster and index buffers
+// when the ring is full.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "jobs.h"
+#include "streambuffer.h"
+
+class Clusters
+{
+
+public:
+	static const GLuint GRID_X = 16;
+	static const GLuint GRID_Y = 9;
+	static const GLuint GRID_Z = 24;
+	static const GLuint CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+
+	// Lights past this many in one cluster are dropped
+	static const GLuint MAX_LIGHTS_PER_CLUSTER = 128;
+
+	// Storage buffer bindings used by the shading and build shaders
+	static const GLuint LIGHT_BINDING = 2;
+	static const GLuint CLUSTER_BINDING = 3;
+	static const GLuint INDEX_BINDING = 4;
+	static const GLuint BOUNDS_BINDING = 5;
+
+	// World space point light, std430 layout (32 bytes)
+	struct PointLight
+	{
+		glm::vec3 position;
+		float radius;		// no light past this distance
+		glm::vec3 color;
+		float padding;
+	};
+
+	// View space bounding box of one cluster, std430 layout (32 bytes)
+	struct ClusterBounds
+	{
+		glm::vec4 min;
+		glm::vec4 max;
+	};
+
+	struct GLClusters
+	{
+		GLuint program = 0;			// compute shader building the lists
+		GLuint lightBuffer = 0;
+		GLuint clusterBuffer = 0;	// uvec2(first index, light count) per cluster
+		GLuint indexBuffer = 0;		// light indices, MAX_LIGHTS_PER_CLUSTER slots per cluster
+		GLuint boundsBuffer = 0;	// cluster bounds for the compute shader
+
+		std::vector<PointLight> lights;
+
+		// Cluster bounds, rebuilt when the projection changes
+		std::vector<ClusterBounds> bounds;
+		glm::mat4 boundsProjection;
+		float nearPlane = 0.0f;
+		float farPlane = 0.0f;
+		bool boundsUploaded = false;	// boundsBuffer matches bounds
+
+		// CPU build output and scratch space
+		std::vector<glm::uvec2> grid;
+		std::vector<GLuint> indices;
+		std::vector<glm::vec4> viewLights;	// view space center and radius
+		std::vector<GLuint> sliceCandidates[GRID_Z];	// lights overlapping each slice
+		std::vector<GLuint> sliceIndices[GRID_Z];
+		std::vector<GLuint> sliceCounts[GRID_Z];
+		GLuint droppedLights = 0;			// references past the per cluster limit
+
+		// What UBind binds at CLUSTER_BINDING and INDEX_BINDING, the last
+		// build's ranges of the stream buffer or the whole buffers above
+		StreamBuffer::Allocation gridRange;
+		StreamBuffer::Allocation indexRange;
+	};
+
+public:
+	static bool UCreateClusters(GLClusters &clusters);
+	static void UDestroyClusters(GLClusters &clusters);
+
+	// Replace the lights, positions in world space
+	static void USetLights(GLClusters &clusters, const PointLight *lights, size_t count);
+
+	// Assign the lights to clusters for a camera. near and far must be the
+	// planes used by the projection.
+	static void UBuildCPU(GLClusters &clusters, Jobs::Scheduler &jobs, StreamBuffer::GLStreamBuffer &stream, const glm::mat4 &view, const glm::mat4 &projection, float nearPlane, float farPlane);
+	static void UBuildGPU(GLClusters &clusters, const glm::mat4 &view, const glm::mat4 &projection, float nearPlane, float farPlane);
+
+	// Bind the light, cluster and index buffers and set the uniforms read by
+	// the shading program, which must be in use
+	static void UBind(const GLClusters &clusters, GLuint program, GLsizei width, GLsizei height);
+
+	// Sphere against box, both in the same space
+	static bool USphereIntersectsBox(const glm::vec3 &center, float radius, const glm::vec3 &boxMin, const glm::vec3 &boxMax);
+};
@@ -0,0 +1,160 @@
+///////////////////////////////////////////////////////////////////////////////
+// commandlist.cpp
+// ===============
+// draw commands recorded on any thread and replayed on the GL thread
+///////////////////////////////////////////////////////////////////////////////
+
+#include "commandlist.h"
+
+namespace
+{
+	void Push(CommandList::List &list, CommandList::Op op, size_t argument)
+	{
+		CommandList::Command command;
+		command.op = op;
+		command.argument = std::uint32_t(argument);
+		list.commands.push_back(command);
+	}
+}
+
+void CommandList::UReset(List &list)
+{
+	list.commands.clear();
+	list.geometry.clear();
+	list.drawData.clear();
+	list.ranges.clear();
+	list.hasPipeline = false;
+	list.pipeline = 0;
+	list.mesh = nullptr;
+}
+
+void CommandList::UBindPipeline(List &list, std::uint32_t pipeline)
+{
+	if (list.hasPipeline && list.pipeline == pipeline)
+		return;
+
+	list.hasPipeline = true;
+	list.pipeline = pipeline;
+	Push(list, OP_BIND_PIPELINE, pipeline);
+}
+
+void CommandList::UBindGeometry(List &list, const Meshes::GLMesh &mesh)
+{
+	if (list.mesh == &mesh)
+		return;
+
+	list.mesh = &mesh;
+	Push(list, OP_BIND_GEOMETRY, list.geometry.size());
+	list.geometry.push_back(&mesh);
+}
+
+void CommandList::USetDrawData(List &list, const DrawData &data)
+{
+	Push(list, OP_SET_DRAW_DATA, list.drawData.size());
+	list.drawData.push_back(data);
+}
+
+void CommandList::UDraw(List &list, GLuint firstIndex, GLuint indexCount)
+{
+	Range range;
+	range.firstIndex = firstIndex;
+	range.indexCount = indexCount;
+	Push(list, OP_DRAW, list.ranges.size());
+	list.ranges.push_back(range);
+}
+
+void CommandList::URecordParallel(Jobs::Scheduler &jobs, std::vector<List> &lists, Recorder record, void *context)
+{
+	Jobs::UParallelFor(jobs, lists.size(), 1, [&lists, record, context](size_t part)
+	{
+		UReset(lists[part]);
+		record(context, part, lists[part]);
+	});
+}
+
+///////////////////////////////////////////////////
+//	UMerge(const std::vector<List>&, List&)
+//
+//	Arguments of the appended commands are moved
+//	past the payloads already merged. Redundant
+//	binds at the seams are left to UReplay.
+///////////////////////////////////////////////////
+void CommandList::UMerge(const std::vector<List> &lists, List &merged)
+{
+	UReset(merged);
+
+	size_t commandCount = 0, geometryCount = 0, drawDataCount = 0, rangeCount = 0;
+	for (const List &list : lists)
+	{
+		commandCount += list.commands.size();
+		geometryCount += list.geometry.size();
+		drawDataCount += list.drawData.size();
+		rangeCount += list.ranges.size();
+	}
+	merged.commands.reserve(commandCount);
+	merged.geometry.reserve(geometryCount);
+	merged.drawData.reserve(drawDataCount);
+	merged.ranges.reserve(rangeCount);
+
+	for (const List &list : lists)
+	{
+		for (Command command : list.commands)
+		{
+			if (command.op == OP_BIND_GEOMETRY)
+				command.argument += std::uint32_t(merged.geometry.size());
+			else if (command.op == OP_SET_DRAW_DATA)
+				command.argument += std::uint32_t(merged.drawData.size());
+			else if (command.op == OP_DRAW)
+				command.argument += std::uint32_t(merged.ranges.size());
+			merged.commands.push_back(command);
+		}
+		merged.geometry.insert(merged.geometry.end(), list.geometry.begin(), list.geometry.end());
+		merged.drawData.insert(merged.drawData.end(), list.drawData.begin(), list.drawData.end());
+		merged.ranges.insert(merged.ranges.end(), list.ranges.begin(), list.ranges.end());
+
+		if (list.hasPipeline)
+		{
+			merged.hasPipeline = true;
+			merged.pipeline = list.pipeline;
+		}
+		if (list.mesh)
+			merged.mesh = list.mesh;
+	}
+}
+
+void CommandList::UReplay(const List &list, const Backend &backend)
+{
+	bool hasPipeline = false;
+	std::uint32_t pipeline = 0;
+	const Meshes::GLMesh *mesh = nullptr;
+
+	for (const Command &command : list.commands)
+	{
+		switch (command.op)
+		{
+		case OP_BIND_PIPELINE:
+			if (hasPipeline && pipeline == command.argument)
+				break;
+			hasPipeline = true;
+			pipeline = command.argument;
+			backend.bindPipeline(backend.context, pipeline);
+			break;
+
+		case OP_BIND_GEOMETRY:
+			if (mesh == list.geometry[command.argument])
+				break;
+			mesh = list.geometry[command.argument];
+			backend.bindGeometry(backend.context, *mesh);
+			break;
+
+		case OP_SET_DRAW_DATA:
+			backend.setDrawData(backend.context, list.drawData[command.argument]);
+			break;
+
+		case OP_DRAW:
+			if (mesh)
+				backend.draw(backend.context, *mesh, list.ranges[command.argument]);
+			break;
+		}
+	}
+}
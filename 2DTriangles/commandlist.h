@@ -0,0 +1,109 @@
+///////////////////////////////////////////////////////////////////////////////
+// commandlist.h
+// =============
+// draw commands recorded on any thread and replayed on the GL thread
+//
+// A list holds plain data, no GL calls: bind a pipeline, bind a mesh, set
+// the per draw data (transform, material, object), draw an index
+// range. Pipelines and materials are numbers the caller gives meaning to,
+// so the same list can be replayed by passes that draw it differently
+// (depth only, shading). Several lists can be recorded at once by worker
+// threads, one per part of the scene, and merged in order into the list
+// one frame replays. Binds of what is already bound are dropped while
+// recording and again while replaying, across the seams between merged
+// lists as well.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "meshes.h"
+#include "jobs.h"
+
+class CommandList
+{
+
+public:
+	enum Op
+	{
+		OP_BIND_PIPELINE,	// argument is the pipeline
+		OP_BIND_GEOMETRY,	// argument indexes List::geometry
+		OP_SET_DRAW_DATA,	// argument indexes List::drawData
+		OP_DRAW				// argument indexes List::ranges
+	};
+
+	struct Command
+	{
+		Op op;
+		std::uint32_t argument;
+	};
+
+	// Everything one draw needs besides its mesh
+	struct DrawData
+	{
+		glm::mat4 model;
+		std::uint32_t material;
+		std::uint32_t object;
+	};
+
+	struct Range
+	{
+		GLuint firstIndex;
+		GLuint indexCount;
+	};
+
+	struct List
+	{
+		std::vector<Command> commands;
+		std::vector<const Meshes::GLMesh *> geometry;
+		std::vector<DrawData> drawData;
+		std::vector<Range> ranges;
+
+		// state at the end of the list, to drop redundant binds
+		bool hasPipeline = false;
+		std::uint32_t pipeline = 0;
+		const Meshes::GLMesh *mesh = nullptr;
+	};
+
+	// Replays a list by calling back for every command that changes something
+	struct Backend
+	{
+		void *context;
+		void (*bindPipeline)(void *context, std::uint32_t pipeline);
+		void (*bindGeometry)(void *context, const Meshes::GLMesh &mesh);
+		void (*setDrawData)(void *context, const DrawData &data);
+		void (*draw)(void *context, const Meshes::GLMesh &mesh, Range range);
+	};
+
+	// Fills lists[part] with record(context, part, lists[part]) for every part
+	typedef void (*Recorder)(void *context, size_t part, List &list);
+
+public:
+	// Empty the list, keeping its memory
+	static void UReset(List &list);
+
+	static void UBindPipeline(List &list, std::uint32_t pipeline);
+	static void UBindGeometry(List &list, const Meshes::GLMesh &mesh);
+	static void USetDrawData(List &list, const DrawData &data);
+
+	// Draw a range of the bound mesh's indices with the last draw data
+	static void UDraw(List &list, GLuint firstIndex, GLuint indexCount);
+
+	// Record every list as a job and wait for them. record must only read
+	// shared data.
+	static void URecordParallel(Jobs::Scheduler &jobs, std::vector<List> &lists, Recorder record, void *context);
+
+	// Append the lists to merged in order, merged is emptied first
+	static void UMerge(const std::vector<List> &lists, List &merged);
+
+	// Call back for the commands of the list in order. Must be called on the
+	// thread that owns the GL context if the callbacks use GL.
+	static void UReplay(const List &list, const Backend &backend);
+};
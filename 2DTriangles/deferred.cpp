@@ -0,0 +1,459 @@
+///////////////////////////////////////////////////////////////////////////////
+// deferred.cpp
+// ============
+// deferred shading through a compact G-buffer and a fullscreen lighting pass
+///////////////////////////////////////////////////////////////////////////////
+
+#include "deferred.h"
+#include "materials.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <iostream>
+
+#ifndef GLSL
+#define GLSL(Version, Source) "#version " #Version " core \n" #Source
+#endif
+
+namespace
+{
+	/* G-buffer fragment shader: material and normal, no lighting */
+	const GLchar *geometryFragmentShaderSource = GLSL(440,
+		in vec3 vertexFragmentNormal;
+	in vec3 vertexFragmentPos;
+	in vec2 vertexTextureCoordinate;
+
+	layout(location = 0) out vec4 gbufferAlbedo;
+	layout(location = 1) out vec2 gbufferNormal;
+	layout(location = 2) out uint fragmentObjectId;	// only written with an ID target attached
+
+	uniform uint objectId;
+
+	// Materials, see materials.h
+	struct Material
+	{
+		vec4 color;
+		int textureLayer;
+		float specularStrength;		// scales the specular intensity of both lights
+		uint variant;
+		float padding;
+	};
+	layout(std430, binding = 6) readonly buffer MaterialBuffer { Material materials[]; };
+	uniform uint materialIndex;
+	uniform sampler2DArray uTextures;
+
+	vec2 signNotZero(vec2 v)
+	{
+		return vec2(v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f);
+	}
+
+	// Unit vector to the octahedron, lower half folded over the upper one
+	vec2 octahedralEncode(vec3 n)
+	{
+		vec2 p = n.xy / (abs(n.x) + abs(n.y) + abs(n.z));
+		return n.z >= 0.0f ? p : (1.0f - abs(p.yx)) * signNotZero(p);
+	}
+
+	void main()
+	{
+		Material material = materials[materialIndex];
+		vec3 color = material.color.xyz;
+		if (material.textureLayer >= 0)
+			color = texture(uTextures, vec3(vertexTextureCoordinate, float(material.textureLayer))).xyz;
+		gbufferAlbedo = vec4(color, material.specularStrength);
+		gbufferNormal = octahedralEncode(normalize(vertexFragmentNormal));
+		fragmentObjectId = objectId;
+	}
+	);
+
+	/* Fullscreen triangle covering the viewport */
+	const GLchar *lightingVertexShaderSource = GLSL(440,
+		void main()
+	{
+		vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+		gl_Position = vec4(position * 2.0f - 1.0f, 0.0f, 1.0f);
+	}
+	);
+
+	/* Lighting fragment shader: the forward surface lighting, fed from the G-buffer */
+	const GLchar *lightingFragmentShaderSource = GLSL(440,
+		layout(location = 0) out vec4 fragmentColor;
+
+	uniform sampler2D gbufferAlbedo;
+	uniform sampler2D gbufferNormal;
+	uniform sampler2D gbufferDepth;
+	uniform mat4 inverseViewProjection;
+
+	uniform vec3 ambientColor;
+	uniform vec3 light1Color;
+	uniform vec3 light1Position;
+	uniform vec3 light2Color;
+	uniform vec3 light2Position;
+	uniform vec3 viewPosition;
+	uniform float ambientStrength = 0.1f;
+	uniform float specularIntensity1 = 0.1f;
+	uniform float highlightSize1 = 0.0f;
+	uniform float specularIntensity2 = 0.1f;
+	uniform float highlightSize2 = 0.0f;
+
+	// Clustered point lights, see clusters.h
+	struct PointLight
+	{
+		vec3 position;
+		float radius;
+		vec3 color;
+		float padding;
+	};
+	layout(std430, binding = 2) readonly buffer LightBuffer { PointLight lights[]; };
+	layout(std430, binding = 3) readonly buffer ClusterBuffer { uvec2 clusters[]; };
+	layout(std430, binding = 4) readonly buffer LightIndexBuffer { uint lightIndices[]; };
+	uniform bool clusteredLighting = false;
+	uniform mat4 view;
+	uniform uvec3 clusterGrid;
+	uniform vec2 clusterScreenSize;
+	uniform vec2 clusterDepthSlicing;
+
+	// Cascaded shadow maps, see shadows.h
+	uniform bool shadowsEnabled = false;
+	uniform sampler2DArrayShadow shadowMap;
+	uniform mat4 shadowMatrices[6];
+	uniform float shadowSplits[3];
+
+	vec3 fragmentPos;	// world position rebuilt from depth
+
+	vec2 signNotZero(vec2 v)
+	{
+		return vec2(v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f);
+	}
+
+	vec3 octahedralDecode(vec2 e)
+	{
+		vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+		if (n.z < 0.0f)
+			n.xy = (1.0f - abs(n.yx)) * signNotZero(n.xy);
+		return normalize(n);
+	}
+
+	vec3 clusteredPointLighting(vec3 norm, float viewDepth)
+	{
+		uvec2 tile = uvec2(clamp(gl_FragCoord.xy / clusterScreenSize, 0.0f, 0.9999f) * vec2(clusterGrid.xy));
+		uint slice = uint(clamp(log(max(viewDepth, 1e-4f)) * clusterDepthSlicing.x + clusterDepthSlicing.y, 0.0f, float(clusterGrid.z - 1)));
+		uvec2 range = clusters[tile.x + clusterGrid.x * (tile.y + clusterGrid.y * slice)];
+
+		vec3 lighting = vec3(0.0f);
+		for (uint i = 0; i < range.y; i++)
+		{
+			PointLight light = lights[lightIndices[range.x + i]];
+			vec3 toLight = light.position - fragmentPos;
+			float distance = length(toLight);
+			float falloff = clamp(1.0f - (distance * distance) / (light.radius * light.radius), 0.0f, 1.0f);
+			lighting += max(dot(norm, toLight / max(distance, 1e-4f)), 0.0f) * falloff * falloff * light.color;
+		}
+		return lighting;
+	}
+
+	float shadowFactor(int light, vec3 norm, float viewDepth)
+	{
+		int cascade = 0;
+		while (cascade < 3 && viewDepth > shadowSplits[cascade])
+			cascade++;
+		if (cascade == 3)
+			return 1.0f;
+
+		int layer = light * 3 + cascade;
+		vec4 position = shadowMatrices[layer] * vec4(fragmentPos + norm * 0.02f, 1.0f);
+		vec3 coord = position.xyz / position.w;
+		vec2 texel = 1.0f / vec2(textureSize(shadowMap, 0).xy);
+		float lit = 0.0f;
+		for (int y = -1; y <= 1; y++)
+		{
+			for (int x = -1; x <= 1; x++)
+				lit += texture(shadowMap, vec4(coord.xy + vec2(x, y) * texel, float(layer), coord.z));
+		}
+		return lit / 9.0f;
+	}
+
+	void main()
+	{
+		ivec2 pixel = ivec2(gl_FragCoord.xy);
+		float depth = texelFetch(gbufferDepth, pixel, 0).x;
+		if (depth == 1.0f)
+			discard;	// nothing drawn, keep the clear color
+
+		vec4 albedo = texelFetch(gbufferAlbedo, pixel, 0);
+		vec3 norm = octahedralDecode(texelFetch(gbufferNormal, pixel, 0).xy);
+		vec2 ndc = (vec2(pixel) + 0.5f) / vec2(textureSize(gbufferDepth, 0)) * 2.0f - 1.0f;
+		vec4 world = inverseViewProjection * vec4(ndc, depth * 2.0f - 1.0f, 1.0f);
+		fragmentPos = world.xyz / world.w;
+
+		vec3 ambient = ambientStrength * ambientColor;
+		vec3 light1Direction = normalize(light1Position - fragmentPos);
+		vec3 diffuse1 = max(dot(norm, light1Direction), 0.0) * light1Color;
+		vec3 light2Direction = normalize(light2Position - fragmentPos);
+		vec3 diffuse2 = max(dot(norm, light2Direction), 0.0) * light2Color;
+
+		vec3 viewDir = normalize(viewPosition - fragmentPos);
+		float specularComponent1 = pow(max(dot(viewDir, reflect(-light1Direction, norm)), 0.0), highlightSize1);
+		vec3 specular1 = albedo.w * specularIntensity1 * specularComponent1 * light1Color;
+		float specularComponent2 = pow(max(dot(viewDir, reflect(-light2Direction, norm)), 0.0), highlightSize2);
+		vec3 specular2 = albedo.w * specularIntensity2 * specularComponent2 * light2Color;
+
+		float viewDepth = -(view * vec4(fragmentPos, 1.0f)).z;
+		float shadow1 = 1.0f;
+		float shadow2 = 1.0f;
+		if (shadowsEnabled)
+		{
+			shadow1 = shadowFactor(0, norm, viewDepth);
+			shadow2 = shadowFactor(1, norm, viewDepth);
+		}
+
+		vec3 phong1 = (ambient + shadow1 * diffuse1 + shadow1 * specular1) * albedo.xyz;
+		vec3 phong2 = (ambient + shadow2 * diffuse2 + shadow2 * specular2) * albedo.xyz;
+		fragmentColor = vec4(phong1 + phong2, 1.0f);
+
+		if (clusteredLighting)
+			fragmentColor.xyz += clusteredPointLighting(norm, viewDepth) * albedo.xyz;
+
+		// the target's depth becomes the G-buffer depth, as if drawn forward
+		gl_FragDepth = depth;
+	}
+	);
+
+	bool CompileShader(GLenum type, const GLchar *source, const char *name, GLuint &shaderId)
+	{
+		int success = 0;
+		char infoLog[512];
+
+		shaderId = glCreateShader(type);
+		glShaderSource(shaderId, 1, &source, NULL);
+		glCompileShader(shaderId);
+		glGetShaderiv(shaderId, GL_COMPILE_STATUS, &success);
+		if (!success)
+		{
+			glGetShaderInfoLog(shaderId, sizeof(infoLog), NULL, infoLog);
+			std::cout << "ERROR::SHADER::" << name << "::COMPILATION_FAILED\n" << infoLog << std::endl;
+			glDeleteShader(shaderId);
+			shaderId = 0;
+			return false;
+		}
+		return true;
+	}
+
+	bool LinkProgram(const GLchar *vertexSource, const GLchar *fragmentSource, GLuint &programId)
+	{
+		int success = 0;
+		char infoLog[512];
+
+		GLuint vertexShaderId, fragmentShaderId;
+		if (!CompileShader(GL_VERTEX_SHADER, vertexSource, "VERTEX", vertexShaderId))
+			return false;
+		if (!CompileShader(GL_FRAGMENT_SHADER, fragmentSource, "FRAGMENT", fragmentShaderId))
+		{
+			glDeleteShader(vertexShaderId);
+			return false;
+		}
+
+		programId = glCreateProgram();
+		glAttachShader(programId, vertexShaderId);
+		glAttachShader(programId, fragmentShaderId);
+		glLinkProgram(programId);
+		glDeleteShader(vertexShaderId);
+		glDeleteShader(fragmentShaderId);
+		glGetProgramiv(programId, GL_LINK_STATUS, &success);
+		if (!success)
+		{
+			glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
+			std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	void CreateTarget(GLuint &texture, GLenum format, GLsizei width, GLsizei height)
+	{
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexStorage2D(GL_TEXTURE_2D, 1, format, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+
+	void DestroyTargets(Deferred::GLDeferred &deferred)
+	{
+		glDeleteFramebuffers(1, &deferred.framebuffer);
+		glDeleteTextures(1, &deferred.albedoTexture);
+		glDeleteTextures(1, &deferred.normalTexture);
+		glDeleteTextures(1, &deferred.depthTexture);
+		deferred.framebuffer = 0;
+		deferred.albedoTexture = 0;
+		deferred.normalTexture = 0;
+		deferred.depthTexture = 0;
+		deferred.idTexture = 0;
+		deferred.width = 0;
+		deferred.height = 0;
+	}
+
+	bool CreateTargets(Deferred::GLDeferred &deferred, GLsizei width, GLsizei height)
+	{
+		deferred.width = width;
+		deferred.height = height;
+
+		CreateTarget(deferred.albedoTexture, GL_RGBA8, width, height);
+		CreateTarget(deferred.normalTexture, GL_RG16_SNORM, width, height);
+		CreateTarget(deferred.depthTexture, GL_DEPTH_COMPONENT24, width, height);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glGenFramebuffers(1, &deferred.framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, deferred.framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, deferred.albedoTexture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, deferred.normalTexture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, deferred.depthTexture, 0);
+		GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+		if (status != GL_FRAMEBUFFER_COMPLETE)
+		{
+			std::cerr << "G-buffer framebuffer incomplete: 0x" << std::hex << status << std::dec << std::endl;
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			DestroyTargets(deferred);
+			return false;
+		}
+		return true;
+	}
+}
+
+///////////////////////////////////////////////////
+//	UCreateDeferred(GLDeferred&, const GLchar*)
+//
+//	Sharing the surface vertex shader keeps the
+//	G-buffer depth identical to the forward depth,
+//	so the depth pre-pass works with either path
+///////////////////////////////////////////////////
+bool Deferred::UCreateDeferred(GLDeferred &deferred, const GLchar *surfaceVertexShaderSource)
+{
+	if (!LinkProgram(surfaceVertexShaderSource, geometryFragmentShaderSource, deferred.geometryProgram))
+		return false;
+	if (!LinkProgram(lightingVertexShaderSource, lightingFragmentShaderSource, deferred.lightingProgram))
+		return false;
+
+	GLint previousProgram = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+	glUseProgram(deferred.geometryProgram);
+	glUniform1i(glGetUniformLocation(deferred.geometryProgram, "uTextures"), Materials::TEXTURE_UNIT);
+	glUseProgram(deferred.lightingProgram);
+	glUniform1i(glGetUniformLocation(deferred.lightingProgram, "gbufferAlbedo"), ALBEDO_UNIT);
+	glUniform1i(glGetUniformLocation(deferred.lightingProgram, "gbufferNormal"), NORMAL_UNIT);
+	glUniform1i(glGetUniformLocation(deferred.lightingProgram, "gbufferDepth"), DEPTH_UNIT);
+	glUseProgram(GLuint(previousProgram));
+
+	glGenVertexArrays(1, &deferred.vao);
+	glGenQueries(1, &deferred.query);
+	return true;
+}
+
+void Deferred::UDestroyDeferred(GLDeferred &deferred)
+{
+	DestroyTargets(deferred);
+	glDeleteProgram(deferred.geometryProgram);
+	glDeleteProgram(deferred.lightingProgram);
+	glDeleteVertexArrays(1, &deferred.vao);
+	glDeleteQueries(1, &deferred.query);
+	deferred = GLDeferred();
+}
+
+bool Deferred::UBeginGeometryPass(GLDeferred &deferred, GLsizei width, GLsizei height, GLuint idTexture)
+{
+	static const GLfloat clearAlbedo[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	static const GLfloat clearNormal[] = { 0.0f, 0.0f, 1.0f, 0.0f };
+	static const GLuint noObject[] = { 0, 0, 0, 0 };
+
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &deferred.targetFramebuffer);
+
+	if (width != deferred.width || height != deferred.height)
+	{
+		DestroyTargets(deferred);
+		if (!CreateTargets(deferred, width, height))
+			return false;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, deferred.framebuffer);
+	if (idTexture != deferred.idTexture)
+	{
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, idTexture, 0);
+		deferred.idTexture = idTexture;
+	}
+
+	const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, idTexture ? GLenum(GL_COLOR_ATTACHMENT2) : GLenum(GL_NONE) };
+	glDrawBuffers(3, drawBuffers);
+	glClearBufferfv(GL_COLOR, 0, clearAlbedo);
+	glClearBufferfv(GL_COLOR, 1, clearNormal);
+	if (idTexture)
+		glClearBufferuiv(GL_COLOR, 2, noObject);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	ULightingPass(GLDeferred&, const glm::mat4&, bool)
+//
+//	One fragment per pixel. The depth test always
+//	passes and writes the G-buffer depth, so later
+//	passes see the same depth buffer as forward
+///////////////////////////////////////////////////
+void Deferred::ULightingPass(GLDeferred &deferred, const glm::mat4 &viewProjection, bool measure)
+{
+	if (measure && !deferred.pending)
+	{
+		glBeginQuery(GL_TIME_ELAPSED, deferred.query);
+		deferred.measuring = true;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, GLuint(deferred.targetFramebuffer));
+
+	GLint program = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+	glUniformMatrix4fv(glGetUniformLocation(GLuint(program), "inverseViewProjection"), 1, GL_FALSE, glm::value_ptr(glm::inverse(viewProjection)));
+
+	glActiveTexture(GL_TEXTURE0 + ALBEDO_UNIT);
+	glBindTexture(GL_TEXTURE_2D, deferred.albedoTexture);
+	glActiveTexture(GL_TEXTURE0 + NORMAL_UNIT);
+	glBindTexture(GL_TEXTURE_2D, deferred.normalTexture);
+	glActiveTexture(GL_TEXTURE0 + DEPTH_UNIT);
+	glBindTexture(GL_TEXTURE_2D, deferred.depthTexture);
+	glActiveTexture(GL_TEXTURE0);
+
+	// an ID target on the destination keeps the IDs of the geometry pass
+	glColorMaski(1, GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthFunc(GL_ALWAYS);
+	glDepthMask(GL_TRUE);
+
+	glBindVertexArray(deferred.vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+
+	glDepthFunc(GL_LESS);
+	glColorMaski(1, GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+	if (deferred.measuring)
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		deferred.measuring = false;
+		deferred.pending = true;
+	}
+}
+
+bool Deferred::UPollLightingTime(GLDeferred &deferred, double &milliseconds)
+{
+	if (!deferred.pending)
+		return false;
+
+	GLuint available = 0;
+	glGetQueryObjectuiv(deferred.query, GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+		return false;
+
+	GLuint64 time = 0;
+	glGetQueryObjectui64v(deferred.query, GL_QUERY_RESULT, &time);
+	milliseconds = time / 1.0e6;
+	deferred.pending = false;
+	return true;
+}
@@ -0,0 +1,76 @@
+///////////////////////////////////////////////////////////////////////////////
+// deferred.h
+// ==========
+// deferred shading: surfaces go to a compact G-buffer, lighting runs once
+// per pixel in a fullscreen pass
+//
+// The geometry pass draws the scene with the regular surface vertex shader
+// into three targets:
+//
+//   albedo   RGBA8        surface color, specular strength in alpha
+//   normal   RG16_SNORM   world space normal, octahedral encoded
+//   depth    DEPTH24      world position is rebuilt from it
+//
+// twelve bytes per pixel. An object ID target can be attached as well so ID
+// buffer picking keeps working. The lighting pass then reads the G-buffer
+// with one fullscreen triangle and runs the same two light Phong model,
+// shadows and clustered point lights as the forward shader, writing into
+// whatever framebuffer was bound when the geometry pass began. Its depth
+// stays readable afterwards for the occlusion culling capture.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+class Deferred
+{
+
+public:
+	// Texture units the lighting pass reads the G-buffer from, clear of the
+	// surface texture (0) and the shadow maps
+	static const GLint ALBEDO_UNIT = 4;
+	static const GLint NORMAL_UNIT = 5;
+	static const GLint DEPTH_UNIT = 6;
+
+	struct GLDeferred
+	{
+		GLuint geometryProgram = 0;	// surface vertex shader, G-buffer fragment shader
+		GLuint lightingProgram = 0;	// fullscreen triangle
+		GLuint vao = 0;				// empty, the triangle comes from gl_VertexID
+
+		GLuint framebuffer = 0;
+		GLuint albedoTexture = 0;	// attachment 0
+		GLuint normalTexture = 0;	// attachment 1
+		GLuint depthTexture = 0;
+		GLuint idTexture = 0;		// attachment 2 when set, owned by the ID buffer
+		GLsizei width = 0;
+		GLsizei height = 0;
+
+		// Framebuffer the lighting pass writes to
+		GLint targetFramebuffer = 0;
+
+		// GPU time of the lighting pass, one frame in flight
+		GLuint query = 0;
+		bool measuring = false;
+		bool pending = false;
+	};
+
+public:
+	// The geometry program is linked with the scene's surface vertex shader
+	static bool UCreateDeferred(GLDeferred &deferred, const GLchar *surfaceVertexShaderSource);
+	static void UDestroyDeferred(GLDeferred &deferred);
+
+	// Bind the G-buffer, sized to the framebuffer, and clear it. idTexture is
+	// an R32UI texture of the same size written with the object IDs, or 0.
+	static bool UBeginGeometryPass(GLDeferred &deferred, GLsizei width, GLsizei height, GLuint idTexture);
+
+	// Light the G-buffer into the framebuffer bound before the geometry pass.
+	// The lighting program must be in use with the light uniforms set.
+	static void ULightingPass(GLDeferred &deferred, const glm::mat4 &viewProjection, bool measure);
+
+	// Collect the GPU time of a measured lighting pass without blocking
+	static bool UPollLightingTime(GLDeferred &deferred, double &milliseconds);
+};
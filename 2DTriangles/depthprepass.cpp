@@ -0,0 +1,223 @@
+///////////////////////////////////////////////////////////////////////////////
+// depthprepass.cpp
+// ================
+// optional depth only pre-pass in front of the shading pass
+///////////////////////////////////////////////////////////////////////////////
+
+#include "depthprepass.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <iostream>
+
+#ifndef GLSL
+#define GLSL(Version, Source) "#version " #Version " core \n" #Source
+#endif
+
+namespace
+{
+	enum Query
+	{
+		QUERY_SAMPLES,
+		QUERY_DEPTH_TIME,
+		QUERY_SHADING_TIME
+	};
+
+	/* Depth only vertex shader: same position math as the shading pass */
+	const GLchar *depthVertexShaderSource = GLSL(440,
+		layout(location = 0) in vec3 vertexPosition;
+
+	uniform mat4 model;
+	uniform mat4 view;
+	uniform mat4 projection;
+
+	// Dequantization of packed meshes (identity for float meshes)
+	uniform vec3 positionOffset = vec3(0.0f);
+	uniform vec3 positionScale = vec3(1.0f);
+
+	invariant gl_Position;
+
+	void main()
+	{
+		vec3 position = positionOffset + positionScale * vertexPosition;
+
+		gl_Position = projection * view * model * vec4(position, 1.0f);
+	}
+	);
+
+	/* Depth only fragment shader: nothing to write but depth */
+	const GLchar *depthFragmentShaderSource = GLSL(440,
+		void main()
+	{
+	}
+	);
+
+	bool CompileShader(GLenum type, const GLchar *source, const char *name, GLuint &shaderId)
+	{
+		int success = 0;
+		char infoLog[512];
+
+		shaderId = glCreateShader(type);
+		glShaderSource(shaderId, 1, &source, NULL);
+		glCompileShader(shaderId);
+		glGetShaderiv(shaderId, GL_COMPILE_STATUS, &success);
+		if (!success)
+		{
+			glGetShaderInfoLog(shaderId, sizeof(infoLog), NULL, infoLog);
+			std::cout << "ERROR::SHADER::" << name << "::COMPILATION_FAILED\n" << infoLog << std::endl;
+			glDeleteShader(shaderId);
+			shaderId = 0;
+			return false;
+		}
+		return true;
+	}
+
+	void StartMeasuring(DepthPrepass::GLDepthPrepass &pass, bool prepass)
+	{
+		// one frame in flight, frames in between are not measured
+		if (pass.pending || pass.measuring)
+			return;
+
+		pass.measuring = true;
+		pass.measuredPrepass = prepass;
+	}
+}
+
+///////////////////////////////////////////////////
+//	UCreateDepthPrepass(GLDepthPrepass&)
+//
+//	Compile the depth only program and create the
+//	queries used for the overdraw statistics
+///////////////////////////////////////////////////
+bool DepthPrepass::UCreateDepthPrepass(GLDepthPrepass &pass)
+{
+	int success = 0;
+	char infoLog[512];
+
+	GLuint vertexShaderId, fragmentShaderId;
+	if (!CompileShader(GL_VERTEX_SHADER, depthVertexShaderSource, "VERTEX", vertexShaderId))
+		return false;
+	if (!CompileShader(GL_FRAGMENT_SHADER, depthFragmentShaderSource, "FRAGMENT", fragmentShaderId))
+	{
+		glDeleteShader(vertexShaderId);
+		return false;
+	}
+
+	pass.program = glCreateProgram();
+	glAttachShader(pass.program, vertexShaderId);
+	glAttachShader(pass.program, fragmentShaderId);
+	glLinkProgram(pass.program);
+	glDeleteShader(vertexShaderId);
+	glDeleteShader(fragmentShaderId);
+	glGetProgramiv(pass.program, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		glGetProgramInfoLog(pass.program, sizeof(infoLog), NULL, infoLog);
+		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+		return false;
+	}
+
+	pass.modelLoc = glGetUniformLocation(pass.program, "model");
+	pass.viewLoc = glGetUniformLocation(pass.program, "view");
+	pass.projectionLoc = glGetUniformLocation(pass.program, "projection");
+	pass.positionOffsetLoc = glGetUniformLocation(pass.program, "positionOffset");
+	pass.positionScaleLoc = glGetUniformLocation(pass.program, "positionScale");
+
+	glGenQueries(3, pass.queries);
+	return true;
+}
+
+void DepthPrepass::UDestroyDepthPrepass(GLDepthPrepass &pass)
+{
+	glDeleteProgram(pass.program);
+	glDeleteQueries(3, pass.queries);
+	pass = GLDepthPrepass();
+}
+
+void DepthPrepass::UBeginDepthPass(GLDepthPrepass &pass, const glm::mat4 &view, const glm::mat4 &projection)
+{
+	StartMeasuring(pass, true);
+	if (pass.measuring)
+		glBeginQuery(GL_TIME_ELAPSED, pass.queries[QUERY_DEPTH_TIME]);
+
+	glUseProgram(pass.program);
+	glUniformMatrix4fv(pass.viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+	glUniformMatrix4fv(pass.projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_TRUE);
+	glDepthFunc(GL_LESS);
+}
+
+void DepthPrepass::UDrawDepth(const GLDepthPrepass &pass, const Meshes::GLMesh &mesh, const glm::mat4 &model)
+{
+	glBindVertexArray(mesh.positionVao);
+	glUniform3fv(pass.positionOffsetLoc, 1, glm::value_ptr(mesh.positionOffset));
+	glUniform3fv(pass.positionScaleLoc, 1, glm::value_ptr(mesh.positionScale));
+	glUniformMatrix4fv(pass.modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+	glDrawElements(GL_TRIANGLES, mesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+}
+
+///////////////////////////////////////////////////
+//	UBeginShadingPass(GLDepthPrepass&, bool)
+//
+//	GL_EQUAL only holds because both passes run the
+//	same invariant position math on the same data
+///////////////////////////////////////////////////
+void DepthPrepass::UBeginShadingPass(GLDepthPrepass &pass, bool afterPrepass)
+{
+	if (afterPrepass && pass.measuring)
+		glEndQuery(GL_TIME_ELAPSED);
+
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	if (afterPrepass)
+	{
+		glDepthFunc(GL_EQUAL);
+		glDepthMask(GL_FALSE);
+	}
+
+	StartMeasuring(pass, false);
+	if (pass.measuring)
+	{
+		glBeginQuery(GL_SAMPLES_PASSED, pass.queries[QUERY_SAMPLES]);
+		glBeginQuery(GL_TIME_ELAPSED, pass.queries[QUERY_SHADING_TIME]);
+	}
+}
+
+void DepthPrepass::UEndShadingPass(GLDepthPrepass &pass)
+{
+	if (pass.measuring)
+	{
+		glEndQuery(GL_SAMPLES_PASSED);
+		glEndQuery(GL_TIME_ELAPSED);
+		pass.measuring = false;
+		pass.pending = true;
+	}
+
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+}
+
+bool DepthPrepass::UPollStats(GLDepthPrepass &pass, Stats &stats)
+{
+	if (!pass.pending)
+		return false;
+
+	// the shading time query ends last, the others are done once it is
+	GLuint available = 0;
+	glGetQueryObjectuiv(pass.queries[QUERY_SHADING_TIME], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+		return false;
+
+	GLuint64 shadingTime = 0, depthTime = 0;
+	glGetQueryObjectui64v(pass.queries[QUERY_SAMPLES], GL_QUERY_RESULT, &stats.shadedSamples);
+	glGetQueryObjectui64v(pass.queries[QUERY_SHADING_TIME], GL_QUERY_RESULT, &shadingTime);
+	if (pass.measuredPrepass)
+		glGetQueryObjectui64v(pass.queries[QUERY_DEPTH_TIME], GL_QUERY_RESULT, &depthTime);
+
+	stats.prepass = pass.measuredPrepass;
+	stats.depthPassMs = depthTime / 1.0e6;
+	stats.shadingPassMs = shadingTime / 1.0e6;
+	pass.pending = false;
+	return true;
+}
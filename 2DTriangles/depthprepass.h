@@ -0,0 +1,77 @@
+///////////////////////////////////////////////////////////////////////////////
+// depthprepass.h
+// ==============
+// optional depth only pre-pass in front of the shading pass
+//
+// The pre-pass draws every visible mesh from its position only stream with
+// color writes off, so the depth buffer holds the nearest surface of every
+// pixel before any lighting runs. The shading pass then draws again with
+// depth test GL_EQUAL and depth writes off, so the fragment shader runs at
+// most once per pixel no matter how much the scene overlaps itself. Both
+// vertex shaders mark gl_Position invariant so the depths match exactly.
+//
+// Each frame can also be measured with queries: samples that passed the
+// depth test in the shading pass (fragments shaded) and the GPU time of
+// both passes. Results are collected on a later frame without stalling.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "meshes.h"
+
+class DepthPrepass
+{
+
+public:
+	// Measurements of one frame
+	struct Stats
+	{
+		bool prepass = false;			// the frame was drawn with the pre-pass
+		GLuint64 shadedSamples = 0;		// samples that ran the shading fragment shader
+		double depthPassMs = 0.0;		// GPU time, 0 without the pre-pass
+		double shadingPassMs = 0.0;
+	};
+
+	struct GLDepthPrepass
+	{
+		GLuint program = 0;
+		GLint modelLoc = -1;
+		GLint viewLoc = -1;
+		GLint projectionLoc = -1;
+		GLint positionOffsetLoc = -1;
+		GLint positionScaleLoc = -1;
+
+		// Queries of the frame being measured: samples passed, depth pass
+		// time and shading pass time
+		GLuint queries[3] = {};
+		bool measuring = false;		// queries are running this frame
+		bool pending = false;		// results not collected yet
+		bool measuredPrepass = false;
+	};
+
+public:
+	static bool UCreateDepthPrepass(GLDepthPrepass &pass);
+	static void UDestroyDepthPrepass(GLDepthPrepass &pass);
+
+	// Switch to the depth only program with color writes off
+	static void UBeginDepthPass(GLDepthPrepass &pass, const glm::mat4 &view, const glm::mat4 &projection);
+
+	// Draw an indexed mesh from its position only stream
+	static void UDrawDepth(const GLDepthPrepass &pass, const Meshes::GLMesh &mesh, const glm::mat4 &model);
+
+	// Restore color writes. After a pre-pass only fragments at exactly the
+	// stored depth pass and depth writes stay off. The caller binds its own
+	// shading program afterwards.
+	static void UBeginShadingPass(GLDepthPrepass &pass, bool afterPrepass);
+
+	// Back to GL_LESS with depth writes on
+	static void UEndShadingPass(GLDepthPrepass &pass);
+
+	// Collect the measurements of an earlier frame without blocking. Returns
+	// true once per measured frame.
+	static bool UPollStats(GLDepthPrepass &pass, Stats &stats);
+};
@@ -0,0 +1,278 @@
+///////////////////////////////////////////////////////////////////////////////
+// entities.cpp
+// ============
+// scene objects as entities made of components, stored by archetype
+///////////////////////////////////////////////////////////////////////////////
+
+#include "entities.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	const Entities::Mask boundsComponents = Entities::COMPONENT_TRANSFORM | Entities::COMPONENT_MESH | Entities::COMPONENT_BOUNDS;
+
+	// Move the last row into row and drop the last one
+	template <typename T>
+	void RemoveRow(std::vector<T> &column, size_t row)
+	{
+		column[row] = column.back();
+		column.pop_back();
+	}
+
+	void RemoveTransform(Transforms::Arrays &arrays, size_t row)
+	{
+		size_t last = arrays.count - 1;
+		float *const components[] = {
+			arrays.positionX, arrays.positionY, arrays.positionZ,
+			arrays.rotationX, arrays.rotationY, arrays.rotationZ, arrays.rotationW,
+			arrays.scaleX, arrays.scaleY, arrays.scaleZ
+		};
+		for (float *component : components)
+			component[row] = component[last];
+		arrays.count = last;
+	}
+}
+
+void Entities::UCreateWorld(World &world)
+{
+	for (int mask = 0; mask < ARCHETYPE_COUNT; mask++)
+		world.archetypes[mask].mask = Mask(mask);
+	world.alive = 0;
+}
+
+void Entities::UDestroyWorld(World &world)
+{
+	for (Archetype &archetype : world.archetypes)
+	{
+		Transforms::UDestroy(archetype.transforms);
+		archetype = Archetype();
+	}
+	world.slots = std::vector<Slot>();
+	world.freeSlots = std::vector<std::uint32_t>();
+	UCreateWorld(world);
+}
+
+void Entities::UReserve(World &world, Mask mask, size_t count)
+{
+	Archetype &archetype = world.archetypes[mask];
+	archetype.entities.reserve(count);
+	if (mask & COMPONENT_TRANSFORM)
+	{
+		Transforms::UReserve(archetype.transforms, count);
+		archetype.models.reserve(count);
+	}
+	if (mask & COMPONENT_MESH)
+		archetype.meshes.reserve(count);
+	if (mask & COMPONENT_MATERIAL)
+		archetype.materials.reserve(count);
+	if (mask & COMPONENT_BOUNDS)
+	{
+		for (std::vector<float> *column : { &archetype.centerX, &archetype.centerY, &archetype.centerZ,
+			&archetype.extentX, &archetype.extentY, &archetype.extentZ })
+			column->reserve(count);
+	}
+	if (mask & COMPONENT_LIGHT)
+		archetype.lights.reserve(count);
+
+	size_t slots = world.alive + count;
+	world.slots.reserve(slots);
+	world.freeSlots.reserve(slots);
+}
+
+///////////////////////////////////////////////////
+//	UCreate(World&, Mask)
+//
+//	Slots of destroyed entities are used again
+//	before the table grows, so the table stays as
+//	large as the most entities alive at once
+///////////////////////////////////////////////////
+Entities::Entity Entities::UCreate(World &world, Mask mask)
+{
+	Entity entity;
+	if (!world.freeSlots.empty())
+	{
+		entity.index = world.freeSlots.back();
+		world.freeSlots.pop_back();
+	}
+	else
+	{
+		entity.index = std::uint32_t(world.slots.size());
+		world.slots.push_back(Slot());
+	}
+
+	Archetype &archetype = world.archetypes[mask];
+	size_t row = archetype.count++;
+
+	Slot &slot = world.slots[entity.index];
+	slot.archetype = mask;
+	slot.row = std::uint32_t(row);
+	slot.alive = true;
+	entity.generation = slot.generation;
+	world.alive++;
+
+	archetype.entities.push_back(entity);
+	if (mask & COMPONENT_TRANSFORM)
+	{
+		Transforms::Arrays &transforms = archetype.transforms;
+		if (row + 1 > transforms.capacity)
+			Transforms::UReserve(transforms, std::max(row + 1, transforms.capacity * 2));
+		Transforms::UResize(transforms, row + 1);
+		archetype.models.push_back(glm::mat4(1.0f));
+	}
+	if (mask & COMPONENT_MESH)
+		archetype.meshes.push_back(MeshRef());
+	if (mask & COMPONENT_MATERIAL)
+		archetype.materials.push_back(Material());
+	if (mask & COMPONENT_BOUNDS)
+	{
+		for (std::vector<float> *column : { &archetype.centerX, &archetype.centerY, &archetype.centerZ,
+			&archetype.extentX, &archetype.extentY, &archetype.extentZ })
+			column->push_back(0.0f);
+	}
+	if (mask & COMPONENT_LIGHT)
+		archetype.lights.push_back(Light());
+
+	return entity;
+}
+
+///////////////////////////////////////////////////
+//	UDestroy(World&, Entity)
+//
+//	The last row of the archetype fills the hole
+//	and its owner's slot is pointed at the new row
+///////////////////////////////////////////////////
+void Entities::UDestroy(World &world, Entity entity)
+{
+	if (!UAlive(world, entity))
+		return;
+
+	Slot &slot = world.slots[entity.index];
+	Archetype &archetype = world.archetypes[slot.archetype];
+	size_t row = slot.row;
+
+	Entity moved = archetype.entities.back();
+	world.slots[moved.index].row = std::uint32_t(row);
+	RemoveRow(archetype.entities, row);
+	if (archetype.mask & COMPONENT_TRANSFORM)
+	{
+		RemoveTransform(archetype.transforms, row);
+		RemoveRow(archetype.models, row);
+	}
+	if (archetype.mask & COMPONENT_MESH)
+		RemoveRow(archetype.meshes, row);
+	if (archetype.mask & COMPONENT_MATERIAL)
+		RemoveRow(archetype.materials, row);
+	if (archetype.mask & COMPONENT_BOUNDS)
+	{
+		for (std::vector<float> *column : { &archetype.centerX, &archetype.centerY, &archetype.centerZ,
+			&archetype.extentX, &archetype.extentY, &archetype.extentZ })
+			RemoveRow(*column, row);
+	}
+	if (archetype.mask & COMPONENT_LIGHT)
+		RemoveRow(archetype.lights, row);
+	archetype.count--;
+
+	slot.alive = false;
+	slot.generation++;
+	world.freeSlots.push_back(entity.index);
+	world.alive--;
+}
+
+bool Entities::UAlive(const World &world, Entity entity)
+{
+	return entity.index < world.slots.size() && world.slots[entity.index].alive
+		&& world.slots[entity.index].generation == entity.generation;
+}
+
+Entities::Archetype &Entities::ULocate(World &world, Entity entity, size_t &row)
+{
+	const Slot &slot = world.slots[entity.index];
+	row = slot.row;
+	return world.archetypes[slot.archetype];
+}
+
+void Entities::USetTransform(World &world, Entity entity, const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale)
+{
+	size_t row;
+	Archetype &archetype = ULocate(world, entity, row);
+	Transforms::USet(archetype.transforms, row, position, rotation, scale);
+}
+
+void Entities::USetMesh(World &world, Entity entity, const MeshRef &mesh)
+{
+	size_t row;
+	Archetype &archetype = ULocate(world, entity, row);
+	archetype.meshes[row] = mesh;
+}
+
+void Entities::USetMaterial(World &world, Entity entity, const Material &material)
+{
+	size_t row;
+	Archetype &archetype = ULocate(world, entity, row);
+	archetype.materials[row] = material;
+}
+
+void Entities::USetLight(World &world, Entity entity, const Light &light)
+{
+	size_t row;
+	Archetype &archetype = ULocate(world, entity, row);
+	archetype.lights[row] = light;
+}
+
+void Entities::UUpdateTransforms(World &world)
+{
+	for (Archetype &archetype : world.archetypes)
+	{
+		if (archetype.count > 0 && UHas(archetype, COMPONENT_TRANSFORM))
+			UUpdateTransforms(archetype, 0, archetype.count);
+	}
+}
+
+///////////////////////////////////////////////////
+//	UUpdateTransforms(Archetype&, size_t, size_t)
+//
+//	Matrices in one batch, then the mesh bounding
+//	boxes moved into world space: the new center is
+//	the transformed center and every extent is the
+//	absolute matrix applied to the old extent
+///////////////////////////////////////////////////
+void Entities::UUpdateTransforms(Archetype &archetype, size_t first, size_t count)
+{
+	Transforms::UModelMatrices(archetype.transforms, first, count, archetype.models.data() + first);
+	if (!UHas(archetype, boundsComponents))
+		return;
+
+	for (size_t i = first; i < first + count; i++)
+	{
+		const glm::mat4 &model = archetype.models[i];
+		const Meshes::GLMesh &mesh = *archetype.meshes[i].mesh;
+		glm::vec3 center = (mesh.boundsMin + mesh.boundsMax) * 0.5f;
+		glm::vec3 extent = (mesh.boundsMax - mesh.boundsMin) * 0.5f;
+
+		glm::vec3 worldCenter = glm::vec3(model * glm::vec4(center, 1.0f));
+		glm::vec3 worldExtent(0.0f);
+		for (int row = 0; row < 3; row++)
+		{
+			for (int column = 0; column < 3; column++)
+				worldExtent[row] += std::fabs(model[column][row]) * extent[column];
+		}
+
+		archetype.centerX[i] = worldCenter.x;
+		archetype.centerY[i] = worldCenter.y;
+		archetype.centerZ[i] = worldCenter.z;
+		archetype.extentX[i] = worldExtent.x;
+		archetype.extentY[i] = worldExtent.y;
+		archetype.extentZ[i] = worldExtent.z;
+	}
+}
+
+size_t Entities::UCull(const Archetype &archetype, const Frustum &frustum, size_t first, size_t count, unsigned char *visible)
+{
+	if (count == 0)
+		return 0;
+
+	return frustum.UCullBoxes(archetype.centerX.data() + first, archetype.centerY.data() + first, archetype.centerZ.data() + first,
+		archetype.extentX.data() + first, archetype.extentY.data() + first, archetype.extentZ.data() + first, count, visible);
+}
@@ -0,0 +1,143 @@
+///////////////////////////////////////////////////////////////////////////////
+// entities.h
+// ==========
+// scene objects as entities made of components, stored by archetype
+//
+// An entity is only a handle, what it is comes from the components it has:
+// a transform, a mesh, a material, world bounds and a light. Entities with
+// the same set of components share an archetype, which keeps every one of
+// those components in its own dense array, so a system (cull, record draws,
+// gather lights) runs one tight loop over the arrays of each archetype that
+// has what it needs instead of visiting objects one by one. There are only
+// 32 possible sets, the archetype of a set is simply archetypes[mask].
+//
+// Transforms are the SoA arrays of the transform kernels and world bounds
+// are SoA centers and extents, the layout the frustum test reads. Destroying
+// an entity moves the last row of its archetype into the hole, so the arrays
+// never have gaps, and the handle slot goes on a free list with its
+// generation bumped, so stale handles are recognized. Arrays and the slot
+// table only grow and keep their capacity, so once a world has seen its
+// peak, creating and destroying entities does not allocate at all.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "meshes.h"
+#include "frustum.h"
+#include "transforms.h"
+
+class Entities
+{
+
+public:
+	typedef unsigned int Mask;
+
+	enum Component
+	{
+		COMPONENT_TRANSFORM = 1 << 0,
+		COMPONENT_MESH = 1 << 1,
+		COMPONENT_MATERIAL = 1 << 2,
+		COMPONENT_BOUNDS = 1 << 3,	// world bounds of the mesh, needs TRANSFORM and MESH
+		COMPONENT_LIGHT = 1 << 4
+	};
+
+	static const int ARCHETYPE_COUNT = 1 << 5;
+	static const std::uint32_t NO_ENTITY = 0xFFFFFFFFu;
+
+	struct Entity
+	{
+		std::uint32_t index = NO_ENTITY;
+		std::uint32_t generation = 0;
+	};
+
+	struct MeshRef
+	{
+		const Meshes::GLMesh *mesh = nullptr;
+		std::uint32_t pick = 0;		// CPU copy of the triangles, owned by the caller
+	};
+
+	struct Material
+	{
+		std::uint32_t id = 0;		// see materials.h
+	};
+
+	struct Light
+	{
+		glm::vec3 color = glm::vec3(1.0f);
+		float radius = 1.0f;		// no light past this distance
+	};
+
+	// Every entity with one set of components, row by row. Columns of
+	// components outside the mask stay empty.
+	struct Archetype
+	{
+		Mask mask = 0;
+		size_t count = 0;
+		std::vector<Entity> entities;	// owner of every row
+
+		Transforms::Arrays transforms;
+		std::vector<glm::mat4> models;
+		std::vector<MeshRef> meshes;
+		std::vector<Material> materials;
+		std::vector<float> centerX, centerY, centerZ;
+		std::vector<float> extentX, extentY, extentZ;
+		std::vector<Light> lights;
+	};
+
+	struct Slot
+	{
+		std::uint32_t generation = 0;
+		Mask archetype = 0;
+		std::uint32_t row = 0;
+		bool alive = false;
+	};
+
+	struct World
+	{
+		Archetype archetypes[ARCHETYPE_COUNT];
+		std::vector<Slot> slots;
+		std::vector<std::uint32_t> freeSlots;
+		size_t alive = 0;
+	};
+
+public:
+	static void UCreateWorld(World &world);
+
+	// Destroy every entity and release the arrays, the world can be used again
+	static void UDestroyWorld(World &world);
+
+	// Room for count entities of one archetype, so creating them does not allocate
+	static void UReserve(World &world, Mask mask, size_t count);
+
+	// New entity with default components, its transform is the identity
+	static Entity UCreate(World &world, Mask mask);
+	static void UDestroy(World &world, Entity entity);
+	static bool UAlive(const World &world, Entity entity);
+
+	// Archetype and row of a live entity. The row changes when another
+	// entity of the archetype is destroyed.
+	static Archetype &ULocate(World &world, Entity entity, size_t &row);
+
+	static bool UHas(const Archetype &archetype, Mask mask) { return (archetype.mask & mask) == mask; }
+
+	static void USetTransform(World &world, Entity entity, const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale);
+	static void USetMesh(World &world, Entity entity, const MeshRef &mesh);
+	static void USetMaterial(World &world, Entity entity, const Material &material);
+	static void USetLight(World &world, Entity entity, const Light &light);
+
+	// Model matrices of every transform, then world bounds where the
+	// archetype has them
+	static void UUpdateTransforms(World &world);
+	static void UUpdateTransforms(Archetype &archetype, size_t first, size_t count);
+
+	// Frustum test of rows first .. first + count - 1 of an archetype with
+	// bounds, visible holds count flags. Returns the visible count.
+	static size_t UCull(const Archetype &archetype, const Frustum &frustum, size_t first, size_t count, unsigned char *visible);
+};
@@ -0,0 +1,183 @@
+///////////////////////////////////////////////////////////////////////////////
+// framepacer.cpp
+// ==============
+// frame pacing: swap interval control, a frame rate cap and frame times
+///////////////////////////////////////////////////////////////////////////////
+
+#include "framepacer.h"
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+namespace
+{
+	const char *modeNames[FramePacer::MODE_COUNT] = { "vsync", "adaptive", "uncapped", "fixed" };
+
+	// Longest spin margin, oversleeping past this is left to the next frame
+	const double maxSpinMargin = 0.004;
+
+	void ApplySwapInterval(const FramePacer::Pacer &pacer)
+	{
+		switch (pacer.mode)
+		{
+		case FramePacer::MODE_VSYNC:
+			glfwSwapInterval(1);
+			break;
+		case FramePacer::MODE_ADAPTIVE:
+			glfwSwapInterval(pacer.tearControl ? -1 : 1);
+			break;
+		default:
+			glfwSwapInterval(0);
+			break;
+		}
+	}
+
+	void Record(FramePacer::Histogram &histogram, double milliseconds)
+	{
+		int bucket = std::min(int(milliseconds / FramePacer::BUCKET_MS), FramePacer::HISTOGRAM_BUCKETS - 1);
+		histogram.buckets[bucket]++;
+		histogram.minMs = histogram.count == 0 ? milliseconds : std::min(histogram.minMs, milliseconds);
+		histogram.maxMs = std::max(histogram.maxMs, milliseconds);
+		histogram.totalMs += milliseconds;
+		histogram.count++;
+	}
+}
+
+void FramePacer::UCreatePacer(Pacer &pacer, Mode mode, double targetFps)
+{
+	pacer = Pacer();
+	pacer.start = std::chrono::steady_clock::now();
+	pacer.tearControl = glfwExtensionSupported("WGL_EXT_swap_control_tear") || glfwExtensionSupported("GLX_EXT_swap_control_tear");
+	USetMode(pacer, mode, targetFps);
+}
+
+void FramePacer::USetMode(Pacer &pacer, Mode mode, double targetFps)
+{
+	pacer.mode = mode;
+	pacer.targetFps = std::max(targetFps, 1.0);
+	pacer.deadline = UNow(pacer);
+	pacer.histogram = Histogram();
+	ApplySwapInterval(pacer);
+
+	if (mode == MODE_ADAPTIVE && !pacer.tearControl)
+		std::cout << "Frame pacing: adaptive vsync is not supported, using vsync" << std::endl;
+}
+
+double FramePacer::UNow(const Pacer &pacer)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - pacer.start).count();
+}
+
+double FramePacer::UBeginFrame(Pacer &pacer)
+{
+	double now = UNow(pacer);
+	double interval = now - pacer.frameStart;
+	pacer.frameStart = now;
+
+	// the first interval runs from creation, it says nothing about pacing
+	if (pacer.frames++ > 0)
+		Record(pacer.histogram, interval * 1000.0);
+	return interval;
+}
+
+///////////////////////////////////////////////////
+//	UWaitForDeadline(Pacer&)
+//
+//	Sleeping is cheap but wakes up late by an OS
+//	dependent amount, so the last spinMargin seconds
+//	are spun. The margin follows the largest recent
+//	oversleep. A frame that is already late moves
+//	the deadline instead of rushing the next ones.
+///////////////////////////////////////////////////
+void FramePacer::UWaitForDeadline(Pacer &pacer)
+{
+	if (pacer.mode != MODE_FIXED)
+		return;
+
+	pacer.deadline += 1.0 / pacer.targetFps;
+	double now = UNow(pacer);
+	if (now >= pacer.deadline)
+	{
+		pacer.deadline = now;
+		return;
+	}
+
+	double sleepUntil = pacer.deadline - pacer.spinMargin;
+	if (now < sleepUntil)
+	{
+		std::this_thread::sleep_for(std::chrono::duration<double>(sleepUntil - now));
+		double oversleep = UNow(pacer) - sleepUntil;
+		pacer.spinMargin = std::min(std::max(pacer.spinMargin * 0.99, oversleep * 1.5), maxSpinMargin);
+	}
+
+	while (UNow(pacer) < pacer.deadline)
+		std::this_thread::yield();
+}
+
+double FramePacer::UPercentile(const Histogram &histogram, double fraction)
+{
+	if (histogram.count == 0)
+		return 0.0;
+
+	unsigned long long rank = (unsigned long long)(fraction * (histogram.count - 1)) + 1;
+	unsigned long long seen = 0;
+	for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		seen += histogram.buckets[i];
+		if (seen >= rank)
+			return i == HISTOGRAM_BUCKETS - 1 ? histogram.maxMs : (i + 1) * BUCKET_MS;
+	}
+	return histogram.maxMs;
+}
+
+void FramePacer::UReport(Pacer &pacer)
+{
+	const Histogram &histogram = pacer.histogram;
+	std::cout << "Frame pacing: " << modeNames[pacer.mode];
+	if (pacer.mode == MODE_FIXED)
+		std::cout << " " << pacer.targetFps << " fps";
+	std::cout << ", " << histogram.count << " frames";
+	if (histogram.count == 0)
+	{
+		std::cout << std::endl;
+		return;
+	}
+
+	std::cout << ", mean " << histogram.totalMs / histogram.count << " ms, min " << histogram.minMs
+		<< " ms, max " << histogram.maxMs << " ms, p50 " << UPercentile(histogram, 0.5)
+		<< " ms, p99 " << UPercentile(histogram, 0.99) << " ms" << std::endl;
+
+	unsigned long long largest = *std::max_element(histogram.buckets, histogram.buckets + HISTOGRAM_BUCKETS);
+	for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		if (histogram.buckets[i] == 0)
+			continue;
+
+		std::cout << "  " << i * BUCKET_MS << (i == HISTOGRAM_BUCKETS - 1 ? "+" : "") << " ms\t"
+			<< std::string(size_t(1 + 49 * histogram.buckets[i] / largest), '#') << " " << histogram.buckets[i] << std::endl;
+	}
+	pacer.histogram = Histogram();
+}
+
+const char *FramePacer::UModeName(Mode mode)
+{
+	return modeNames[mode];
+}
+
+bool FramePacer::UParseMode(const char *name, Mode &mode)
+{
+	for (int i = 0; i < MODE_COUNT; i++)
+	{
+		if (strcmp(name, modeNames[i]) == 0)
+		{
+			mode = Mode(i);
+			return true;
+		}
+	}
+	return false;
+}
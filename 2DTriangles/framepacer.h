@@ -0,0 +1,96 @@
+///////////////////////////////////////////////////////////////////////////////
+// framepacer.h
+// ============
+// frame pacing: swap interval control, a frame rate cap and frame times
+//
+// The pacer owns the swap interval instead of leaving it to the driver
+// default, in one of four modes:
+//
+//   vsync      swap interval 1, lowest power, up to a refresh of latency
+//   adaptive   swap interval -1 (tear instead of waiting when a frame is
+//              late), falls back to vsync without swap_control_tear
+//   uncapped   swap interval 0, as fast as possible
+//   fixed      swap interval 0, frames held to a target rate by sleeping
+//              until shortly before the deadline and spinning the rest
+//
+// Times come from the monotonic steady clock in double precision. Every
+// frame interval goes into a histogram with fixed buckets, so percentiles
+// and stutter can be read without keeping every sample.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <chrono>
+
+class FramePacer
+{
+
+public:
+	enum Mode
+	{
+		MODE_VSYNC,
+		MODE_ADAPTIVE,
+		MODE_UNCAPPED,
+		MODE_FIXED,
+		MODE_COUNT
+	};
+
+	// Frame time histogram: HISTOGRAM_BUCKETS buckets of BUCKET_MS, the
+	// last one also takes everything longer
+	static const int HISTOGRAM_BUCKETS = 100;
+	static constexpr double BUCKET_MS = 0.5;
+
+	struct Histogram
+	{
+		unsigned long long buckets[HISTOGRAM_BUCKETS] = {};
+		unsigned long long count = 0;
+		double totalMs = 0.0;
+		double minMs = 0.0;
+		double maxMs = 0.0;
+	};
+
+	struct Pacer
+	{
+		Mode mode = MODE_VSYNC;
+		double targetFps = 60.0;	// used by MODE_FIXED
+		bool tearControl = false;	// the adaptive swap interval is supported
+
+		std::chrono::steady_clock::time_point start;
+		double frameStart = 0.0;	// seconds since start
+		unsigned long long frames = 0;	// frames begun
+		double deadline = 0.0;		// when the next fixed rate frame may be shown
+		double spinMargin = 0.002;	// seconds spun instead of slept, grows with oversleeping
+
+		Histogram histogram;
+	};
+
+public:
+	// Start the clock and apply the mode. Needs a current GL context.
+	static void UCreatePacer(Pacer &pacer, Mode mode, double targetFps);
+
+	// Change the mode, and for MODE_FIXED the rate
+	static void USetMode(Pacer &pacer, Mode mode, double targetFps);
+
+	// Seconds since the pacer was created
+	static double UNow(const Pacer &pacer);
+
+	// Call once at the top of every frame. Records the interval since the
+	// previous call and returns it in seconds.
+	static double UBeginFrame(Pacer &pacer);
+
+	// Call right before swapping buffers. Waits for the frame's deadline in
+	// MODE_FIXED and returns immediately in the other modes.
+	static void UWaitForDeadline(Pacer &pacer);
+
+	// Percentile of the recorded frame times in milliseconds, upper edge of
+	// the bucket it falls in (the maximum for the overflow bucket)
+	static double UPercentile(const Histogram &histogram, double fraction);
+
+	// Print the mode, summary and non empty buckets to cout, then start over
+	static void UReport(Pacer &pacer);
+
+	static const char *UModeName(Mode mode);
+
+	// Parse a --pacing argument, returns false for an unknown name
+	static bool UParseMode(const char *name, Mode &mode);
+};
@@ -0,0 +1,190 @@
+///////////////////////////////////////////////////////////////////////////////
+// frustum.cpp
+// ===========
+// view frustum planes extracted from a combined clip matrix
+///////////////////////////////////////////////////////////////////////////////
+
+#include "frustum.h"
+#include "simd.h"
+
+#include <cmath>
+
+namespace
+{
+	// Scalar test used by the single box query and the batch tails
+	size_t CullBoxesScalar(const glm::vec4 *planes, const float *cx, const float *cy, const float *cz,
+		const float *ex, const float *ey, const float *ez, size_t begin, size_t end, unsigned char *visible)
+	{
+		size_t count = 0;
+		for (size_t i = begin; i < end; i++)
+		{
+			bool inside = true;
+			for (int p = 0; p < Frustum::PLANE_COUNT && inside; p++)
+			{
+				// distance of the center against the box projected on the plane normal
+				float distance = planes[p].x * cx[i] + planes[p].y * cy[i] + planes[p].z * cz[i] + planes[p].w;
+				float radius = std::fabs(planes[p].x) * ex[i] + std::fabs(planes[p].y) * ey[i] + std::fabs(planes[p].z) * ez[i];
+				inside = distance + radius >= 0.0f;
+			}
+			visible[i] = inside ? 1 : 0;
+			count += visible[i];
+		}
+		return count;
+	}
+
+#if SIMD_X86
+	size_t CullBoxesSSE(const glm::vec4 *planes, const float *cx, const float *cy, const float *cz,
+		const float *ex, const float *ey, const float *ez, size_t total, unsigned char *visible, size_t &count)
+	{
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+		size_t i = 0;
+		for (; i + 4 <= total; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(cx + i), y = _mm_loadu_ps(cy + i), z = _mm_loadu_ps(cz + i);
+			__m128 sx = _mm_loadu_ps(ex + i), sy = _mm_loadu_ps(ey + i), sz = _mm_loadu_ps(ez + i);
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (int p = 0; p < Frustum::PLANE_COUNT; p++)
+			{
+				__m128 nx = _mm_set1_ps(planes[p].x), ny = _mm_set1_ps(planes[p].y), nz = _mm_set1_ps(planes[p].z);
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, x), _mm_mul_ps(ny, y)), _mm_add_ps(_mm_mul_ps(nz, z), _mm_set1_ps(planes[p].w)));
+				__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, nx), sx), _mm_mul_ps(_mm_andnot_ps(signMask, ny), sy)), _mm_mul_ps(_mm_andnot_ps(signMask, nz), sz));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+			}
+			int bits = _mm_movemask_ps(inside);
+			for (int k = 0; k < 4; k++)
+			{
+				visible[i + k] = (bits >> k) & 1;
+				count += visible[i + k];
+			}
+		}
+		return i;
+	}
+
+	SIMD_TARGET_AVX2 size_t CullBoxesAVX2(const glm::vec4 *planes, const float *cx, const float *cy, const float *cz,
+		const float *ex, const float *ey, const float *ez, size_t total, unsigned char *visible, size_t &count)
+	{
+		const __m256 signMask = _mm256_set1_ps(-0.0f);
+		size_t i = 0;
+		for (; i + 8 <= total; i += 8)
+		{
+			__m256 x = _mm256_loadu_ps(cx + i), y = _mm256_loadu_ps(cy + i), z = _mm256_loadu_ps(cz + i);
+			__m256 sx = _mm256_loadu_ps(ex + i), sy = _mm256_loadu_ps(ey + i), sz = _mm256_loadu_ps(ez + i);
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (int p = 0; p < Frustum::PLANE_COUNT; p++)
+			{
+				__m256 nx = _mm256_set1_ps(planes[p].x), ny = _mm256_set1_ps(planes[p].y), nz = _mm256_set1_ps(planes[p].z);
+				__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, x), _mm256_mul_ps(ny, y)), _mm256_add_ps(_mm256_mul_ps(nz, z), _mm256_set1_ps(planes[p].w)));
+				__m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_andnot_ps(signMask, nx), sx), _mm256_mul_ps(_mm256_andnot_ps(signMask, ny), sy)), _mm256_mul_ps(_mm256_andnot_ps(signMask, nz), sz));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_GE_OQ));
+			}
+			int bits = _mm256_movemask_ps(inside);
+			for (int k = 0; k < 8; k++)
+			{
+				visible[i + k] = (bits >> k) & 1;
+				count += visible[i + k];
+			}
+		}
+		return i;
+	}
+#endif
+}
+
+Frustum::Frustum()
+{
+	for (int i = 0; i < PLANE_COUNT; i++)
+		planes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+Frustum::Frustum(const glm::mat4 &clipFromSpace)
+{
+	Extract(clipFromSpace);
+}
+
+///////////////////////////////////////////////////
+//	Extract(const glm::mat4&)
+//
+//	Gribb/Hartmann plane extraction: every clip
+//	plane is the last matrix row plus or minus one
+//	of the others (GL clip space, z in [-w, w])
+///////////////////////////////////////////////////
+void Frustum::Extract(const glm::mat4 &clipFromSpace)
+{
+	// glm is column major, so row i is m[0][i], m[1][i], m[2][i], m[3][i]
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+		rows[i] = glm::vec4(clipFromSpace[0][i], clipFromSpace[1][i], clipFromSpace[2][i], clipFromSpace[3][i]);
+
+	planes[PLANE_LEFT] = rows[3] + rows[0];
+	planes[PLANE_RIGHT] = rows[3] - rows[0];
+	planes[PLANE_BOTTOM] = rows[3] + rows[1];
+	planes[PLANE_TOP] = rows[3] - rows[1];
+	planes[PLANE_NEAR] = rows[3] + rows[2];
+	planes[PLANE_FAR] = rows[3] - rows[2];
+
+	// normalize so plane distances are in the units of the input space
+	for (int i = 0; i < PLANE_COUNT; i++)
+	{
+		float length = glm::length(glm::vec3(planes[i]));
+		if (length > 0.0f)
+			planes[i] /= length;
+	}
+}
+
+bool Frustum::IntersectsSphere(const glm::vec3 &center, float radius) const
+{
+	for (int i = 0; i < PLANE_COUNT; i++)
+	{
+		if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+			return false;
+	}
+	return true;
+}
+
+bool Frustum::IntersectsBox(const glm::vec3 &center, const glm::vec3 &extent) const
+{
+	unsigned char visible;
+	return CullBoxesScalar(planes, &center.x, &center.y, &center.z, &extent.x, &extent.y, &extent.z, 0, 1, &visible) != 0;
+}
+
+Frustum::Containment Frustum::ClassifyBox(const glm::vec3 &center, const glm::vec3 &extent) const
+{
+	Containment result = CONTAINMENT_INSIDE;
+	for (int i = 0; i < PLANE_COUNT; i++)
+	{
+		float distance = glm::dot(glm::vec3(planes[i]), center) + planes[i].w;
+		float radius = std::fabs(planes[i].x) * extent.x + std::fabs(planes[i].y) * extent.y + std::fabs(planes[i].z) * extent.z;
+		if (distance + radius < 0.0f)
+			return CONTAINMENT_OUTSIDE;
+		if (distance - radius < 0.0f)
+			result = CONTAINMENT_INTERSECTING;
+	}
+	return result;
+}
+
+///////////////////////////////////////////////////
+//	UCullBoxes(...)
+//
+//	Batched box test, 8 (AVX2) or 4 (SSE) boxes
+//	per step against all six planes
+///////////////////////////////////////////////////
+size_t Frustum::UCullBoxes(const float *centerX, const float *centerY, const float *centerZ,
+	const float *extentX, const float *extentY, const float *extentZ,
+	size_t count, unsigned char *visible) const
+{
+	size_t done = 0;
+	size_t visibleCount = 0;
+#if SIMD_X86
+	switch (Simd::UInstructionSet())
+	{
+	case Simd::INSTRUCTIONS_AVX2:
+		done = CullBoxesAVX2(planes, centerX, centerY, centerZ, extentX, extentY, extentZ, count, visible, visibleCount);
+		break;
+	case Simd::INSTRUCTIONS_SSE:
+		done = CullBoxesSSE(planes, centerX, centerY, centerZ, extentX, extentY, extentZ, count, visible, visibleCount);
+		break;
+	default:
+		break;
+	}
+#endif
+	return visibleCount + CullBoxesScalar(planes, centerX, centerY, centerZ, extentX, extentY, extentZ, done, count, visible);
+}
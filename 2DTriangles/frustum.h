@@ -0,0 +1,60 @@
+///////////////////////////////////////////////////////////////////////////////
+// frustum.h
+// =========
+// view frustum planes extracted from a combined clip matrix
+//
+// Passing projection * view gives world space planes, passing
+// projection * view * model gives planes in that model's space.
+// Works for both perspective and orthographic projections.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+class Frustum
+{
+
+public:
+	enum Plane
+	{
+		PLANE_LEFT,
+		PLANE_RIGHT,
+		PLANE_BOTTOM,
+		PLANE_TOP,
+		PLANE_NEAR,
+		PLANE_FAR,
+		PLANE_COUNT
+	};
+
+	// Result of testing a volume against all planes
+	enum Containment
+	{
+		CONTAINMENT_OUTSIDE,
+		CONTAINMENT_INTERSECTING,
+		CONTAINMENT_INSIDE
+	};
+
+	// xyz is the unit normal pointing into the frustum, w the distance term
+	glm::vec4 planes[PLANE_COUNT];
+
+public:
+	Frustum();
+	explicit Frustum(const glm::mat4 &clipFromSpace);
+
+	void Extract(const glm::mat4 &clipFromSpace);
+
+	bool IntersectsSphere(const glm::vec3 &center, float radius) const;
+	bool IntersectsBox(const glm::vec3 &center, const glm::vec3 &extent) const;
+
+	// Like IntersectsBox(), but also tells boxes entirely inside apart
+	Containment ClassifyBox(const glm::vec3 &center, const glm::vec3 &extent) const;
+
+	// Test many boxes at once, given as SoA centers and half extents.
+	// Writes 1 (visible) or 0 (culled) per box and returns the visible count.
+	size_t UCullBoxes(const float *centerX, const float *centerY, const float *centerZ,
+		const float *extentX, const float *extentY, const float *extentZ,
+		size_t count, unsigned char *visible) const;
+};
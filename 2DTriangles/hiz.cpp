@@ -0,0 +1,365 @@
+///////////////////////////////////////////////////////////////////////////////
+// hiz.cpp
+// =======
+// hierarchical Z occlusion culling against the previous frame's depth
+///////////////////////////////////////////////////////////////////////////////
+
+#include "hiz.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#ifndef GLSL
+#define GLSL(Version, Source) "#version " #Version " core \n" #Source
+#endif
+
+namespace
+{
+	const GLuint workGroupSize = 8;
+
+	/* Depth pyramid compute shader: one invocation per destination texel */
+	const GLchar *reduceShaderSource = GLSL(440,
+		layout(local_size_x = 8, local_size_y = 8) in;
+
+	layout(r32f, binding = 0) writeonly uniform image2D destination;
+	uniform sampler2D source;
+	uniform int sourceLevel;
+	uniform bool copyLevel;		// level 0 copies the depth texture as it is
+
+	void main()
+	{
+		ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+		ivec2 size = imageSize(destination);
+		if (texel.x >= size.x || texel.y >= size.y)
+			return;
+
+		if (copyLevel)
+		{
+			imageStore(destination, texel, vec4(texelFetch(source, texel, 0).r));
+			return;
+		}
+
+		// farthest of the 2x2 source texels, the last row and column also
+		// take in the odd texel left over when the size was halved
+		ivec2 sourceSize = textureSize(source, sourceLevel);
+		ivec2 first = texel * 2;
+		ivec2 last = min(first + 1, sourceSize - 1);
+		if (texel.x == size.x - 1)
+			last.x = sourceSize.x - 1;
+		if (texel.y == size.y - 1)
+			last.y = sourceSize.y - 1;
+
+		float farthest = 0.0;
+		for (int y = first.y; y <= last.y; y++)
+		{
+			for (int x = first.x; x <= last.x; x++)
+				farthest = max(farthest, texelFetch(source, ivec2(x, y), sourceLevel).r);
+		}
+		imageStore(destination, texel, vec4(farthest));
+	}
+	);
+
+	GLsizei LevelSize(GLsizei size, int level)
+	{
+		return std::max<GLsizei>(1, size >> level);
+	}
+
+	// Allocate the textures and CPU levels for a new framebuffer size
+	void Resize(HiZ::GLHiZ &hiz, GLsizei width, GLsizei height)
+	{
+		if (hiz.width == width && hiz.height == height)
+			return;
+
+		glDeleteTextures(1, &hiz.depthTexture);
+		glDeleteTextures(1, &hiz.pyramidTexture);
+
+		hiz.width = width;
+		hiz.height = height;
+		hiz.levelCount = 1;
+		while (LevelSize(width, hiz.levelCount - 1) > 1 || LevelSize(height, hiz.levelCount - 1) > 1)
+			hiz.levelCount++;
+
+		glGenTextures(1, &hiz.depthTexture);
+		glBindTexture(GL_TEXTURE_2D, hiz.depthTexture);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		glGenTextures(1, &hiz.pyramidTexture);
+		glBindTexture(GL_TEXTURE_2D, hiz.pyramidTexture);
+		glTexStorage2D(GL_TEXTURE_2D, hiz.levelCount, GL_R32F, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		hiz.levels.assign(hiz.levelCount, HiZ::Level());
+		for (int level = 0; level < hiz.levelCount; level++)
+		{
+			hiz.levels[level].width = LevelSize(width, level);
+			hiz.levels[level].height = LevelSize(height, level);
+		}
+
+		// the readback buffer holds every level from GPU_READBACK_LEVEL up
+		GLsizeiptr readbackSize = 0;
+		for (int level = std::min(HiZ::GPU_READBACK_LEVEL, hiz.levelCount - 1); level < hiz.levelCount; level++)
+			readbackSize += GLsizeiptr(hiz.levels[level].width) * hiz.levels[level].height * sizeof(float);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, hiz.packBuffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, readbackSize, NULL, GL_STREAM_READ);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		HiZ::UInvalidate(hiz);
+	}
+}
+
+///////////////////////////////////////////////////
+//	UCreateHiZ(GLHiZ&)
+//
+//	Compile the reduction shader, the textures are
+//	sized on the first capture
+///////////////////////////////////////////////////
+bool HiZ::UCreateHiZ(GLHiZ &hiz)
+{
+	int success = 0;
+	char infoLog[512];
+
+	hiz.program = glCreateProgram();
+	GLuint computeShaderId = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(computeShaderId, 1, &reduceShaderSource, NULL);
+	glCompileShader(computeShaderId);
+	glGetShaderiv(computeShaderId, GL_COMPILE_STATUS, &success);
+	if (!success)
+	{
+		glGetShaderInfoLog(computeShaderId, sizeof(infoLog), NULL, infoLog);
+		std::cout << "ERROR::SHADER::COMPUTE::COMPILATION_FAILED\n" << infoLog << std::endl;
+		glDeleteShader(computeShaderId);
+		return false;
+	}
+
+	glAttachShader(hiz.program, computeShaderId);
+	glLinkProgram(hiz.program);
+	glDeleteShader(computeShaderId);
+	glGetProgramiv(hiz.program, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		glGetProgramInfoLog(hiz.program, sizeof(infoLog), NULL, infoLog);
+		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+		return false;
+	}
+
+	glGenBuffers(1, &hiz.packBuffer);
+	return true;
+}
+
+void HiZ::UDestroyHiZ(GLHiZ &hiz)
+{
+	glDeleteProgram(hiz.program);
+	glDeleteTextures(1, &hiz.depthTexture);
+	glDeleteTextures(1, &hiz.pyramidTexture);
+	glDeleteBuffers(1, &hiz.packBuffer);
+	if (hiz.fence)
+		glDeleteSync(hiz.fence);
+	hiz = GLHiZ();
+}
+
+void HiZ::UInvalidate(GLHiZ &hiz)
+{
+	hiz.valid = false;
+	if (hiz.fence)
+		glDeleteSync(hiz.fence);
+	hiz.fence = 0;
+}
+
+///////////////////////////////////////////////////
+//	UCaptureGPU(GLHiZ&, const glm::mat4&, GLsizei, GLsizei)
+//
+//	Copy the depth buffer, reduce it level by level
+//	and queue the coarse levels for readback
+///////////////////////////////////////////////////
+void HiZ::UCaptureGPU(GLHiZ &hiz, const glm::mat4 &viewProjection, GLsizei width, GLsizei height)
+{
+	Resize(hiz, width, height);
+
+	// wait for the previous readback before overwriting what it reads
+	if (hiz.fence)
+		return;
+
+	GLint previousProgram = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+
+	// copying into a depth texture reads the read framebuffer's depth
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, hiz.depthTexture);
+	glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+
+	glUseProgram(hiz.program);
+	glUniform1i(glGetUniformLocation(hiz.program, "source"), 1);
+	GLint sourceLevelLoc = glGetUniformLocation(hiz.program, "sourceLevel");
+	GLint copyLevelLoc = glGetUniformLocation(hiz.program, "copyLevel");
+	for (int level = 0; level < hiz.levelCount; level++)
+	{
+		const Level &destination = hiz.levels[level];
+		glBindTexture(GL_TEXTURE_2D, level == 0 ? hiz.depthTexture : hiz.pyramidTexture);
+		glUniform1i(sourceLevelLoc, level - 1);
+		glUniform1i(copyLevelLoc, level == 0);
+		glBindImageTexture(0, hiz.pyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		glDispatchCompute((destination.width + workGroupSize - 1) / workGroupSize, (destination.height + workGroupSize - 1) / workGroupSize, 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+	glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+	// queue the coarse levels into the pack buffer, back to back
+	glBindTexture(GL_TEXTURE_2D, hiz.pyramidTexture);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, hiz.packBuffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	GLintptr offset = 0;
+	for (int level = std::min(GPU_READBACK_LEVEL, hiz.levelCount - 1); level < hiz.levelCount; level++)
+	{
+		glGetTexImage(GL_TEXTURE_2D, level, GL_RED, GL_FLOAT, (void*)offset);
+		offset += GLintptr(hiz.levels[level].width) * hiz.levels[level].height * sizeof(float);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	hiz.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	hiz.pendingViewProjection = viewProjection;
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glUseProgram(GLuint(previousProgram));
+}
+
+void HiZ::UPoll(GLHiZ &hiz)
+{
+	if (!hiz.fence)
+		return;
+
+	GLenum status = glClientWaitSync(hiz.fence, 0, 0);
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+		return;
+
+	glDeleteSync(hiz.fence);
+	hiz.fence = 0;
+
+	hiz.firstLevel = std::min(GPU_READBACK_LEVEL, hiz.levelCount - 1);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, hiz.packBuffer);
+	GLintptr offset = 0;
+	for (int level = hiz.firstLevel; level < hiz.levelCount; level++)
+	{
+		Level &destination = hiz.levels[level];
+		GLsizeiptr size = GLsizeiptr(destination.width) * destination.height * sizeof(float);
+		destination.depth.resize(size_t(destination.width) * destination.height);
+		glGetBufferSubData(GL_PIXEL_PACK_BUFFER, offset, size, destination.depth.data());
+		offset += size;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	hiz.viewProjection = hiz.pendingViewProjection;
+	hiz.valid = true;
+}
+
+///////////////////////////////////////////////////
+//	UCaptureCPU(GLHiZ&, const glm::mat4&, GLsizei, GLsizei)
+//
+//	Synchronous fallback: read the depth buffer and
+//	build every level on the CPU
+///////////////////////////////////////////////////
+void HiZ::UCaptureCPU(GLHiZ &hiz, const glm::mat4 &viewProjection, GLsizei width, GLsizei height)
+{
+	Resize(hiz, width, height);
+
+	Level &base = hiz.levels[0];
+	base.depth.resize(size_t(width) * height);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, width, height, GL_DEPTH_COMPONENT, GL_FLOAT, base.depth.data());
+
+	for (int level = 1; level < hiz.levelCount; level++)
+		UReduceLevel(hiz.levels[level - 1], hiz.levels[level]);
+
+	hiz.firstLevel = 0;
+	hiz.viewProjection = viewProjection;
+	hiz.valid = true;
+}
+
+void HiZ::UReduceLevel(const Level &source, Level &destination)
+{
+	destination.depth.resize(size_t(destination.width) * destination.height);
+	for (GLsizei y = 0; y < destination.height; y++)
+	{
+		GLsizei firstY = y * 2;
+		GLsizei lastY = (y == destination.height - 1) ? source.height - 1 : std::min(firstY + 1, source.height - 1);
+		for (GLsizei x = 0; x < destination.width; x++)
+		{
+			GLsizei firstX = x * 2;
+			GLsizei lastX = (x == destination.width - 1) ? source.width - 1 : std::min(firstX + 1, source.width - 1);
+
+			float farthest = 0.0f;
+			for (GLsizei sy = firstY; sy <= lastY; sy++)
+			{
+				for (GLsizei sx = firstX; sx <= lastX; sx++)
+					farthest = std::max(farthest, source.depth[size_t(sy) * source.width + sx]);
+			}
+			destination.depth[size_t(y) * destination.width + x] = farthest;
+		}
+	}
+}
+
+///////////////////////////////////////////////////
+//	UIsBoxOccluded(const GLHiZ&, const glm::vec3&, const glm::vec3&)
+//
+//	Project the corners, pick the level where the
+//	screen rectangle spans at most 2x2 texels and
+//	compare the nearest corner with the farthest
+//	depth stored there. Anything touching the near
+//	plane counts as visible.
+///////////////////////////////////////////////////
+bool HiZ::UIsBoxOccluded(const GLHiZ &hiz, const glm::vec3 &center, const glm::vec3 &extent)
+{
+	if (!hiz.valid)
+		return false;
+
+	glm::vec2 rectMin(1e30f);
+	glm::vec2 rectMax(-1e30f);
+	float nearest = 1.0f;
+	for (int corner = 0; corner < 8; corner++)
+	{
+		glm::vec3 position = center + glm::vec3((corner & 1) ? extent.x : -extent.x,
+			(corner & 2) ? extent.y : -extent.y,
+			(corner & 4) ? extent.z : -extent.z);
+		glm::vec4 clip = hiz.viewProjection * glm::vec4(position, 1.0f);
+		if (clip.w <= 0.0f || clip.z < -clip.w)
+			return false;
+
+		glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		rectMin = glm::min(rectMin, glm::vec2(ndc.x, ndc.y));
+		rectMax = glm::max(rectMax, glm::vec2(ndc.x, ndc.y));
+		nearest = std::min(nearest, ndc.z * 0.5f + 0.5f);
+	}
+
+	// normalized device coordinates to pixels of level 0, clamped to the screen
+	const float width = float(hiz.width);
+	const float height = float(hiz.height);
+	int x0 = int(std::floor(std::max(0.0f, (rectMin.x * 0.5f + 0.5f) * width)));
+	int y0 = int(std::floor(std::max(0.0f, (rectMin.y * 0.5f + 0.5f) * height)));
+	int x1 = int(std::floor(std::min(width - 1.0f, (rectMax.x * 0.5f + 0.5f) * width)));
+	int y1 = int(std::floor(std::min(height - 1.0f, (rectMax.y * 0.5f + 0.5f) * height)));
+	if (x0 > x1 || y0 > y1)
+		return false;
+
+	int level = hiz.firstLevel;
+	while (level < hiz.levelCount - 1 && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+		level++;
+
+	// texels past the last one were folded into it when reducing
+	const Level &pyramid = hiz.levels[level];
+	int tx0 = std::min(x0 >> level, pyramid.width - 1);
+	int tx1 = std::min(x1 >> level, pyramid.width - 1);
+	int ty0 = std::min(y0 >> level, pyramid.height - 1);
+	int ty1 = std::min(y1 >> level, pyramid.height - 1);
+
+	float farthest = 0.0f;
+	for (int y = ty0; y <= ty1; y++)
+	{
+		for (int x = tx0; x <= tx1; x++)
+			farthest = std::max(farthest, pyramid.depth[size_t(y) * pyramid.width + x]);
+	}
+	return nearest > farthest;
+}
@@ -0,0 +1,83 @@
+///////////////////////////////////////////////////////////////////////////////
+// hiz.h
+// =====
+// hierarchical Z occlusion culling against the previous frame's depth
+//
+// After the scene is drawn its depth buffer is reduced into a pyramid where
+// every texel holds the farthest depth of the texels below it. Next frame a
+// box is occluded when its nearest point is farther than the farthest depth
+// of the (at most 2x2) pyramid texels covering its screen rectangle, using
+// the matrices the pyramid was rendered with.
+//
+// The pyramid is built by a compute shader and its coarser levels are read
+// back through a pixel pack buffer and a fence, so the CPU test runs a frame
+// or two behind without stalling. The CPU fallback reads the depth buffer
+// directly and builds every level itself, which stalls but is exact and
+// easy to check.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+class HiZ
+{
+
+public:
+	// Finest level read back in the GPU path, level 3 is 1/64 of the pixels
+	static const int GPU_READBACK_LEVEL = 3;
+
+	// One level of the CPU copy of the pyramid
+	struct Level
+	{
+		GLsizei width;
+		GLsizei height;
+		std::vector<float> depth;	// rows bottom to top, like GL
+	};
+
+	struct GLHiZ
+	{
+		GLuint program = 0;
+		GLuint depthTexture = 0;	// copy of the depth buffer
+		GLuint pyramidTexture = 0;	// R32F, one mip per level
+		GLsizei width = 0;
+		GLsizei height = 0;
+		int levelCount = 0;
+
+		// GPU readback in flight
+		GLuint packBuffer = 0;
+		GLsync fence = 0;
+		glm::mat4 pendingViewProjection;
+
+		// Pyramid used by the occlusion test
+		std::vector<Level> levels;
+		int firstLevel = 0;			// finest level present in levels
+		glm::mat4 viewProjection;	// matrices the pyramid was rendered with
+		bool valid = false;
+	};
+
+public:
+	static bool UCreateHiZ(GLHiZ &hiz);
+	static void UDestroyHiZ(GLHiZ &hiz);
+
+	// Reduce the depth of the bound framebuffer into the pyramid. The GPU
+	// path starts an asynchronous readback, the CPU path is ready at once.
+	static void UCaptureGPU(GLHiZ &hiz, const glm::mat4 &viewProjection, GLsizei width, GLsizei height);
+	static void UCaptureCPU(GLHiZ &hiz, const glm::mat4 &viewProjection, GLsizei width, GLsizei height);
+
+	// Pick up a finished GPU readback without blocking
+	static void UPoll(GLHiZ &hiz);
+
+	// Forget the pyramid, for example after switching modes
+	static void UInvalidate(GLHiZ &hiz);
+
+	// True when the world space box is hidden behind the captured depth
+	static bool UIsBoxOccluded(const GLHiZ &hiz, const glm::vec3 &center, const glm::vec3 &extent);
+
+	// CPU reduction of one level into the next, shared with the fallback
+	static void UReduceLevel(const Level &source, Level &destination);
+};
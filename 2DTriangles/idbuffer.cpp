@@ -0,0 +1,169 @@
+///////////////////////////////////////////////////////////////////////////////
+// idbuffer.cpp
+// ============
+// object ID picking through an R32UI attachment and an asynchronous readback
+///////////////////////////////////////////////////////////////////////////////
+
+#include "idbuffer.h"
+
+#include <iostream>
+
+namespace
+{
+	void DestroyAttachments(IdBuffer::GLIdBuffer &buffer)
+	{
+		glDeleteFramebuffers(1, &buffer.framebuffer);
+		glDeleteTextures(1, &buffer.colorTexture);
+		glDeleteTextures(1, &buffer.idTexture);
+		glDeleteRenderbuffers(1, &buffer.depthBuffer);
+		buffer.framebuffer = 0;
+		buffer.colorTexture = 0;
+		buffer.idTexture = 0;
+		buffer.depthBuffer = 0;
+	}
+
+	bool CreateAttachments(IdBuffer::GLIdBuffer &buffer, GLsizei width, GLsizei height)
+	{
+		buffer.width = width;
+		buffer.height = height;
+
+		glGenTextures(1, &buffer.colorTexture);
+		glBindTexture(GL_TEXTURE_2D, buffer.colorTexture);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		glGenTextures(1, &buffer.idTexture);
+		glBindTexture(GL_TEXTURE_2D, buffer.idTexture);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32UI, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glGenRenderbuffers(1, &buffer.depthBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, buffer.depthBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glGenFramebuffers(1, &buffer.framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, buffer.framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, buffer.colorTexture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, buffer.idTexture, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, buffer.depthBuffer);
+		GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		if (status != GL_FRAMEBUFFER_COMPLETE)
+		{
+			std::cerr << "ID buffer framebuffer incomplete: 0x" << std::hex << status << std::dec << std::endl;
+			DestroyAttachments(buffer);
+			return false;
+		}
+		return true;
+	}
+}
+
+bool IdBuffer::UCreateIdBuffer(GLIdBuffer &buffer, GLsizei width, GLsizei height)
+{
+	if (!CreateAttachments(buffer, width, height))
+		return false;
+
+	glGenBuffers(1, &buffer.packBuffer);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer.packBuffer);
+	glBufferData(GL_PIXEL_PACK_BUFFER, sizeof(GLuint), NULL, GL_STREAM_READ);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	return true;
+}
+
+void IdBuffer::UDestroyIdBuffer(GLIdBuffer &buffer)
+{
+	DestroyAttachments(buffer);
+	glDeleteBuffers(1, &buffer.packBuffer);
+	buffer.packBuffer = 0;
+	if (buffer.fence)
+		glDeleteSync(buffer.fence);
+	buffer.fence = 0;
+	buffer.requested = false;
+}
+
+bool IdBuffer::UResizeIdBuffer(GLIdBuffer &buffer, GLsizei width, GLsizei height)
+{
+	if (width == buffer.width && height == buffer.height)
+		return true;
+
+	DestroyAttachments(buffer);
+	return CreateAttachments(buffer, width, height);
+}
+
+void IdBuffer::UBeginFrame(GLIdBuffer &buffer, const glm::vec4 &clearColor)
+{
+	static const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	static const GLuint noObject[] = { NO_OBJECT, 0, 0, 0 };
+
+	glBindFramebuffer(GL_FRAMEBUFFER, buffer.framebuffer);
+	glDrawBuffers(2, drawBuffers);
+	glClearBufferfv(GL_COLOR, 0, &clearColor[0]);
+	glClearBufferuiv(GL_COLOR, 1, noObject);
+	glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+///////////////////////////////////////////////////
+//	UEndFrame(GLIdBuffer&)
+//
+//	The readback goes into a pack buffer, so
+//	glReadPixels returns right away and the copy
+//	happens when the GPU gets to it
+///////////////////////////////////////////////////
+void IdBuffer::UEndFrame(GLIdBuffer &buffer)
+{
+	// one readback in flight at a time, later requests wait for it
+	if (buffer.requested && !buffer.fence)
+	{
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, buffer.framebuffer);
+		glReadBuffer(GL_COLOR_ATTACHMENT1);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer.packBuffer);
+		glReadPixels(buffer.requestX, buffer.height - 1 - buffer.requestY, 1, 1, GL_RED_INTEGER, GL_UNSIGNED_INT, (void*)0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		buffer.readFrame = buffer.frame;
+		buffer.requested = false;
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, buffer.framebuffer);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, buffer.width, buffer.height, 0, 0, buffer.width, buffer.height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	buffer.frame++;
+}
+
+void IdBuffer::URequestPick(GLIdBuffer &buffer, GLint x, GLint y)
+{
+	if (x < 0 || y < 0 || x >= buffer.width || y >= buffer.height)
+		return;
+
+	buffer.requested = true;
+	buffer.requestX = x;
+	buffer.requestY = y;
+}
+
+bool IdBuffer::UPollPick(GLIdBuffer &buffer, GLuint &id, unsigned long long &latency)
+{
+	if (!buffer.fence)
+		return false;
+
+	// a zero timeout only asks whether the copy is done
+	GLenum status = glClientWaitSync(buffer.fence, 0, 0);
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+		return false;
+
+	glDeleteSync(buffer.fence);
+	buffer.fence = 0;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer.packBuffer);
+	glGetBufferSubData(GL_PIXEL_PACK_BUFFER, 0, sizeof(GLuint), &id);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	latency = buffer.frame - buffer.readFrame;
+	return true;
+}
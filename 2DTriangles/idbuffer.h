@@ -0,0 +1,68 @@
+///////////////////////////////////////////////////////////////////////////////
+// idbuffer.h
+// ==========
+// object ID picking: the main pass also writes a per draw ID into an R32UI
+// attachment, and the ID under the cursor is read back asynchronously
+//
+// The scene renders into an offscreen framebuffer (color, ID and depth)
+// that is blitted to the window at the end of the frame. A pick request
+// copies one texel of the ID attachment into a pixel pack buffer and puts
+// a fence behind it. The result is collected on a later frame once the
+// fence has signaled, so the CPU never waits for the GPU and the cost does
+// not depend on how many objects are in the scene.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+class IdBuffer
+{
+
+public:
+	// ID written where nothing was drawn
+	static const GLuint NO_OBJECT = 0;
+
+	struct GLIdBuffer
+	{
+		GLuint framebuffer = 0;
+		GLuint colorTexture = 0;	// attachment 0, what the window shows
+		GLuint idTexture = 0;		// attachment 1, R32UI object IDs
+		GLuint depthBuffer = 0;
+		GLsizei width = 0;
+		GLsizei height = 0;
+
+		// Pick request waiting for the end of the frame
+		bool requested = false;
+		GLint requestX = 0;
+		GLint requestY = 0;
+
+		// Readback in flight
+		GLuint packBuffer = 0;
+		GLsync fence = 0;
+		unsigned long long frame = 0;		// frames ended so far
+		unsigned long long readFrame = 0;	// frame the readback was issued in
+	};
+
+public:
+	static bool UCreateIdBuffer(GLIdBuffer &buffer, GLsizei width, GLsizei height);
+	static void UDestroyIdBuffer(GLIdBuffer &buffer);
+
+	// Recreate the attachments for a new framebuffer size
+	static bool UResizeIdBuffer(GLIdBuffer &buffer, GLsizei width, GLsizei height);
+
+	// Bind the offscreen framebuffer and clear color, depth and IDs
+	static void UBeginFrame(GLIdBuffer &buffer, const glm::vec4 &clearColor);
+
+	// Issue a pending readback, then blit the color attachment to the window
+	static void UEndFrame(GLIdBuffer &buffer);
+
+	// Ask for the ID at a framebuffer pixel (origin top left, like the cursor)
+	static void URequestPick(GLIdBuffer &buffer, GLint x, GLint y);
+
+	// Collect a finished readback without blocking. Returns true once, when
+	// the ID is available, with the number of frames it took.
+	static bool UPollPick(GLIdBuffer &buffer, GLuint &id, unsigned long long &latency);
+};
@@ -0,0 +1,290 @@
+///////////////////////////////////////////////////////////////////////////////
+// jobs.cpp
+// ========
+// work stealing job scheduler
+///////////////////////////////////////////////////////////////////////////////
+
+#include "jobs.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+	const long long dequeMask = Jobs::MAX_JOBS - 1;
+
+	// Spins looking for work before an idle worker goes to sleep
+	const int idleSpins = 64;
+
+	thread_local Jobs::Scheduler *tScheduler = nullptr;
+	thread_local Jobs::Worker *tWorker = nullptr;
+
+	// The calling thread's worker, created on first use. NULL when every
+	// slot is taken, the thread then runs its jobs as they are submitted.
+	Jobs::Worker *CurrentWorker(Jobs::Scheduler &scheduler)
+	{
+		if (tScheduler == &scheduler)
+			return tWorker;
+
+		int index = scheduler.workerCount.load();
+		do
+		{
+			if (index >= Jobs::MAX_THREADS)
+				return nullptr;
+		} while (!scheduler.workerCount.compare_exchange_weak(index, index + 1));
+
+		Jobs::Worker *worker = new Jobs::Worker();
+		worker->random = unsigned(index) * 2654435761u + 1u;
+		scheduler.workers[index].store(worker);
+
+		tScheduler = &scheduler;
+		tWorker = worker;
+		return worker;
+	}
+
+	///////////////////////////////////////////////////
+	//	Push, Pop and Steal
+	//
+	//	The Chase-Lev deque as given with C11 atomics
+	//	by Le, Pop, Cohen and Zappa Nardelli (2013).
+	//	Only the owner moves bottom, top only grows
+	//	and is taken with a CAS when owner and thief
+	//	may want the same last job.
+	///////////////////////////////////////////////////
+	bool Full(const Jobs::Worker &worker)
+	{
+		long long bottom = worker.bottom.load(std::memory_order_relaxed);
+		long long top = worker.top.load(std::memory_order_acquire);
+		return bottom - top >= (long long)Jobs::MAX_JOBS;
+	}
+
+	// Only the owner pushes and top only grows, so there is room after Full()
+	void Push(Jobs::Worker &worker, Jobs::Entry *entry)
+	{
+		long long bottom = worker.bottom.load(std::memory_order_relaxed);
+		worker.deque[bottom & dequeMask].store(entry, std::memory_order_relaxed);
+		worker.bottom.store(bottom + 1, std::memory_order_release);
+	}
+
+	Jobs::Entry *Pop(Jobs::Worker &worker)
+	{
+		long long bottom = worker.bottom.load(std::memory_order_relaxed) - 1;
+		worker.bottom.store(bottom, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		long long top = worker.top.load(std::memory_order_relaxed);
+
+		if (top > bottom)
+		{
+			worker.bottom.store(bottom + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		Jobs::Entry *job = worker.deque[bottom & dequeMask].load(std::memory_order_relaxed);
+		if (top == bottom)
+		{
+			// the last job, a thief may be taking it too
+			if (!worker.top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				job = nullptr;
+			worker.bottom.store(bottom + 1, std::memory_order_relaxed);
+		}
+		return job;
+	}
+
+	Jobs::Entry *Steal(Jobs::Worker &worker)
+	{
+		long long top = worker.top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		long long bottom = worker.bottom.load(std::memory_order_acquire);
+		if (top >= bottom)
+			return nullptr;
+
+		Jobs::Entry *job = worker.deque[top & dequeMask].load(std::memory_order_relaxed);
+		if (!worker.top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return nullptr;
+		return job;
+	}
+
+	// Own jobs newest first, then the oldest job of another thread
+	Jobs::Entry *FindJob(Jobs::Scheduler &scheduler, Jobs::Worker &worker)
+	{
+		Jobs::Entry *job = Pop(worker);
+		if (job)
+			return job;
+
+		int count = std::min(scheduler.workerCount.load(), Jobs::MAX_THREADS);
+		worker.random ^= worker.random << 13;
+		worker.random ^= worker.random >> 17;
+		worker.random ^= worker.random << 5;
+		for (int i = 0; i < count; i++)
+		{
+			Jobs::Worker *victim = scheduler.workers[(worker.random + i) % count].load();
+			if (victim == nullptr || victim == &worker)
+				continue;
+
+			job = Steal(*victim);
+			if (job)
+			{
+				worker.stolen++;
+				return job;
+			}
+		}
+		return nullptr;
+	}
+
+	void Execute(Jobs::Worker *worker, const Jobs::Job &job)
+	{
+		job.function(job.context, job.first, job.count);
+		if (worker)
+			worker->executed++;
+		job.counter->pending.fetch_sub(1, std::memory_order_acq_rel);
+	}
+
+	// The job is copied first, its owner may reuse the entry once it is free
+	void Execute(Jobs::Worker *worker, Jobs::Entry *entry)
+	{
+		Jobs::Job job = entry->job;
+		entry->busy.store(false, std::memory_order_release);
+		Execute(worker, job);
+	}
+
+	void WorkerLoop(Jobs::Scheduler *scheduler)
+	{
+		Jobs::Worker *worker = CurrentWorker(*scheduler);
+		if (worker == nullptr)
+			return;
+
+		int idle = 0;
+		while (!scheduler->stopping.load())
+		{
+			Jobs::Entry *job = FindJob(*scheduler, *worker);
+			if (job)
+			{
+				Execute(worker, job);
+				idle = 0;
+				continue;
+			}
+
+			if (++idle < idleSpins)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			// nothing to do for a while, sleep until jobs are pushed. A wake
+			// up lost between the check and the wait only costs the timeout
+			std::unique_lock<std::mutex> lock(scheduler->mutex);
+			scheduler->sleeping++;
+			if (!scheduler->stopping.load())
+				scheduler->wake.wait_for(lock, std::chrono::milliseconds(1));
+			scheduler->sleeping--;
+			idle = 0;
+		}
+	}
+}
+
+void Jobs::UCreateScheduler(Scheduler &scheduler, int threadCount)
+{
+	if (threadCount <= 0)
+		threadCount = int(std::max(1u, std::thread::hardware_concurrency()));
+	threadCount = std::min(threadCount, MAX_THREADS);
+
+	scheduler.stopping = false;
+	CurrentWorker(scheduler);
+	for (int i = 1; i < threadCount; i++)
+		scheduler.threads.emplace_back(WorkerLoop, &scheduler);
+}
+
+void Jobs::UDestroyScheduler(Scheduler &scheduler)
+{
+	{
+		std::lock_guard<std::mutex> lock(scheduler.mutex);
+		scheduler.stopping = true;
+	}
+	scheduler.wake.notify_all();
+	for (auto &thread : scheduler.threads)
+		thread.join();
+	scheduler.threads.clear();
+
+	for (int i = 0; i < MAX_THREADS; i++)
+		delete scheduler.workers[i].exchange(nullptr);
+	scheduler.workerCount = 0;
+
+	if (tScheduler == &scheduler)
+	{
+		tScheduler = nullptr;
+		tWorker = nullptr;
+	}
+}
+
+int Jobs::UThreadCount(const Scheduler &scheduler)
+{
+	return int(scheduler.threads.size()) + 1;
+}
+
+void Jobs::URun(Scheduler &scheduler, Function function, void *context, size_t first, size_t count, Counter &counter)
+{
+	counter.pending.fetch_add(1, std::memory_order_relaxed);
+
+	Job local = { function, context, first, count, &counter };
+	Worker *worker = CurrentWorker(scheduler);
+	if (worker == nullptr || Full(*worker))
+	{
+		Execute(worker, local);
+		return;
+	}
+
+	// the entry's last job may still wait in the deque or be in a thief's
+	// hands between its CAS and its copy
+	Entry *entry = &worker->pool[worker->nextJob & dequeMask];
+	if (entry->busy.load(std::memory_order_acquire))
+	{
+		Execute(worker, local);
+		return;
+	}
+
+	worker->nextJob++;
+	entry->job = local;
+	entry->busy.store(true, std::memory_order_relaxed);
+	Push(*worker, entry);
+
+	if (scheduler.sleeping.load() > 0)
+		scheduler.wake.notify_one();
+}
+
+void Jobs::UWait(Scheduler &scheduler, Counter &counter)
+{
+	Worker *worker = CurrentWorker(scheduler);
+	while (counter.pending.load(std::memory_order_acquire) != 0)
+	{
+		Entry *job = worker ? FindJob(scheduler, *worker) : nullptr;
+		if (job)
+			Execute(worker, job);
+		else
+			std::this_thread::yield();
+	}
+}
+
+void Jobs::UParallelFor(Scheduler &scheduler, size_t count, size_t grain, Function function, void *context)
+{
+	grain = std::max<size_t>(grain, 1);
+
+	Counter counter;
+	for (size_t first = 0; first < count; first += grain)
+		URun(scheduler, function, context, first, std::min(grain, count - first), counter);
+	UWait(scheduler, counter);
+}
+
+void Jobs::UStats(const Scheduler &scheduler, unsigned long long &executed, unsigned long long &stolen)
+{
+	executed = 0;
+	stolen = 0;
+	for (int i = 0; i < MAX_THREADS; i++)
+	{
+		const Worker *worker = scheduler.workers[i].load();
+		if (worker)
+		{
+			executed += worker->executed;
+			stolen += worker->stolen;
+		}
+	}
+}
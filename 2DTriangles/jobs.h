@@ -0,0 +1,126 @@
+///////////////////////////////////////////////////////////////////////////////
+// jobs.h
+// ======
+// work stealing job scheduler
+//
+// A job is a function, a context and a range of indices. Every thread that
+// runs jobs owns a Chase-Lev deque: it pushes and pops its own jobs at the
+// bottom without locking, idle threads steal the oldest jobs from the top
+// of the others. Worker threads are started with the scheduler; any other
+// thread that submits or waits (main, render) gets a deque of its own the
+// first time it does.
+//
+// Jobs count down a Counter when they finish. Waiting on a counter runs
+// other jobs instead of blocking, so a job can start children and wait for
+// them without fibers, and a job that must follow others is started after
+// waiting on their counter.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class Jobs
+{
+
+public:
+	// Threads that can own a deque, workers included
+	static const int MAX_THREADS = 64;
+
+	// Jobs one thread may have in flight, a power of two. Past this, or
+	// while the next pool entry is still taken, a submitted job is run
+	// right away on the submitting thread.
+	static const size_t MAX_JOBS = 4096;
+
+	typedef void (*Function)(void *context, size_t first, size_t count);
+
+	struct Counter
+	{
+		std::atomic<size_t> pending{ 0 };
+	};
+
+	struct Job
+	{
+		Function function;
+		void *context;
+		size_t first;
+		size_t count;
+		Counter *counter;
+	};
+
+	// A pooled job, busy from URun() until the thread running it has
+	// taken its copy
+	struct Entry
+	{
+		Job job;
+		std::atomic<bool> busy{ false };
+	};
+
+	// The deque and job storage of one thread. Entries are taken from the
+	// pool in turn and only once the job they last held has been taken.
+	struct Worker
+	{
+		std::atomic<long long> top{ 0 };
+		std::atomic<long long> bottom{ 0 };
+		std::atomic<Entry *> deque[MAX_JOBS];
+		Entry pool[MAX_JOBS];
+		size_t nextJob = 0;
+		unsigned int random = 0;	// victim choice when stealing
+
+		std::atomic<unsigned long long> executed{ 0 };
+		std::atomic<unsigned long long> stolen{ 0 };
+	};
+
+	struct Scheduler
+	{
+		std::atomic<Worker *> workers[MAX_THREADS] = {};
+		std::atomic<int> workerCount{ 0 };
+		std::vector<std::thread> threads;
+
+		// idle workers sleep here until jobs are pushed
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::atomic<int> sleeping{ 0 };
+		std::atomic<bool> stopping{ false };
+	};
+
+public:
+	// Start threadCount - 1 worker threads, the calling thread being the
+	// first of threadCount. 0 uses every hardware thread.
+	static void UCreateScheduler(Scheduler &scheduler, int threadCount = 0);
+
+	// Stop the workers. Jobs must not be in flight.
+	static void UDestroyScheduler(Scheduler &scheduler);
+
+	// Threads running jobs, the creating thread included
+	static int UThreadCount(const Scheduler &scheduler);
+
+	// Queue function(context, first, count) on the calling thread's deque
+	static void URun(Scheduler &scheduler, Function function, void *context, size_t first, size_t count, Counter &counter);
+
+	// Run jobs until every job counted by counter has finished
+	static void UWait(Scheduler &scheduler, Counter &counter);
+
+	// Split 0 .. count - 1 into jobs of at most grain indices and wait for them
+	static void UParallelFor(Scheduler &scheduler, size_t count, size_t grain, Function function, void *context);
+
+	// Same, calling fn(i) for every index
+	template <typename Fn>
+	static void UParallelFor(Scheduler &scheduler, size_t count, size_t grain, const Fn &fn)
+	{
+		UParallelFor(scheduler, count, grain, [](void *context, size_t first, size_t count)
+		{
+			const Fn &fn = *static_cast<const Fn *>(context);
+			for (size_t i = first; i < first + count; i++)
+				fn(i);
+		}, const_cast<Fn *>(&fn));
+	}
+
+	// Jobs run and jobs stolen from other threads since creation
+	static void UStats(const Scheduler &scheduler, unsigned long long &executed, unsigned long long &stolen);
+};
@@ -1,5 +1,13 @@
 #include <iostream>         // cout, cerr
 #include <cstdlib>          // EXIT_FAILURE
+#include <cctype>           // isdigit
+#include <cstdio>           // snprintf
+#include <algorithm>        // min, max
+#include <atomic>           // atomic
+#include <cstring>          // strcmp
+#include <map>              // map
+#include <string>           // string
+#include <vector>           // vector
 #include <GL/glew.h>        // GLEW library
 #include <GLFW/glfw3.h>     // GLFW library
 
@@ -10,6 +18,24 @@
 
 // include the provided basic shape meshes code
 #include "./meshes.h"
+#include "./meshcache.h"
+#include "./meshlets.h"
+#include "./frustum.h"
+#include "./scene.h"
+#include "./idbuffer.h"
+#include "./hiz.h"
+#include "./depthprepass.h"
+#include "./clusters.h"
+#include "./shadows.h"
+#include "./deferred.h"
+#include "./framepacer.h"
+#include "./renderthread.h"
+#include "./commandlist.h"
+#include "./jobs.h"
+#include "./arena.h"
+#include "./materials.h"
+#include "./streambuffer.h"
+#include "./alloctracker.h"
 #include "./camera.h"
 
 using namespace std; // Standard namespace
@@ -30,6 +56,14 @@ namespace
 	// Variables for window width and height
 	const int WINDOW_WIDTH = 800;
 	const int WINDOW_HEIGHT = 600;
+
+	// Clip planes of both projections, the light clusters are sliced between them
+	const float NEAR_PLANE = 0.1f;
+	const float FAR_PLANE = 100.0f;
+
+	// The two scene lights, their shadows look from here at the computer
+	const glm::vec3 LIGHT_POSITIONS[Shadows::LIGHT_COUNT] = { glm::vec3(2.0f, 5.0f, 5.0f), glm::vec3(-2.0f, 5.0f, 5.0f) };
+	const glm::vec3 LIGHT_TARGET(0.0f, 2.0f, 3.0f);
 	// Stores the GL data relative to a given mesh
 	struct GLMesh
 	{
@@ -45,25 +79,326 @@ namespace
 	// Shader program
 	GLuint gProgramId;
 
-	//Shape Meshes from Professor Brian
-	Meshes meshes;
+	// Shared parametric meshes, keyed by generator parameters
+	MeshCache gMeshCache;
+
+	// Work stealing jobs for culling, light binning and image decoding,
+	// --jobs <count> sets the number of threads running them
+	Jobs::Scheduler gJobs;
+	int gJobThreads = 0;
+
+	// An image decoded by a job, uploaded as a texture on the GL thread
+	struct TextureImage
+	{
+		const char* filename;
+		unsigned char* pixels;
+		int width;
+		int height;
+		int channels;
+	};
+
+	// Everything drawn by URender, in draw order
+	const SceneNode gSceneNodes[] =
+	{
+		{ "background plane", MeshCache::SHAPE_PLANE, glm::vec3(50.0f, 50.0f, 50.0f), 0.0f, glm::vec3(0.5f, 1.0f, 0.0f), glm::vec3(-1.5f, 0.4f, 3.0f), glm::vec4(0.3f, 0.5f, 0.30f, 1.0f), SCENE_TEXTURE_CASE },
+		{ "backdrop", MeshCache::SHAPE_PLANE, glm::vec3(50.0f, 50.0f, 50.0f), 90.0f, glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -10.0f), glm::vec4(0.3f, 0.5f, 0.30f, 1.0f), SCENE_TEXTURE_CASE },
+		{ "main computer body", MeshCache::SHAPE_BOX, glm::vec3(5.0f, 5.0f, 5.0f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.0f, 3.0f, 0.0f), glm::vec4(0.9f, 0.9f, 0.7f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "monitor screen", MeshCache::SHAPE_BOX, glm::vec3(4.0f, 2.5f, 0.2f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.0f, 3.5f, 2.5f), glm::vec4(0.0f, 0.2f, 0.0f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "monitor screen depth top", MeshCache::SHAPE_BOX, glm::vec3(5.0f, 0.5f, 0.5f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.0f, 5.0f, 2.5f), glm::vec4(0.9f, 0.9f, 0.7f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "monitor screen depth right", MeshCache::SHAPE_BOX, glm::vec3(0.5f, 2.5f, 0.5f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(2.25f, 3.5f, 2.5f), glm::vec4(0.9f, 0.9f, 0.7f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "monitor screen depth left", MeshCache::SHAPE_BOX, glm::vec3(0.5f, 2.5f, 0.5f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-2.25f, 3.5f, 2.5f), glm::vec4(0.9f, 0.9f, 0.7f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "monitor screen depth bottom", MeshCache::SHAPE_BOX, glm::vec3(5.0f, 1.0f, 0.5f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.0f, 1.75f, 2.5f), glm::vec4(0.9f, 0.9f, 0.7f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "monitor slot", MeshCache::SHAPE_BOX, glm::vec3(1.5f, 0.1f, 1.0f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(1.25f, 1.75f, 2.3f), glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "secondary monitor slot", MeshCache::SHAPE_BOX, glm::vec3(0.5f, 0.25f, 1.0f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(1.75f, 1.75f, 2.3f), glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "apple logo", MeshCache::SHAPE_PLANE, glm::vec3(0.2f, 0.2f, 0.2f), 90.0f, glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.75f, 1.58f, 2.76f), glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), SCENE_TEXTURE_LOGO },
+		{ "keyboard body", MeshCache::SHAPE_BOX, glm::vec3(5.25f, 0.5f, 2.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.15f, 0.7f, 5.75f), glm::vec4(0.9f, 0.9f, 0.7f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "~ key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-2.0f, 1.0f, 5.15f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "Tab key", MeshCache::SHAPE_BOX, glm::vec3(0.375f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-1.94f, 1.0f, 5.5f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "Caps key", MeshCache::SHAPE_BOX, glm::vec3(0.7f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-1.78f, 1.0f, 5.85f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "Shift key", MeshCache::SHAPE_BOX, glm::vec3(0.75f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-1.75f, 1.0f, 6.2f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "1 key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-1.65f, 1.0f, 5.15f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "2 key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-1.30f, 1.0f, 5.15f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "2 key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-0.95f, 1.0f, 5.15f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "3 key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-0.60f, 1.0f, 5.15f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "4 key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-0.25f, 1.0f, 5.15f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "5 key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.1f, 1.0f, 5.15f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "6 key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.45f, 1.0f, 5.15f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "6 key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.80f, 1.0f, 5.15f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "7 key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(1.15f, 1.0f, 5.15f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "8 key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(1.5f, 1.0f, 5.15f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "9 key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(1.85f, 1.0f, 5.15f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "backspace key", MeshCache::SHAPE_BOX, glm::vec3(0.375f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(2.15f, 1.0f, 5.15f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "q key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-1.55f, 1.0f, 5.5f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "w key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-1.25f, 1.0f, 5.5f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "w key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-0.9f, 1.0f, 5.5f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "e key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-0.55f, 1.0f, 5.5f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "r key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-0.20f, 1.0f, 5.5f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "r key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.15f, 1.0f, 5.5f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "T key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.5f, 1.0f, 5.5f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "Y key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.85f, 1.0f, 5.5f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "U key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(1.2f, 1.0f, 5.5f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "I key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(1.55f, 1.0f, 5.5f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "O key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(1.9f, 1.0f, 5.5f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "O key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(2.25f, 1.0f, 5.5f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "S key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-1.17f, 1.0f, 5.85f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "D key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-0.82f, 1.0f, 5.85f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "F key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-0.82f, 1.0f, 5.85f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "G key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-0.47f, 1.0f, 5.85f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "H key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-0.12f, 1.0f, 5.85f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "H key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-0.12f, 1.0f, 5.85f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "J key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.23f, 1.0f, 5.85f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "K key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.58f, 1.0f, 5.85f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "L key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.93f, 1.0f, 5.85f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "; key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(1.28f, 1.0f, 5.85f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "' key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(1.63f, 1.0f, 5.85f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "ENTER key", MeshCache::SHAPE_BOX, glm::vec3(0.5f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(2.15f, 1.0f, 5.85f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "Z key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-1.15f, 1.0f, 6.2f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "X key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-0.8f, 1.0f, 6.2f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "C key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-0.45f, 1.0f, 6.2f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "V key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-0.1f, 1.0f, 6.2f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "V key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.25f, 1.0f, 6.2f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "B key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.6f, 1.0f, 6.2f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "N key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.95f, 1.0f, 6.2f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "M key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.95f, 1.0f, 6.2f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ ", key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(1.3f, 1.0f, 6.2f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ ". key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(1.65f, 1.0f, 6.2f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "right shift key", MeshCache::SHAPE_BOX, glm::vec3(0.75f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(1.95f, 1.0f, 6.2f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "option key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-1.5f, 1.0f, 6.55f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "mac button key", MeshCache::SHAPE_BOX, glm::vec3(0.5f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-1.05f, 1.0f, 6.55f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "space key", MeshCache::SHAPE_BOX, glm::vec3(2.0f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.25f, 1.0f, 6.55f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "space key", MeshCache::SHAPE_BOX, glm::vec3(0.5f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(1.55f, 1.0f, 6.55f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+		{ "space key", MeshCache::SHAPE_BOX, glm::vec3(0.25f, 0.25f, 0.25f), 0.0f, glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(2.0f, 1.0f, 6.55f), glm::vec4(0.7f, 0.7f, 0.5f, 1.0f), SCENE_TEXTURE_NONE },
+	};
+	Scene gScene;
+
+	// nodes that passed frustum culling in the last frame, and how many
+	// of those were then rejected by the occlusion test. The occlusion test
+	// runs where the frame is drawn, the title is set on the main thread
+	size_t gVisibleCount = 0;
+	std::atomic<size_t> gOccludedCount(0);
+	char gTitle[256] = "";	// formatted in place, no allocation per frame
+
+	// Occlusion culling against last frame's depth pyramid, H cycles the modes
+	enum OcclusionMode
+	{
+		OCCLUSION_OFF,
+		OCCLUSION_GPU,	// pyramid built by a compute shader, read back asynchronously
+		OCCLUSION_CPU	// depth read back and reduced on the CPU, stalls
+	};
+	OcclusionMode gOcclusionMode = OCCLUSION_OFF;
+	HiZ::GLHiZ gHiZ;
+
+	// Depth only pre-pass before shading, Z toggles it and X toggles the
+	// overdraw statistics printed once a second
+	bool gDepthPrepass = false;
+	bool gOverdrawStats = false;
+	double gLastOverdrawReport = 0.0;
+	DepthPrepass::GLDepthPrepass gPrepass;
+
+	// Clustered point lights on top of the two scene lights, L cycles the
+	// modes and --lights <count> sets how many are scattered over the desk
+	enum LightingMode
+	{
+		LIGHTS_OFF,
+		LIGHTS_CPU,	// light lists built on the CPU in parallel
+		LIGHTS_GPU	// light lists built by a compute shader
+	};
+	LightingMode gLightingMode = LIGHTS_OFF;
+	size_t gPointLightCount = 256;
+	Clusters::GLClusters gClusters;
+
+	// Ring of mapped buffer memory the per frame uploads are written to,
+	// the cluster light lists and the CPU culled meshlet draws
+	StreamBuffer::GLStreamBuffer gStream;
+
+	// Cascaded shadow maps of the two scene lights, K toggles them
+	bool gShadows = false;
+	Shadows::GLShadows gShadowMaps;
+
+	// Forward shading or a G-buffer lit in a fullscreen pass, G switches
+	enum ShadingMode
+	{
+		SHADING_FORWARD,
+		SHADING_DEFERRED
+	};
+	ShadingMode gShadingMode = SHADING_FORWARD;
+	Deferred::GLDeferred gDeferred;
 
 	Camera gCamera(glm::vec3(0.0f, 3.0f, 20.0f));
+
+	// Fixed timestep simulation: input moves gCamera in ticks of
+	// SIMULATION_STEP, frames are drawn with the camera interpolated between
+	// the last two ticks, so movement does not depend on the frame rate
+	const double SIMULATION_STEP = 1.0 / 120.0;
+	const double MAX_FRAME_TIME = 0.25;	// longer frames slow the simulation down instead
+	double gFrameStart = 0.0;		// pacer time the last frame started on the main thread
+	double gSimulationLag = 0.0;		// time not simulated yet, less than a step after the ticks
+	unsigned long long gSimulationTicks = 0;
+	Camera gPreviousCamera = gCamera;	// camera at the tick before the last
+	Camera gRenderCamera = gCamera;		// camera the frame is drawn with
+	glm::vec2 gMouseOffset(0.0f);		// mouse movement waiting for the next tick
+	float gScrollOffset = 0.0f;		// scrolling waiting for the next tick
 	float gLastY = WINDOW_HEIGHT / 2.0f;
 	float gLastX = WINDOW_WIDTH / 2.0f;
 	bool  gFirstMouse = true; // ?
 	bool orthoViewToggle = false;
 
 	// timing
-	float gDeltaTime = 0.0f; // time between current frame and last frame
-	float gLastFrame = 0.0f;
+	float gDeltaTime = float(SIMULATION_STEP); // time simulated by one call of UProcessInput
+
+	// Swap interval and frame rate cap, V cycles the modes and F prints the
+	// frame time histogram. --pacing <mode> and --fps <rate> pick them at start
+	FramePacer::Pacer gPacer;
+	FramePacer::Mode gPacingMode = FramePacer::MODE_VSYNC;
+	double gTargetFps = 60.0;
+	bool gReportPacing = false;	// print the histogram with the next frame
 	GLMesh gMesh;
 
-	//texture information
-	GLuint gTextureIdCase;
-	GLuint gTextureIdLogo;
+	// Node materials and the texture array they sample
+	Materials::GLMaterials gMaterials;
+
+	// dequantization uniform locations, looked up again when the surface
+	// program changes between forward and deferred shading
+	GLuint gSurfaceProgramId = 0;
+	GLint gPositionOffsetLoc;
+	GLint gPositionScaleLoc;
+	GLint gUVOffsetLoc;
+	GLint gUVScaleLoc;
 
 	glm::vec2 gUVScale(5.0f, 5.0f);
+
+	// Meshlet rendering of the boxes and planes, M cycles through the modes
+	enum MeshletMode
+	{
+		MESHLETS_OFF,	// plain glDrawElements
+		MESHLETS_CPU,	// meshlets culled on the CPU
+		MESHLETS_GPU	// meshlets culled by a compute shader
+	};
+	MeshletMode gMeshletMode = MESHLETS_OFF;
+	std::map<const Meshes::GLMesh*, Meshlets::GLMeshlets> gMeshlets;
+	GLuint gMeshletCullProgramId;
+
+	// projection * view of the last frame packet, raycast picking unprojects with it
+	glm::mat4 gViewProjection;
+
+	// How a left click finds the object under the cursor, I switches
+	enum PickMode
+	{
+		PICK_RAYCAST,	// CPU ray through the BVH
+		PICK_ID_BUFFER	// object IDs rendered with the scene, read back later
+	};
+	PickMode gPickMode = PICK_RAYCAST;
+	IdBuffer::GLIdBuffer gIdBuffer;
+	GLint gObjectIdLoc;
+
+	// ID buffer pick waiting for the next frame packet, in framebuffer pixels
+	bool gPickRequested = false;
+	GLint gPickX = 0;
+	GLint gPickY = 0;
+
+	// The draws of a frame are recorded into a command list. Its pipelines
+	// are the material variants, each pass replaying the list picks its
+	// program. --record-threads <count> splits the nodes into that many runs
+	// (the case, the screen, the keyboard rows), culled and recorded in
+	// parallel into lists of their own that are then merged in node order
+	struct RecordPart
+	{
+		size_t first;
+		size_t count;
+		size_t visibleCount;
+		unsigned char* visible;	// in the packet's arena
+	};
+	int gRecordThreads = 1;
+	std::vector<RecordPart> gRecordParts;
+	std::vector<CommandList::List> gRecordLists;
+
+	// What URecordPart is given for every part
+	struct RecordContext
+	{
+		const Frustum* frustum;
+		Arena::FrameArena* arena;
+	};
+
+	// Scratch memory that lives for one frame: each packet has an arena for
+	// the data built with it on the main thread and the jobs it starts, the
+	// render side has one for what URender works out. An arena that still
+	// grows after ARENA_WARMUP_FRAMES is reported
+	Arena::FrameArena gRenderArena;
+	const unsigned long long ARENA_WARMUP_FRAMES = 60;
+	unsigned long long gBuiltFrames = 0;
+	unsigned long long gRenderedFrames = 0;
+
+	// --alloc-check [frames] runs that many frames (1000 by default) in a
+	// hidden window and fails when operator new is called on any thread once
+	// ALLOC_CHECK_WARMUP frames are done, printing where the first of those
+	// allocations came from
+	unsigned long long gAllocCheckFrames = 0;
+	const unsigned long long ALLOC_CHECK_WARMUP = 120;
+	unsigned long long gWarmAllocations = 0;
+
+	// Everything URender needs to draw one frame, built by the main thread.
+	// URender reads nothing else the main thread changes, so a packet can be
+	// drawn while the main thread already builds the next one
+	struct FramePacket
+	{
+		int framebufferWidth = 0;
+		int framebufferHeight = 0;
+
+		// camera of the frame
+		glm::mat4 view;
+		glm::mat4 projection;
+		glm::mat4 viewProjection;
+		glm::vec3 cameraPosition;
+		glm::vec3 cameraFront;
+		bool ortho = false;
+
+		// draws of the frustum culled nodes in node order, with their materials
+		CommandList::List commands;
+
+		// transient data of this frame, reset when the packet is built again
+		Arena::FrameArena arena;
+
+		// the modes and toggles of the keys
+		ShadingMode shading = SHADING_FORWARD;
+		OcclusionMode occlusion = OCCLUSION_OFF;
+		MeshletMode meshlets = MESHLETS_OFF;
+		PickMode picking = PICK_RAYCAST;
+		LightingMode lighting = LIGHTS_OFF;
+		bool depthPrepass = false;
+		bool overdrawStats = false;
+		bool shadows = false;
+		FramePacer::Mode pacing = FramePacer::MODE_VSYNC;
+		bool reportPacing = false;
+
+		// ID buffer pick to start this frame
+		bool pickRequested = false;
+		GLint pickX = 0;
+		GLint pickY = 0;
+	};
+
+	// --render-thread draws the packets on a thread owning the GL context,
+	// otherwise the main thread draws each packet as soon as it is built
+	bool gUseRenderThread = false;
+	RenderThread::Thread gRenderThread;
+	FramePacket gPackets[RenderThread::PACKET_COUNT];
+
+	// What the render side last applied, to catch up with changed packets
+	int gViewportWidth = 0;
+	int gViewportHeight = 0;
+	OcclusionMode gRenderedOcclusionMode = OCCLUSION_OFF;
+	bool gRenderedOverdrawStats = false;
+	bool gRenderedShadows = false;
+
+	// What the replay callbacks need while URender replays a packet
+	struct ReplayState
+	{
+		const FramePacket* packet;
+		GLuint programIds[Materials::VARIANT_COUNT];	// of every material variant in this pass
+		GLint modelLoc;
+		GLint materialLoc;
+		const CommandList::DrawData* data;	// last draw data set
+		const unsigned char* occluded;		// per scene node, hidden by the occlusion test
+	};
 }
 
 /* User-defined Function prototypes to:
@@ -72,16 +407,37 @@ namespace
  * and render graphics on the screen
  */
 bool UInitialize(int, char* [], GLFWwindow** window);
-void UResizeWindow(GLFWwindow* window, int width, int height);
 void UProcessInput(GLFWwindow* window);
-void URender();
+void URender(const FramePacket& packet);
+void UBuildFramePacket(FramePacket& packet);
+void UApplyPacketSettings(const FramePacket& packet);
+void URecordNode(CommandList::List& list, size_t index);
+void URecordPart(void* context, size_t part, CommandList::List& list);
+void UCheckAllocations();
+bool UCheckJobs(int threadCount);
+void UReplayBindPipeline(void* context, std::uint32_t pipeline);
+void UReplayBindGeometry(void* context, const Meshes::GLMesh& mesh);
+void UReplaySetDrawData(void* context, const CommandList::DrawData& data);
+void UReplayDraw(void* context, const Meshes::GLMesh& mesh, CommandList::Range range);
+void UReplayDrawDepth(void* context, const Meshes::GLMesh& mesh, CommandList::Range range);
 bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
 void UDestroyShaderProgram(GLuint programId);
 void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos);
 void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
-bool UCreateTexture(const char* filename, GLuint& textureId);
-void UDestroyTexture(GLuint textureId);
+void UDecodeImages(void* context, size_t first, size_t count);
+void UBindMesh(const Meshes::GLMesh& mesh);
+void UDrawMesh(const Meshes::GLMesh& mesh, const glm::mat4& model, const FramePacket& packet);
+void UKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
+void UReportVisibility();
+void UPickAtCursor(GLFWwindow* window);
+bool UGetPickPoint(GLFWwindow* window, double& x, double& y);
+void UCollectIdPick();
+void UReportOverdraw(const FramePacket& packet);
+void UCreatePointLights(size_t count);
+void UUploadPointLights();
+void ULocateSurfaceUniforms(GLuint programId);
+Camera UInterpolateCamera(const Camera& from, const Camera& to, float alpha);
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////
 /* Surface Vertex Shader Source Code*/
@@ -100,14 +456,24 @@ uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// Dequantization of packed meshes (identity for float meshes)
+uniform vec3 positionOffset = vec3(0.0f);
+uniform vec3 positionScale = vec3(1.0f);
+uniform vec2 uvOffset = vec2(0.0f);
+uniform vec2 uvScale = vec2(1.0f);
+
+invariant gl_Position;
+
 void main()
 {
-	gl_Position = projection * view * model * vec4(vertexPosition, 1.0f); // Transforms vertices into clip coordinates
+	vec3 position = positionOffset + positionScale * vertexPosition; // Expand packed positions back to model space
 
-	vertexFragmentPos = vec3(model * vec4(vertexPosition, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
+	gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
+
+	vertexFragmentPos = vec3(model * vec4(position, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
 
 	vertexFragmentNormal = mat3(transpose(inverse(model))) * vertexNormal; // get normal vectors in world space only and exclude normal translation properties
-	vertexTextureCoordinate = textureCoordinate;
+	vertexTextureCoordinate = uvOffset + uvScale * textureCoordinate;
 }
 );
 ////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -119,26 +485,106 @@ const GLchar* fragmentShaderSource = GLSL(440,
 in vec3 vertexFragmentPos; // For incoming fragment position
 in vec2 vertexTextureCoordinate;
 
-out vec4 fragmentColor; // For outgoing cube color to the GPU
+layout(location = 0) out vec4 fragmentColor; // For outgoing cube color to the GPU
+layout(location = 1) out uint fragmentObjectId; // For ID buffer picking, ignored without an ID attachment
 
-// Uniform / Global variables for object color, light color, light position, and camera/view position
-uniform vec4 objectColor;
+// Uniform / Global variables for light color, light position, and camera/view position
 uniform vec3 ambientColor;
 uniform vec3 light1Color;
 uniform vec3 light1Position;
 uniform vec3 light2Color;
 uniform vec3 light2Position;
 uniform vec3 viewPosition;
-uniform sampler2D uTexture; // Useful when working with multiple textures
-uniform bool ubHasTexture;
+uniform uint objectId;
 uniform float ambientStrength = 0.1f; // Set ambient or global lighting strength
 uniform float specularIntensity1 = 0.1f;
 uniform float highlightSize1 = 0.0f;
 uniform float specularIntensity2 = 0.1f;
 uniform float highlightSize2 = 0.0f;
 
+// Materials, see materials.h: the color is used without a texture layer
+struct Material
+{
+	vec4 color;
+	int textureLayer;
+	float specularStrength;
+	uint variant;
+	float padding;
+};
+layout(std430, binding = 6) readonly buffer MaterialBuffer { Material materials[]; };
+uniform uint materialIndex;
+uniform sampler2DArray uTextures;
+
+// Clustered point lights, see clusters.h
+struct PointLight
+{
+	vec3 position;
+	float radius;
+	vec3 color;
+	float padding;
+};
+layout(std430, binding = 2) readonly buffer LightBuffer { PointLight lights[]; };
+layout(std430, binding = 3) readonly buffer ClusterBuffer { uvec2 clusters[]; };
+layout(std430, binding = 4) readonly buffer LightIndexBuffer { uint lightIndices[]; };
+uniform bool clusteredLighting = false;
+uniform mat4 view;
+uniform uvec3 clusterGrid;
+uniform vec2 clusterScreenSize;
+uniform vec2 clusterDepthSlicing; // slice = log(view depth) * x + y
+
+// Cascaded shadow maps, see shadows.h: 2 lights x 3 cascades
+uniform bool shadowsEnabled = false;
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 shadowMatrices[6];
+uniform float shadowSplits[3];
+
+// Diffuse light of the point lights in this fragment's cluster, fading out at their radius
+vec3 clusteredPointLighting(vec3 norm)
+{
+	float viewDepth = -(view * vec4(vertexFragmentPos, 1.0f)).z;
+	uvec2 tile = uvec2(clamp(gl_FragCoord.xy / clusterScreenSize, 0.0f, 0.9999f) * vec2(clusterGrid.xy));
+	uint slice = uint(clamp(log(max(viewDepth, 1e-4f)) * clusterDepthSlicing.x + clusterDepthSlicing.y, 0.0f, float(clusterGrid.z - 1)));
+	uvec2 range = clusters[tile.x + clusterGrid.x * (tile.y + clusterGrid.y * slice)];
+
+	vec3 lighting = vec3(0.0f);
+	for (uint i = 0; i < range.y; i++)
+	{
+		PointLight light = lights[lightIndices[range.x + i]];
+		vec3 toLight = light.position - vertexFragmentPos;
+		float distance = length(toLight);
+		float falloff = clamp(1.0f - (distance * distance) / (light.radius * light.radius), 0.0f, 1.0f);
+		lighting += max(dot(norm, toLight / max(distance, 1e-4f)), 0.0f) * falloff * falloff * light.color;
+	}
+	return lighting;
+}
+
+// Fraction of a light reaching this fragment: 3x3 PCF taps, each one a
+// hardware filtered 2x2 comparison
+float shadowFactor(int light, vec3 norm, float viewDepth)
+{
+	int cascade = 0;
+	while (cascade < 3 && viewDepth > shadowSplits[cascade])
+		cascade++;
+	if (cascade == 3)
+		return 1.0f;
+
+	int layer = light * 3 + cascade;
+	vec4 position = shadowMatrices[layer] * vec4(vertexFragmentPos + norm * 0.02f, 1.0f);
+	vec3 coord = position.xyz / position.w;
+	vec2 texel = 1.0f / vec2(textureSize(shadowMap, 0).xy);
+	float lit = 0.0f;
+	for (int y = -1; y <= 1; y++)
+	{
+		for (int x = -1; x <= 1; x++)
+			lit += texture(shadowMap, vec4(coord.xy + vec2(x, y) * texel, float(layer), coord.z));
+	}
+	return lit / 9.0f;
+}
+
 void main()
 {
+	Material material = materials[materialIndex];
+
 	/*Phong lighting model calculations to generate ambient, diffuse, and specular components*/
 
 	//Calculate Ambient lighting
@@ -158,35 +604,37 @@ void main()
 	vec3 reflectDir1 = reflect(-light1Direction, norm);// Calculate reflection vector
 	//Calculate specular component
 	float specularComponent1 = pow(max(dot(viewDir, reflectDir1), 0.0), highlightSize1);
-	vec3 specular1 = specularIntensity1 * specularComponent1 * light1Color;
+	vec3 specular1 = material.specularStrength * specularIntensity1 * specularComponent1 * light1Color;
 	vec3 reflectDir2 = reflect(-light2Direction, norm);// Calculate reflection vector
 	//Calculate specular component
 	float specularComponent2 = pow(max(dot(viewDir, reflectDir2), 0.0), highlightSize2);
-	vec3 specular2 = specularIntensity2 * specularComponent2 * light2Color;
-
-	//**Calculate phong result**
-	//Texture holds the color to be used for all three components
-	vec4 textureColor = texture(uTexture, vertexTextureCoordinate);
-	vec3 phong1;
-	vec3 phong2;
+	vec3 specular2 = material.specularStrength * specularIntensity2 * specularComponent2 * light2Color;
 
-	if (ubHasTexture == true)
+	//**Calculate shadows**
+	float shadow1 = 1.0f;
+	float shadow2 = 1.0f;
+	if (shadowsEnabled)
 	{
-		phong1 = (ambient + diffuse1 + specular1) * textureColor.xyz;
-		phong2 = (ambient + diffuse2 + specular2) * textureColor.xyz;
-		fragmentColor = texture(uTexture, vertexTextureCoordinate);
-
+		float viewDepth = -(view * vec4(vertexFragmentPos, 1.0f)).z;
+		shadow1 = shadowFactor(0, norm, viewDepth);
+		shadow2 = shadowFactor(1, norm, viewDepth);
 	}
-	else
-	{
-		phong1 = (ambient + diffuse1 + specular1) * objectColor.xyz;
-		phong2 = (ambient + diffuse2 + specular2) * objectColor.xyz;
-		fragmentColor = objectColor;
 
-	}
+	//**Calculate phong result**
+	//Texture layer or material color is the color used for all three components
+	vec3 surfaceColor = material.color.xyz;
+	if (material.textureLayer >= 0)
+		surfaceColor = texture(uTextures, vec3(vertexTextureCoordinate, float(material.textureLayer))).xyz;
+	vec3 phong1 = (ambient + shadow1 * diffuse1 + shadow1 * specular1) * surfaceColor;
+	vec3 phong2 = (ambient + shadow2 * diffuse2 + shadow2 * specular2) * surfaceColor;
 
 	fragmentColor = vec4(phong1 + phong2, 1.0); // Send lighting results to GPU
 
+	// Point lights only loop over the lights of their cluster
+	if (clusteredLighting)
+		fragmentColor.xyz += clusteredPointLighting(norm) * surfaceColor;
+	fragmentObjectId = objectId;
+
 	//fragmentColor = vec4(1.0f, 1.0f, 1.0f, 1.0f);
 }
 );
@@ -213,73 +661,272 @@ void flipImageVertically(unsigned char* image, int width, int height, int channe
 
 int main(int argc, char* argv[])
 {
+	// --jobs-check queues more jobs than a deque holds, on one thread and on
+	// eight, and fails unless each of them ran exactly once
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--jobs-check") == 0)
+			return UCheckJobs(1) && UCheckJobs(8) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
 	if (!UInitialize(argc, argv, &gWindow))
 		return EXIT_FAILURE;
 
-	// Create the basic shape meshes for use
-	meshes.CreateMeshes();
+	// --mesh-cache <dir> keeps generated vertex data on disk between runs
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		if (strcmp(argv[i], "--mesh-cache") == 0)
+			gMeshCache.SetDiskCacheDirectory(argv[i + 1]);
+		else if (strcmp(argv[i], "--jobs") == 0)
+			gJobThreads = atoi(argv[i + 1]);
+	}
+	Jobs::UCreateScheduler(gJobs, gJobThreads);
+	gMeshCache.SetJobs(&gJobs);
+
+	// The case, keys and backdrop are all boxes and planes, so store
+	// those in the compact vertex format to halve their vertex bandwidth
+	if (!gScene.Create(gMeshCache, gMaterials, gSceneNodes, sizeof(gSceneNodes) / sizeof(gSceneNodes[0]), Meshes::VERTEX_FORMAT_PACKED))
+		return EXIT_FAILURE;
+
+	// Split every mesh used by the scene into meshlets for the culled draw path
+	for (size_t i = 0; i < gScene.Count(); i++)
+	{
+		const Meshes::GLMesh* mesh = &gScene.Mesh(i);
+		if (gMeshlets.count(mesh) == 0)
+			Meshlets::UCreateMeshlets(gMeshlets[mesh], *mesh, *gMeshCache.Data(gScene.Params(i)));
+	}
+	if (!Meshlets::UCreateCullProgram(gMeshletCullProgramId))
+		return EXIT_FAILURE;
+	if (!HiZ::UCreateHiZ(gHiZ))
+		return EXIT_FAILURE;
+	if (!DepthPrepass::UCreateDepthPrepass(gPrepass))
+		return EXIT_FAILURE;
+	if (!Clusters::UCreateClusters(gClusters))
+		return EXIT_FAILURE;
+	if (!Shadows::UCreateShadows(gShadowMaps))
+		return EXIT_FAILURE;
+	if (!Deferred::UCreateDeferred(gDeferred, vertexShaderSource))
+		return EXIT_FAILURE;
+
+	// without it the uploads go through glBufferSubData as before
+	StreamBuffer::UCreateStreamBuffer(gStream);
 
 	// Create the shader program
 	if (!UCreateShaderProgram(vertexShaderSource, fragmentShaderSource, gProgramId))
 		return EXIT_FAILURE;
 
 
-	//load textures
-	const char* caseTexture = "casetexture.jpg";
-	if (!UCreateTexture(caseTexture, gTextureIdCase))
+	//load textures, decoded as jobs and uploaded here as the layers of the
+	//material texture array, in SceneTexture order
+	TextureImage images[] = { { "casetexture.jpg", NULL, 0, 0, 0 }, { "applelogo.png", NULL, 0, 0, 0 } };
+	const size_t imageCount = sizeof(images) / sizeof(images[0]);
+	Jobs::UParallelFor(gJobs, imageCount, 1, UDecodeImages, images);
+
+	Materials::Image layers[imageCount];
+	for (size_t i = 0; i < imageCount; i++)
 	{
-		cout << "Failed to load texture " << caseTexture << endl;
-		return EXIT_FAILURE;
+		if (!images[i].pixels)
+		{
+			cout << "Failed to load texture " << images[i].filename << endl;
+			return EXIT_FAILURE;
+		}
+		layers[i] = { images[i].pixels, images[i].width, images[i].height, images[i].channels };
 	}
 
-
-	//load textures
-	const char* logoTexture = "applelogo.png";
-	if (!UCreateTexture(logoTexture, gTextureIdLogo))
-	{
-		cout << "Failed to load texture " << logoTexture << endl;
+	bool materialsCreated = Materials::UCreateMaterials(gMaterials, layers, imageCount);
+	for (TextureImage& image : images)
+		stbi_image_free(image.pixels);
+	if (!materialsCreated)
 		return EXIT_FAILURE;
-	}
 
 
 	// tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
 	glUseProgram(gProgramId);
-	// We set the texture as texture unit 0
-	glUniform1i(glGetUniformLocation(gProgramId, "uTexture"), 0);
+	// We set the texture array as texture unit 0
+	glUniform1i(glGetUniformLocation(gProgramId, "uTextures"), Materials::TEXTURE_UNIT);
+	// and the shadow maps as unit 3, samplers of different types may not share a unit
+	glUniform1i(glGetUniformLocation(gProgramId, "shadowMap"), Shadows::TEXTURE_UNIT);
+	glUseProgram(gDeferred.lightingProgram);
+	glUniform1i(glGetUniformLocation(gDeferred.lightingProgram, "shadowMap"), Shadows::TEXTURE_UNIT);
+	glUseProgram(gProgramId);
+
+	// Locate the per mesh dequantization uniforms
+	ULocateSurfaceUniforms(gProgramId);
+
+	// Offscreen target with an object ID attachment for ID buffer picking
+	int framebufferWidth, framebufferHeight;
+	glfwGetFramebufferSize(gWindow, &framebufferWidth, &framebufferHeight);
+	if (!IdBuffer::UCreateIdBuffer(gIdBuffer, framebufferWidth, framebufferHeight))
+		return EXIT_FAILURE;
+
+	// --id-picking starts with ID buffer picking instead of raycasting,
+	// --depth-prepass with the depth pre-pass on
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--id-picking") == 0)
+			gPickMode = PICK_ID_BUFFER;
+		else if (strcmp(argv[i], "--depth-prepass") == 0)
+			gDepthPrepass = true;
+		else if (strcmp(argv[i], "--shadows") == 0)
+			gShadows = true;
+		else if (strcmp(argv[i], "--deferred") == 0)
+			gShadingMode = SHADING_DEFERRED;
+		else if (strcmp(argv[i], "--lights") == 0 && i + 1 < argc)
+			gPointLightCount = size_t(atoi(argv[i + 1]));
+		else if (strcmp(argv[i], "--pacing") == 0 && i + 1 < argc && !FramePacer::UParseMode(argv[i + 1], gPacingMode))
+			cout << "Unknown pacing mode " << argv[i + 1] << ", use vsync, adaptive, uncapped or fixed" << endl;
+		else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc)
+			gTargetFps = atof(argv[i + 1]);
+		else if (strcmp(argv[i], "--render-thread") == 0)
+			gUseRenderThread = true;
+		else if (strcmp(argv[i], "--record-threads") == 0 && i + 1 < argc)
+			gRecordThreads = std::max(atoi(argv[i + 1]), 1);
+	}
+	UCreatePointLights(gPointLightCount);
+
+	Arena::UCreateArena(gRenderArena);
+	for (FramePacket& packet : gPackets)
+		Arena::UCreateArena(packet.arena);
+
+	// contiguous runs of nodes, so the merged list keeps the draw order
+	gRecordParts.resize(std::min<size_t>(gRecordThreads, gScene.Count()));
+	gRecordLists.resize(gRecordParts.size());
+	for (size_t part = 0; part < gRecordParts.size(); part++)
+	{
+		gRecordParts[part].first = gScene.Count() * part / gRecordParts.size();
+		gRecordParts[part].count = gScene.Count() * (part + 1) / gRecordParts.size() - gRecordParts[part].first;
+	}
 
 	// Sets the background color of the window to black (it will be implicitely used by glClear)
 	glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
 
+	FramePacer::UCreatePacer(gPacer, gPacingMode, gTargetFps);
+	gFrameStart = FramePacer::UNow(gPacer);
+
+	// the render side starts out with what was set up here
+	gViewportWidth = framebufferWidth;
+	gViewportHeight = framebufferHeight;
+	gRenderedShadows = gShadows;
+
+	// hand the GL context to the render thread, from here on the main thread
+	// only builds frame packets
+	if (gUseRenderThread)
+		RenderThread::UStart(gRenderThread, gWindow, [](int slot) { URender(gPackets[slot]); });
+
 	// render loop
 	// -----------
 	while (!glfwWindowShouldClose(gWindow))
 	{
-		// per-frame timing
+		// per-frame timing, measured in double precision
 		// --------------------
-		float currentFrame = glfwGetTime();
-		gDeltaTime = currentFrame - gLastFrame;
-		gLastFrame = currentFrame;
-		// input
+		double frameStart = FramePacer::UNow(gPacer);
+		gSimulationLag += std::min(frameStart - gFrameStart, MAX_FRAME_TIME);
+		gFrameStart = frameStart;
+
+		// input and simulation, as many fixed ticks as the frame took
 		// -----
-		UProcessInput(gWindow);
+		while (gSimulationLag >= SIMULATION_STEP)
+		{
+			gPreviousCamera = gCamera;
+			UProcessInput(gWindow);
+			gSimulationLag -= SIMULATION_STEP;
+			gSimulationTicks++;
+		}
 
-		// Render this frame
-		URender();
+		// Render this frame between the last two ticks. With the render thread
+		// this waits only when every packet is still queued or being drawn
+		gRenderCamera = UInterpolateCamera(gPreviousCamera, gCamera, float(gSimulationLag / SIMULATION_STEP));
+		if (gUseRenderThread)
+		{
+			int slot = RenderThread::UAcquire(gRenderThread);
+			UBuildFramePacket(gPackets[slot]);
+			RenderThread::USubmit(gRenderThread, slot);
+		}
+		else
+		{
+			UBuildFramePacket(gPackets[0]);
+			URender(gPackets[0]);
+		}
+		UReportVisibility();
+		if (gAllocCheckFrames > 0)
+			UCheckAllocations();
 
 		glfwPollEvents();
 	}
 
+	// Draw the packets still queued and take the GL context back, so the
+	// allocation check below counts every frame
+	if (gUseRenderThread)
+		RenderThread::UStop(gRenderThread, gWindow);
+
+	// Count what the steady-state frames allocated
+	bool allocationsFound = false;
+	if (gAllocCheckFrames > 0)
+	{
+		AllocTracker::UCaptureStacks(false);
+		unsigned long long allocations, frees, bytes;
+		AllocTracker::UTotals(allocations, frees, bytes);
+		allocations -= gWarmAllocations;
+		cout << "Allocation check: " << allocations << " heap allocations in " << gAllocCheckFrames - ALLOC_CHECK_WARMUP
+			<< " frames after " << ALLOC_CHECK_WARMUP << " warm-up frames" << endl;
+		if (allocations > 0)
+		{
+			AllocTracker::UPrintStacks(cerr);
+			allocationsFound = true;
+		}
+	}
+
+	if (gUseRenderThread)
+		cout << "Render thread: waited for a free frame packet " << gRenderThread.waits << " times" << endl;
+
+	// Frame times of the last mode
+	FramePacer::UReport(gPacer);
+
 	// Release mesh data
 	//UDestroyMesh(gMesh);
-	meshes.DestroyMeshes();
+	for (auto& meshlets : gMeshlets)
+		Meshlets::UDestroyMeshlets(meshlets.second);
+	gScene.Destroy(gMeshCache);
+	gMeshCache.Clear();
+	UDestroyShaderProgram(gMeshletCullProgramId);
+	HiZ::UDestroyHiZ(gHiZ);
+	DepthPrepass::UDestroyDepthPrepass(gPrepass);
+	Clusters::UDestroyClusters(gClusters);
+	Shadows::UDestroyShadows(gShadowMaps);
+	Deferred::UDestroyDeferred(gDeferred);
+
+	cout << "Stream buffer: " << gStream.bytes << " bytes written, waited for the GPU " << gStream.waits
+		<< " times, " << gStream.failures << " uploads did not fit" << endl;
+	StreamBuffer::UDestroyStreamBuffer(gStream);
+
+	// Scratch memory of the last frame and what the arenas took from the heap
+	size_t packetBytes = 0, packetAllocations = 0;
+	unsigned long long arenaBlocks = gRenderArena.heapBlocks;
+	for (const FramePacket& packet : gPackets)
+	{
+		packetBytes = std::max(packetBytes, packet.arena.peakBytes);
+		packetAllocations = std::max(packetAllocations, packet.arena.lastAllocations);
+		arenaBlocks += packet.arena.heapBlocks;
+	}
+	cout << "Arenas: frame packets peak " << packetBytes << " bytes in " << packetAllocations << " allocations, render peak "
+		<< gRenderArena.peakBytes << " bytes in " << gRenderArena.lastAllocations << " allocations, "
+		<< arenaBlocks << " heap blocks in all" << endl;
+	Arena::UDestroyArena(gRenderArena);
+	for (FramePacket& packet : gPackets)
+		Arena::UDestroyArena(packet.arena);
 
-	UDestroyTexture(gTextureIdCase);
-	UDestroyTexture(gTextureIdLogo);
+	Materials::UDestroyMaterials(gMaterials);
+	IdBuffer::UDestroyIdBuffer(gIdBuffer);
 
 	// Release shader program
 	UDestroyShaderProgram(gProgramId);
 
-	exit(EXIT_SUCCESS); // Terminates the program successfully
+	unsigned long long jobsExecuted, jobsStolen;
+	Jobs::UStats(gJobs, jobsExecuted, jobsStolen);
+	cout << "Jobs: " << Jobs::UThreadCount(gJobs) << " threads, " << jobsExecuted << " jobs run, " << jobsStolen << " stolen" << endl;
+	Jobs::UDestroyScheduler(gJobs);
+
+	exit(allocationsFound ? EXIT_FAILURE : EXIT_SUCCESS); // Terminates the program successfully
 }
 
 
@@ -298,6 +945,17 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
+	// the allocation check runs without showing anything
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--alloc-check") == 0)
+		{
+			gAllocCheckFrames = (i + 1 < argc && isdigit(argv[i + 1][0])) ? strtoull(argv[i + 1], NULL, 10) : 1000;
+			gAllocCheckFrames = std::max(gAllocCheckFrames, ALLOC_CHECK_WARMUP + 1);
+			glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+		}
+	}
+
 	// GLFW: window creation
 	// ---------------------
 	* window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_TITLE, NULL, NULL);
@@ -308,10 +966,12 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 		return false;
 	}
 	glfwMakeContextCurrent(*window);
-	glfwSetFramebufferSizeCallback(*window, UResizeWindow);
+	// no framebuffer size callback: every frame packet reads the size and
+	// URender resizes the viewport and the ID buffer when it changed
 	glfwSetCursorPosCallback(*window, UMousePositionCallback);
 	glfwSetScrollCallback(*window, UMouseScrollCallback);
 	glfwSetMouseButtonCallback(*window, UMouseButtonCallback);
+	glfwSetKeyCallback(*window, UKeyCallback);
 
 	// tell GLFW to capture our mouse
 	glfwSetInputMode(*window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -335,12 +995,6 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 }
 
 
-// glfw: whenever the window size changed (by OS or user resize) this callback function executes
-void UResizeWindow(GLFWwindow* window, int width, int height)
-{
-	glViewport(0, 0, width, height);
-}
-
 // glfw: whenever the mouse moves, this callback is called
 // -------------------------------------------------------
 void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos)
@@ -358,7 +1012,8 @@ void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos)
 	gLastX = xpos;
 	gLastY = ypos;
 
-	gCamera.ProcessMouseMovement(xoffset, yoffset);
+	// applied on the next simulation tick
+	gMouseOffset += glm::vec2(xoffset, yoffset);
 }
 
 
@@ -366,7 +1021,8 @@ void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos)
 // ----------------------------------------------------------------------
 void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 {
-	gCamera.ProcessMouseScroll(yoffset);
+	// applied on the next simulation tick
+	gScrollOffset += float(yoffset);
 }
 
 // glfw: handle mouse button events
@@ -378,7 +1034,26 @@ void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 	case GLFW_MOUSE_BUTTON_LEFT:
 	{
 		if (action == GLFW_PRESS)
+		{
 			cout << "Left mouse button pressed" << endl;
+			if (gPickMode == PICK_ID_BUFFER)
+			{
+				// window coordinates to framebuffer pixels, sent with the next
+				// frame packet. The answer arrives in a later frame
+				double x, y;
+				int width, height, framebufferWidth, framebufferHeight;
+				if (UGetPickPoint(window, x, y))
+				{
+					glfwGetWindowSize(window, &width, &height);
+					glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+					gPickRequested = true;
+					gPickX = GLint(x * framebufferWidth / width);
+					gPickY = GLint(y * framebufferHeight / height);
+				}
+			}
+			else
+				UPickAtCursor(window);
+		}
 		else
 			cout << "Left mouse button released" << endl;
 	}
@@ -408,1581 +1083,797 @@ void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 	}
 }
 
-// Functioned called to render a frame
-void URender()
+// Cast a ray from the camera through the cursor and report the scene node it hits
+void UPickAtCursor(GLFWwindow* window)
 {
-	GLint modelLoc;
-	GLint viewLoc;
-	GLint projLoc;
-	GLint viewPosLoc;
-	GLint ambStrLoc;
-	GLint ambColLoc;
-	GLint light1ColLoc;
-	GLint light1PosLoc;
-	GLint light2ColLoc;
-	GLint light2PosLoc;
-	GLint objColLoc;
-	GLint specInt1Loc;
-	GLint highlghtSz1Loc;
-	GLint specInt2Loc;
-	GLint highlghtSz2Loc;
-	GLint uHasTextureLoc;
-	bool ubHasTextureVal;
-	glm::mat4 scale;
-	glm::mat4 rotation;
-	glm::mat4 rotation1;
-	glm::mat4 rotation2;
-	glm::mat4 translation;
-	glm::mat4 model;
-	glm::mat4 view;
-	glm::mat4 projection;
-	GLint objectColorLoc;
+	double x, y;
+	int width, height;
+	if (!UGetPickPoint(window, x, y))
+		return;
+	glfwGetWindowSize(window, &width, &height);
+
+	// unproject the cursor on the near and far planes of the last frame
+	glm::vec2 ndc(float(2.0 * x / width - 1.0), float(1.0 - 2.0 * y / height));
+	glm::mat4 inverseViewProjection = glm::inverse(gViewProjection);
+	glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndc.x, ndc.y, -1.0f, 1.0f);
+	glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndc.x, ndc.y, 1.0f, 1.0f);
+	glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+	glm::vec3 direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+
+	double start = glfwGetTime();
+	size_t node;
+	float distance;
+	bool hit = gScene.Raycast(origin, direction, node, distance);
+	double elapsed = (glfwGetTime() - start) * 1000000.0;
+
+	if (hit)
+		cout << "Picked " << gScene.Node(node).name << " at distance " << distance;
+	else
+		cout << "Picked nothing";
+	cout << " (" << gScene.Hierarchy().LastVisited() << " BVH nodes, " << elapsed << " us)" << endl;
+}
 
-	// Enable z-depth
-	glEnable(GL_DEPTH_TEST);
 
-	// Clear the frame and z buffers
-	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+// Window coordinates to pick at: the cursor, or the screen center while the
+// cursor is captured for mouse look. False for a minimized window.
+bool UGetPickPoint(GLFWwindow* window, double& x, double& y)
+{
+	int width, height;
+	glfwGetWindowSize(window, &width, &height);
+	if (width <= 0 || height <= 0)
+		return false;
+
+	x = width * 0.5;
+	y = height * 0.5;
+	if (glfwGetInputMode(window, GLFW_CURSOR) != GLFW_CURSOR_DISABLED)
+		glfwGetCursorPos(window, &x, &y);
+	return true;
+}
+
+
+// Report an ID buffer pick once its readback has finished
+void UCollectIdPick()
+{
+	GLuint id;
+	unsigned long long latency;
+	if (!IdBuffer::UPollPick(gIdBuffer, id, latency))
+		return;
+
+	if (id == IdBuffer::NO_OBJECT || id > gScene.Count())
+		cout << "Picked nothing";
+	else
+		cout << "Picked " << gScene.Node(id - 1).name;
+	cout << " (ID buffer, " << latency << " frames later)" << endl;
+}
+
+
+// Describe the frame to draw: the camera, the frustum culled nodes with their
+// materials and the current settings. Runs on the main thread
+void UBuildFramePacket(FramePacket& packet)
+{
+	if (Arena::UReset(packet.arena) && gBuiltFrames > ARENA_WARMUP_FRAMES)
+		cerr << "Frame packet arena grew to " << packet.arena.capacity << " bytes after warm-up" << endl;
+	gBuiltFrames++;
+
+	glfwGetFramebufferSize(gWindow, &packet.framebufferWidth, &packet.framebufferHeight);
 
 	// Transforms the camera
-	view = gCamera.GetViewMatrix();
+	packet.view = gRenderCamera.GetViewMatrix();
 
 	if (orthoViewToggle)
 	{
-		projection = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, 0.1f, 100.0f);
+		packet.projection = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, NEAR_PLANE, FAR_PLANE);
 	}
-	else 
+	else
 	{
-		projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+		packet.projection = glm::perspective(glm::radians(gRenderCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, NEAR_PLANE, FAR_PLANE);
 	}
+	packet.viewProjection = packet.projection * packet.view;
+	packet.cameraPosition = gRenderCamera.Position;
+	packet.cameraFront = gRenderCamera.Front;
+	packet.ortho = orthoViewToggle;
+	gViewProjection = packet.viewProjection;
+
+	// Cull the scene against the camera, planes in world space, and record
+	// the draws of what is left
+	Frustum frustum(packet.viewProjection);
+	if (gRecordParts.size() > 1)
+	{
+		RecordContext record = { &frustum, &packet.arena };
+		CommandList::URecordParallel(gJobs, gRecordLists, URecordPart, &record);
+		CommandList::UMerge(gRecordLists, packet.commands);
 
-	// Set the shader to be used
-	glUseProgram(gProgramId);
-
-	// Retrieves and passes transform matrices to the Shader program
-	modelLoc = glGetUniformLocation(gProgramId, "model");
-	viewLoc = glGetUniformLocation(gProgramId, "view");
-	projLoc = glGetUniformLocation(gProgramId, "projection");
-	viewPosLoc = glGetUniformLocation(gProgramId, "viewPosition");
-	ambStrLoc = glGetUniformLocation(gProgramId, "ambientStrength");
-	ambColLoc = glGetUniformLocation(gProgramId, "ambientColor");
-	light1ColLoc = glGetUniformLocation(gProgramId, "light1Color");
-	light1PosLoc = glGetUniformLocation(gProgramId, "light1Position");
-	light2ColLoc = glGetUniformLocation(gProgramId, "light2Color");
-	light2PosLoc = glGetUniformLocation(gProgramId, "light2Position");
-	objColLoc = glGetUniformLocation(gProgramId, "objectColor");
-	specInt1Loc = glGetUniformLocation(gProgramId, "specularIntensity1");
-	highlghtSz1Loc = glGetUniformLocation(gProgramId, "highlightSize1");
-	specInt2Loc = glGetUniformLocation(gProgramId, "specularIntensity2");
-	highlghtSz2Loc = glGetUniformLocation(gProgramId, "highlightSize2");
-	uHasTextureLoc = glGetUniformLocation(gProgramId, "ubHasTexture");
-	objectColorLoc = glGetUniformLocation(gProgramId, "objectColor");
-
-	glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-	glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+		gVisibleCount = 0;
+		for (const RecordPart& part : gRecordParts)
+			gVisibleCount += part.visibleCount;
+	}
+	else
+	{
+		gVisibleCount = gScene.Cull(frustum);
 
-	//set the camera view location
-	glUniform3f(viewPosLoc, gCamera.Position.x, gCamera.Position.y, gCamera.Position.z);
-	//set ambient lighting strength
-	glUniform1f(ambStrLoc, 0.9f);
-	//set ambient color
-	glUniform3f(ambColLoc, 0.2f, 0.2f, 0.2f);
-	glUniform3f(light1ColLoc, 0.2f, 0.2f, 0.2f);
-	glUniform3f(light1PosLoc, 2.0f, 5.0f, 5.0f);
-	glUniform3f(light2ColLoc, 0.2f, 0.2f, 0.2f);
-	glUniform3f(light2PosLoc, -2.0f, 5.0f, 5.0f);
+		CommandList::UReset(packet.commands);
+		for (size_t i = 0; i < gScene.Count(); i++)
+		{
+			if (gScene.IsVisible(i))
+				URecordNode(packet.commands, i);
+		}
+	}
 
-	//set specular intensity
-	glUniform1f(specInt1Loc, 0.1f);
-	glUniform1f(specInt2Loc, 0.0f);
-	//set specular highlight size
-	glUniform1f(highlghtSz1Loc, 0.3f);
-	glUniform1f(highlghtSz2Loc, 0.3f);
+	packet.shading = gShadingMode;
+	packet.occlusion = gOcclusionMode;
+	packet.meshlets = gMeshletMode;
+	packet.picking = gPickMode;
+	packet.lighting = gLightingMode;
+	packet.depthPrepass = gDepthPrepass;
+	packet.overdrawStats = gOverdrawStats;
+	packet.shadows = gShadows;
+	packet.pacing = gPacingMode;
+	packet.reportPacing = gReportPacing;
+	gReportPacing = false;
+
+	packet.pickRequested = gPickRequested;
+	packet.pickX = gPickX;
+	packet.pickY = gPickY;
+	gPickRequested = false;
+}
 
-	ubHasTextureVal = true;
-	glUniform1i(uHasTextureLoc, ubHasTextureVal);
 
+// Record the draw of one scene node
+void URecordNode(CommandList::List& list, size_t index)
+{
+	const Entities::Archetype& nodes = gScene.Nodes();
+	const Meshes::GLMesh& mesh = *nodes.meshes[index].mesh;
+
+	CommandList::DrawData data;
+	data.model = nodes.models[index];
+	data.material = nodes.materials[index].id;
+	data.object = std::uint32_t(index);
+
+	CommandList::UBindPipeline(list, gMaterials.materials[data.material].variant);
+	CommandList::UBindGeometry(list, mesh);
+	CommandList::USetDrawData(list, data);
+	CommandList::UDraw(list, 0, mesh.nIndices);
+}
 
-	///-------Transform and draw background plane --------
 
-	glBindVertexArray(meshes.gPlaneMesh.vao);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gTextureIdCase);
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(50.0f, 50.0f, 50.0f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(0.5f, 1.0f, 0.f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-1.5f, 0.4f, 3.0f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.3f, 0.5f, 0.30f, 1.0f);
+// Cull one run of scene nodes against the frustum of the RecordContext and
+// record the visible ones, on a worker thread. Only reads the scene
+void URecordPart(void* context, size_t part, CommandList::List& list)
+{
+	const RecordContext& record = *static_cast<const RecordContext*>(context);
+	RecordPart& run = gRecordParts[part];
+	run.visible = Arena::UAllocateArray<unsigned char>(*record.arena, run.count);
+	run.visibleCount = gScene.Cull(*record.frustum, run.first, run.count, run.visible);
 
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gPlaneMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+	for (size_t i = 0; i < run.count; i++)
+	{
+		if (run.visible[i])
+			URecordNode(list, run.first + i);
+	}
+}
 
-	///-------Transform and draw the apple logo--------
 
-	glBindVertexArray(meshes.gPlaneMesh.vao);
+// Called after every frame of --alloc-check: start counting after the
+// warm-up and close the window after the last frame
+void UCheckAllocations()
+{
+	if (gBuiltFrames == ALLOC_CHECK_WARMUP)
+	{
+		unsigned long long frees, bytes;
+		AllocTracker::UTotals(gWarmAllocations, frees, bytes);
+		AllocTracker::UCaptureStacks(true);
+	}
+	if (gBuiltFrames >= gAllocCheckFrames)
+		glfwSetWindowShouldClose(gWindow, true);
+}
 
-	ubHasTextureVal = true;
-	glUniform1i(uHasTextureLoc, ubHasTextureVal);
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gTextureIdCase);
+///////////////////////////////////////////////////
+//	UCheckJobs(int)
+//
+//	A scheduler of its own, gJobs is not started yet.
+//	Every round queues MAX_JOBS * 3 + 1 jobs of one
+//	index from the main thread before waiting, so
+//	the pool wraps around while jobs are queued
+///////////////////////////////////////////////////
+bool UCheckJobs(int threadCount)
+{
+	const size_t jobCount = Jobs::MAX_JOBS * 3 + 1;
+	const int rounds = 8;
+
+	Jobs::Scheduler scheduler;
+	Jobs::UCreateScheduler(scheduler, threadCount);
+	std::vector<std::atomic<int>> runs(jobCount);
+	size_t wrong = 0;
+	for (int round = 0; round < rounds; round++)
+	{
+		for (auto& run : runs)
+			run = 0;
 
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		Jobs::Counter counter;
+		for (size_t i = 0; i < jobCount; i++)
+		{
+			Jobs::URun(scheduler, [](void* context, size_t first, size_t count)
+			{
+				std::atomic<int>* runs = static_cast<std::atomic<int>*>(context);
+				for (size_t j = first; j < first + count; j++)
+					runs[j]++;
+			}, runs.data(), i, 1, counter);
+		}
+		Jobs::UWait(scheduler, counter);
 
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(50.0f, 50.0f, 50.0f));
+		for (const auto& run : runs)
+			wrong += run != 1;
+	}
+	int threads = Jobs::UThreadCount(scheduler);
+	Jobs::UDestroyScheduler(scheduler);
 
-	// 2. Rotate the object 90 degrees around the X-axis to make it stand vertical
-	rotation = glm::rotate(glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f)); // Rotating around X-axis
+	cout << "Jobs check: " << rounds << " rounds of " << jobCount << " jobs on " << threads << " threads, "
+		<< wrong << " jobs skipped or run twice" << endl;
+	return wrong == 0;
+}
 
-	// 3. Position the object - adjust as necessary after rotation
-	translation = glm::translate(glm::vec3(0.0f, 0.0f, -10.0f));
 
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+// Catch up with what changed since the last packet and needs the GL context
+// or state only the render side touches
+void UApplyPacketSettings(const FramePacket& packet)
+{
+	if (packet.framebufferWidth != gViewportWidth || packet.framebufferHeight != gViewportHeight)
+	{
+		gViewportWidth = packet.framebufferWidth;
+		gViewportHeight = packet.framebufferHeight;
+		glViewport(0, 0, gViewportWidth, gViewportHeight);
+		if (gViewportWidth > 0 && gViewportHeight > 0)
+			IdBuffer::UResizeIdBuffer(gIdBuffer, gViewportWidth, gViewportHeight);
+	}
 
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 1); // Enable texturing 
+	if (packet.reportPacing)
+		FramePacer::UReport(gPacer);
+	if (packet.pacing != gPacer.mode)
+		FramePacer::USetMode(gPacer, packet.pacing, gTargetFps);
 
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gPlaneMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+	if (packet.occlusion != gRenderedOcclusionMode)
+	{
+		gRenderedOcclusionMode = packet.occlusion;
+		HiZ::UInvalidate(gHiZ);
+	}
 
-	// Deactivate the Vertex A
+	if (packet.overdrawStats && !gRenderedOverdrawStats)
+		gLastOverdrawReport = glfwGetTime() - 1.0; // report right away
+	gRenderedOverdrawStats = packet.overdrawStats;
 
-	// turn off texture application
-	ubHasTextureVal = false; // Set to false for non-textured objects
-	glUniform1i(uHasTextureLoc, ubHasTextureVal);
+	if (packet.shadows != gRenderedShadows)
+	{
+		gRenderedShadows = packet.shadows;
+		if (packet.shadows)
+			cout << "Shadows: " << Shadows::CASCADE_COUNT << " cascades per light, " << gShadowMaps.cascadesDrawn << " cascades drawn so far" << endl;
+		else
+			cout << "Shadows: off, " << gShadowMaps.cascadesDrawn << " cascades drawn so far" << endl;
+	}
 
+	if (packet.pickRequested)
+		IdBuffer::URequestPick(gIdBuffer, packet.pickX, packet.pickY);
+}
 
-	///-------Transform and draw the main computer body --------
 
+// Functioned called to render a frame, on the render thread when there is one
+void URender(const FramePacket& packet)
+{
+	if (Arena::UReset(gRenderArena) && gRenderedFrames > ARENA_WARMUP_FRAMES)
+		cerr << "Render arena grew to " << gRenderArena.capacity << " bytes after warm-up" << endl;
+	gRenderedFrames++;
 
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	GLint modelLoc;
+	GLint viewLoc;
+	GLint projLoc;
+	GLint viewPosLoc;
+	GLint ambStrLoc;
+	GLint ambColLoc;
+	GLint light1ColLoc;
+	GLint light1PosLoc;
+	GLint light2ColLoc;
+	GLint light2PosLoc;
+	GLint specInt1Loc;
+	GLint highlghtSz1Loc;
+	GLint specInt2Loc;
+	GLint highlghtSz2Loc;
+	const glm::mat4& view = packet.view;
+	const glm::mat4& projection = packet.projection;
+	GLint materialLoc;
 
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(5.0f, 5.0f, 5.0f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(0.0f, 3.0f, 0.0f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.9f, 0.9f, 0.7f, 1.0f);
+	FramePacer::UBeginFrame(gPacer);
+	UApplyPacketSettings(packet);
 
+	// Collect object IDs, depth pyramids and statistics read back during earlier frames
+	UCollectIdPick();
+	if (packet.occlusion == OCCLUSION_GPU)
+		HiZ::UPoll(gHiZ);
+	UReportOverdraw(packet);
 
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+	// Enable z-depth
+	glEnable(GL_DEPTH_TEST);
 
+	// Clear the frame and z buffers
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	if (packet.picking == PICK_ID_BUFFER)
+		IdBuffer::UBeginFrame(gIdBuffer, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+	else
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+	// Forward shading lights the surfaces as they are drawn, deferred
+	// shading writes them to the G-buffer and lights that afterwards
+	bool deferred = packet.shading == SHADING_DEFERRED;
+	GLuint surfaceProgramId = deferred ? gDeferred.geometryProgram : gProgramId;
+	GLuint lightingProgramId = deferred ? gDeferred.lightingProgram : gProgramId;
+	if (surfaceProgramId != gSurfaceProgramId)
+		ULocateSurfaceUniforms(surfaceProgramId);
 
-	///-------Transform and draw the monitor screen --------
+	// Set the shader to be used
+	glUseProgram(surfaceProgramId);
 
-	// Activate the VBOs contained within the mesh's VAO
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(4.0f, 2.5f, 0.2f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(0.0f, 3.5f, 2.5f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+	// Retrieves and passes transform matrices to the Shader program
+	modelLoc = glGetUniformLocation(surfaceProgramId, "model");
+	viewLoc = glGetUniformLocation(surfaceProgramId, "view");
+	projLoc = glGetUniformLocation(surfaceProgramId, "projection");
+	viewPosLoc = glGetUniformLocation(lightingProgramId, "viewPosition");
+	ambStrLoc = glGetUniformLocation(lightingProgramId, "ambientStrength");
+	ambColLoc = glGetUniformLocation(lightingProgramId, "ambientColor");
+	light1ColLoc = glGetUniformLocation(lightingProgramId, "light1Color");
+	light1PosLoc = glGetUniformLocation(lightingProgramId, "light1Position");
+	light2ColLoc = glGetUniformLocation(lightingProgramId, "light2Color");
+	light2PosLoc = glGetUniformLocation(lightingProgramId, "light2Position");
+	specInt1Loc = glGetUniformLocation(lightingProgramId, "specularIntensity1");
+	highlghtSz1Loc = glGetUniformLocation(lightingProgramId, "highlightSize1");
+	specInt2Loc = glGetUniformLocation(lightingProgramId, "specularIntensity2");
+	highlghtSz2Loc = glGetUniformLocation(lightingProgramId, "highlightSize2");
+	materialLoc = glGetUniformLocation(surfaceProgramId, "materialIndex");
 
-	glProgramUniform4f(gProgramId, objectColorLoc, 0.0f, 0.22f, 0.0f, 1.0f);
+	glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+	glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
 
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Disable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.0f, 0.2f, 0.0f, 1.0f);
+	// the lighting uniforms go to the program that does the lighting
+	glUseProgram(lightingProgramId);
+	if (deferred)
+		glUniformMatrix4fv(glGetUniformLocation(lightingProgramId, "view"), 1, GL_FALSE, glm::value_ptr(view));
 
+	//set the camera view location
+	glUniform3f(viewPosLoc, packet.cameraPosition.x, packet.cameraPosition.y, packet.cameraPosition.z);
+	//set ambient lighting strength
+	glUniform1f(ambStrLoc, 0.9f);
+	//set ambient color
+	glUniform3f(ambColLoc, 0.2f, 0.2f, 0.2f);
+	glUniform3f(light1ColLoc, 0.2f, 0.2f, 0.2f);
+	glUniform3fv(light1PosLoc, 1, glm::value_ptr(LIGHT_POSITIONS[0]));
+	glUniform3f(light2ColLoc, 0.2f, 0.2f, 0.2f);
+	glUniform3fv(light2PosLoc, 1, glm::value_ptr(LIGHT_POSITIONS[1]));
 
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+	//set specular intensity
+	glUniform1f(specInt1Loc, 0.1f);
+	glUniform1f(specInt2Loc, 0.0f);
+	//set specular highlight size
+	glUniform1f(highlghtSz1Loc, 0.3f);
+	glUniform1f(highlghtSz2Loc, 0.3f);
 
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
-	///-------Transform and draw the monitor screen depth top--------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(5.0f, 0.5f, 0.5f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(0.0f, 5.0f, 2.5f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Disable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.9f, 0.9f, 0.7f, 1.0f);
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
+	// Bring the shadow maps up to date, this culls the scene for the lights
+	if (packet.shadows)
+		Shadows::UUpdate(gShadowMaps, gScene, LIGHT_POSITIONS, LIGHT_TARGET, view, projection, NEAR_PLANE);
 
-	///-------Transform and draw the monitor screen depth right--------
+	// Skip the draws hidden behind what was drawn last frame
+	size_t occludedCount = 0;
+	unsigned char* occluded = Arena::UAllocateArray<unsigned char>(gRenderArena, gScene.Count());
+	if (packet.occlusion != OCCLUSION_OFF)
+	{
+		for (const CommandList::DrawData& data : packet.commands.drawData)
+		{
+			if (HiZ::UIsBoxOccluded(gHiZ, gScene.BoundsCenter(data.object), gScene.BoundsExtent(data.object)))
+			{
+				occluded[data.object] = 1;
+				occludedCount++;
+			}
+		}
+	}
+	gOccludedCount = occludedCount;
 
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.5f, 2.5f, 0.5f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	//translation = glm::translate(glm::vec3(1.75f, 3.3f, 4.3f));
-	translation = glm::translate(glm::vec3(2.25f, 3.5f, 2.5f));
+	ReplayState replay;
+	replay.packet = &packet;
+	replay.data = NULL;
+	replay.occluded = occluded;
 
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+	// Deferred shading draws everything below into the G-buffer
+	if (deferred)
+		Deferred::UBeginGeometryPass(gDeferred, packet.framebufferWidth, packet.framebufferHeight, packet.picking == PICK_ID_BUFFER ? gIdBuffer.idTexture : 0);
 
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Disable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.9f, 0.9f, 0.7f, 1.0f);
+	// Lay down depth first so the lighting runs once per pixel
+	if (packet.depthPrepass)
+	{
+		DepthPrepass::UBeginDepthPass(gPrepass, view, projection);
+		CommandList::Backend depthBackend = { &replay, [](void*, std::uint32_t) {}, [](void*, const Meshes::GLMesh&) {},
+			[](void* context, const CommandList::DrawData& data) { static_cast<ReplayState*>(context)->data = &data; }, UReplayDrawDepth };
+		CommandList::UReplay(packet.commands, depthBackend);
+	}
+	// Assign the point lights to clusters for this camera
+	if (packet.lighting == LIGHTS_CPU)
+		Clusters::UBuildCPU(gClusters, gJobs, gStream, view, projection, NEAR_PLANE, FAR_PLANE);
+	else if (packet.lighting == LIGHTS_GPU)
+		Clusters::UBuildGPU(gClusters, view, projection, NEAR_PLANE, FAR_PLANE);
+
+	DepthPrepass::UBeginShadingPass(gPrepass, packet.depthPrepass);
+	glUseProgram(lightingProgramId);
+
+	glUniform1i(glGetUniformLocation(lightingProgramId, "clusteredLighting"), packet.lighting != LIGHTS_OFF);
+	glUniform1i(glGetUniformLocation(lightingProgramId, "shadowsEnabled"), packet.shadows);
+	if (packet.shadows)
+		Shadows::UBind(gShadowMaps, lightingProgramId);
+	if (packet.lighting != LIGHTS_OFF)
+		Clusters::UBind(gClusters, lightingProgramId, packet.framebufferWidth, packet.framebufferHeight);
+	glUseProgram(surfaceProgramId);
+
+	// every surface is opaque, blending only matters for textures with alpha.
+	// The G-buffer keeps the specular strength in alpha, so no blending there
+	if (deferred)
+		glDisable(GL_BLEND);
+	else
+		glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	Materials::UBind(gMaterials);
 
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+	// Replay the draws of the packet, the mesh is only rebound when it changes
+	replay.programIds[Materials::VARIANT_SURFACE] = surfaceProgramId;
+	replay.modelLoc = modelLoc;
+	replay.materialLoc = materialLoc;
+	CommandList::Backend shadingBackend = { &replay, UReplayBindPipeline, UReplayBindGeometry, UReplaySetDrawData, UReplayDraw };
+	CommandList::UReplay(packet.commands, shadingBackend);
+	DepthPrepass::UEndShadingPass(gPrepass);
 
-	// Deactivate the Vertex Array Object
+	//clear vertex array
 	glBindVertexArray(0);
 
+	// Light every pixel of the G-buffer once
+	if (deferred)
+	{
+		glUseProgram(lightingProgramId);
+		Deferred::ULightingPass(gDeferred, packet.viewProjection, packet.overdrawStats);
+	}
 
-	///-------Transform and draw the monitor screen depth left--------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.5f, 2.5f, 0.5f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	//translation = glm::translate(glm::vec3(1.75f, 3.3f, 4.3f));
-	translation = glm::translate(glm::vec3(-2.25f, 3.5f, 2.5f));
-
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+	// reduce this frame's depth for next frame's occlusion test
+	if (packet.occlusion == OCCLUSION_GPU)
+		HiZ::UCaptureGPU(gHiZ, packet.viewProjection, packet.framebufferWidth, packet.framebufferHeight);
+	else if (packet.occlusion == OCCLUSION_CPU)
+		HiZ::UCaptureCPU(gHiZ, packet.viewProjection, packet.framebufferWidth, packet.framebufferHeight);
 
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Disable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.9f, 0.9f, 0.7f, 1.0f);
+	// read back a requested object ID and show the offscreen image
+	if (packet.picking == PICK_ID_BUFFER)
+		IdBuffer::UEndFrame(gIdBuffer);
 
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+	// the stream buffer memory written this frame is reused once this passes
+	StreamBuffer::UEndFrame(gStream);
 
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
+	// hold the frame back when pacing to a fixed rate
+	FramePacer::UWaitForDeadline(gPacer);
 
-	///-------Transform and draw the monitor screen depth top--------
+	// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+	glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+}
 
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(5.0f, 1.0f, 0.5f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(0.0f, 1.75f, 2.5f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
 
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Disable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.9f, 0.9f, 0.7f, 1.0f);
+// Replay callbacks of URender, context is its ReplayState
+void UReplayBindPipeline(void* context, std::uint32_t pipeline)
+{
+	glUseProgram(static_cast<ReplayState*>(context)->programIds[pipeline]);
+}
 
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
 
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
+void UReplayBindGeometry(void*, const Meshes::GLMesh& mesh)
+{
+	UBindMesh(mesh);
+}
 
-	///-------Transform and draw the monitor slot--------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(1.5f, 0.1f, 1.0f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(1.25f, 1.75f, 2.3f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Disable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.0f, 0.0f, 0.0f, 1.0f);
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
 
-	///-------Transform and draw the secondary monitor slot--------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.5f, 0.25f, 1.0f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(1.75f, 1.75f, 2.3f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Disable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.0f, 0.0f, 0.0f, 1.0f);
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
+void UReplaySetDrawData(void* context, const CommandList::DrawData& data)
+{
+	ReplayState& replay = *static_cast<ReplayState*>(context);
+	replay.data = &data;
 
-	///-------Transform and draw the apple logo--------
+	// the material buffer and texture array hold the rest
+	glUniform1ui(replay.materialLoc, data.material);
+	glUniformMatrix4fv(replay.modelLoc, 1, GL_FALSE, glm::value_ptr(data.model));
+	glUniform1ui(gObjectIdLoc, data.object + 1); // IDs start at 1, 0 is the background
+}
 
-	glBindVertexArray(meshes.gPlaneMesh.vao);
 
-	ubHasTextureVal = true;
-	glUniform1i(uHasTextureLoc, ubHasTextureVal);
+void UReplayDraw(void* context, const Meshes::GLMesh& mesh, CommandList::Range range)
+{
+	ReplayState& replay = *static_cast<ReplayState*>(context);
+	if (!replay.data || replay.occluded[replay.data->object])
+		return;
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gTextureIdLogo);
+	// Draws the triangles, whole meshes may go through the meshlets
+	if (range.firstIndex == 0 && range.indexCount == mesh.nIndices)
+		UDrawMesh(mesh, replay.data->model, *replay.packet);
+	else
+		glDrawElements(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, (void*)(range.firstIndex * sizeof(GLuint)));
+}
 
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.2f, 0.2f, 0.2f));
+void UReplayDrawDepth(void* context, const Meshes::GLMesh& mesh, CommandList::Range)
+{
+	ReplayState& replay = *static_cast<ReplayState*>(context);
+	if (!replay.data || replay.occluded[replay.data->object])
+		return;
 
-	// 2. Rotate the object 90 degrees around the X-axis to make it stand vertical
-	rotation = glm::rotate(glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f)); // Rotating around X-axis
+	DepthPrepass::UDrawDepth(gPrepass, mesh, replay.data->model);
+}
 
-	// 3. Position the object - adjust as necessary after rotation
-	translation = glm::translate(glm::vec3(-1.75f, 1.58f, 2.76f));
 
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+// Look up the per mesh and per draw uniforms of the program drawing the surfaces
+void ULocateSurfaceUniforms(GLuint programId)
+{
+	gSurfaceProgramId = programId;
+	gPositionOffsetLoc = glGetUniformLocation(programId, "positionOffset");
+	gPositionScaleLoc = glGetUniformLocation(programId, "positionScale");
+	gUVOffsetLoc = glGetUniformLocation(programId, "uvOffset");
+	gUVScaleLoc = glGetUniformLocation(programId, "uvScale");
+	gObjectIdLoc = glGetUniformLocation(programId, "objectId");
+}
 
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 1); // Enable texturing 
 
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gPlaneMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+// Activate a mesh's VAO and pass its dequantization parameters to the shader
+void UBindMesh(const Meshes::GLMesh& mesh)
+{
+	glBindVertexArray(mesh.vao);
 
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
+	glUniform3fv(gPositionOffsetLoc, 1, glm::value_ptr(mesh.positionOffset));
+	glUniform3fv(gPositionScaleLoc, 1, glm::value_ptr(mesh.positionScale));
+	glUniform2fv(gUVOffsetLoc, 1, glm::value_ptr(mesh.uvOffset));
+	glUniform2fv(gUVScaleLoc, 1, glm::value_ptr(mesh.uvScale));
+}
 
-	// turn off texture application
-	ubHasTextureVal = false; // Set to false for non-textured objects
-	glUniform1i(uHasTextureLoc, ubHasTextureVal);
 
-	///-------Transform and draw the main keyboard body --------
+// Draw an indexed mesh that is already bound with UBindMesh. With meshlets
+// enabled the clusters are culled against the camera first and only the
+// survivors are drawn through an indirect draw list.
+void UDrawMesh(const Meshes::GLMesh& mesh, const glm::mat4& model, const FramePacket& packet)
+{
+	Meshlets::GLMeshlets* meshlets = NULL;
+	auto found = gMeshlets.find(&mesh);
+	if (found != gMeshlets.end())
+		meshlets = &found->second;
 
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	if (packet.meshlets == MESHLETS_OFF || meshlets == NULL || meshlets->meshlets.empty())
+	{
+		glDrawElements(GL_TRIANGLES, mesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+		return;
+	}
 
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(5.25f, 0.5f, 2.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(0.15f, 0.7f, 5.75f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.9f, 0.9f, 0.7f, 1.0f);
+	// cull in model space: planes of clip * model, camera moved into the model
+	Frustum frustum(packet.viewProjection * model);
+	glm::mat4 modelInverse = glm::inverse(model);
+	glm::vec4 eye;
+	if (packet.ortho)
+		eye = glm::vec4(glm::normalize(glm::vec3(modelInverse * glm::vec4(packet.cameraFront, 0.0f))), 0.0f);
+	else
+		eye = modelInverse * glm::vec4(packet.cameraPosition, 1.0f);
 
+	if (packet.meshlets == MESHLETS_CPU)
+	{
+		StreamBuffer::Allocation commands;
+		GLuint visible = Meshlets::UCullMeshlets(*meshlets, gStream, frustum, eye, commands);
+		Meshlets::UDrawMeshlets(commands, visible);
+	}
+	else
+	{
+		Meshlets::UCullMeshletsGPU(*meshlets, gMeshletCullProgramId, frustum, eye);
+		Meshlets::UDrawMeshlets(*meshlets, GLuint(meshlets->meshlets.size()));
+	}
+}
 
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
 
-	glBindVertexArray(0);
+// Show how many scene nodes were drawn, frustum culled and occluded in the window title.
+// The occluded count may be a frame behind while the render thread catches up
+void UReportVisibility()
+{
+	size_t occludedCount = std::min(gOccludedCount.load(), gVisibleCount);
+	char title[sizeof(gTitle)];
+	snprintf(title, sizeof(title), "%s - %zu drawn, %zu culled, %zu occluded", WINDOW_TITLE,
+		gVisibleCount - occludedCount, gScene.Count() - gVisibleCount, occludedCount);
+	if (strcmp(title, gTitle) == 0)
+		return;
+	strcpy(gTitle, title);
+	glfwSetWindowTitle(gWindow, title);
+}
 
-	///-------Transform and draw the ~ Key --------
 
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
+// Scatter colored point lights over the desk as light entities of the scene,
+// always the same ones so runs compare
+void UCreatePointLights(size_t count)
+{
+	unsigned int seed = 12345u;
+	auto random = [&seed]()
+	{
+		seed = seed * 1664525u + 1013904223u;
+		return float(seed >> 8) / 16777216.0f;
+	};
 
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-2.0f, 1.0f, 5.15f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
+	const Entities::Mask lightComponents = Entities::COMPONENT_TRANSFORM | Entities::COMPONENT_LIGHT;
+	Entities::World& world = gScene.World();
+	Entities::UReserve(world, lightComponents, count);
+	for (size_t i = 0; i < count; i++)
+	{
+		glm::vec3 position(-8.0f + 16.0f * random(), 0.5f + 7.0f * random(), -2.0f + 12.0f * random());
+		Entities::Light light;
+		light.radius = 1.0f + 2.0f * random();
+		glm::vec3 color(random(), random(), random());
+		light.color = 0.5f * color / std::max(std::max(color.x, color.y), std::max(color.z, 1e-3f));
+
+		Entities::Entity entity = Entities::UCreate(world, lightComponents);
+		Entities::USetTransform(world, entity, position, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f));
+		Entities::USetLight(world, entity, light);
+	}
+	UUploadPointLights();
+}
 
 
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-
-	///-------Transform and draw the Tab Key --------
+// Gather every entity with a transform and a light into the light buffer
+void UUploadPointLights()
+{
+	const Entities::Mask lightComponents = Entities::COMPONENT_TRANSFORM | Entities::COMPONENT_LIGHT;
+	std::vector<Clusters::PointLight> lights;
+	for (const Entities::Archetype& archetype : gScene.World().archetypes)
+	{
+		if (!Entities::UHas(archetype, lightComponents))
+			continue;
 
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
+		const Transforms::Arrays& transforms = archetype.transforms;
+		for (size_t row = 0; row < archetype.count; row++)
+		{
+			Clusters::PointLight light;
+			light.position = glm::vec3(transforms.positionX[row], transforms.positionY[row], transforms.positionZ[row]);
+			light.radius = archetype.lights[row].radius;
+			light.color = archetype.lights[row].color;
+			light.padding = 0.0f;
+			lights.push_back(light);
+		}
+	}
+	Clusters::USetLights(gClusters, lights.data(), lights.size());
+}
 
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.375f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-1.94f, 1.0f, 5.5f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the Caps keyboard body --------
 
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
+// Print the overdraw statistics once a second while they are enabled
+void UReportOverdraw(const FramePacket& packet)
+{
+	DepthPrepass::Stats stats;
+	if (!DepthPrepass::UPollStats(gPrepass, stats) || !packet.overdrawStats)
+		return;
+
+	double now = glfwGetTime();
+	if (now - gLastOverdrawReport < 1.0)
+		return;
+	gLastOverdrawReport = now;
+
+	double pixels = double(packet.framebufferWidth) * packet.framebufferHeight;
+	cout << "Overdraw (pre-pass " << (stats.prepass ? "on" : "off") << "): "
+		<< stats.shadedSamples / pixels << " shaded fragments per pixel, depth pass "
+		<< stats.depthPassMs << " ms, shading pass " << stats.shadingPassMs << " ms";
+
+	// with deferred shading the shading pass only fills the G-buffer
+	double lightingPassMs = 0.0;
+	if (packet.shading == SHADING_DEFERRED && Deferred::UPollLightingTime(gDeferred, lightingPassMs))
+		cout << ", lighting pass " << lightingPassMs << " ms";
+	cout << endl;
+}
 
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.7f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-1.78f, 1.0f, 5.85));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the Shift keyboard body --------
 
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
+// glfw: whenever a key is pressed this callback is called (one shot toggles)
+// -------------------------------------------------------
+void UKeyCallback(GLFWwindow*, int key, int, int action, int)
+{
+	if (action != GLFW_PRESS)
+		return;
 
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.75f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-1.75f, 1.0f, 6.2f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the 1 Key --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	switch (key)
+	{
+	case GLFW_KEY_M:
+		gMeshletMode = MeshletMode((gMeshletMode + 1) % 3);
+		if (gMeshletMode == MESHLETS_OFF)
+			cout << "Meshlets: off" << endl;
+		else if (gMeshletMode == MESHLETS_CPU)
+			cout << "Meshlets: CPU culling" << endl;
+		else
+			cout << "Meshlets: GPU culling" << endl;
+		break;
 
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-1.65f, 1.0f, 5.15f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the 2 Key --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-1.30f, 1.0f, 5.15f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the 2 Key --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-0.95f, 1.0f, 5.15f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the 3 Key --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-0.60f, 1.0f, 5.15f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the 4 Key --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-0.25f, 1.0f, 5.15f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-
-	///-------Transform and draw the 5 Key --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(0.1f, 1.0f, 5.15f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-
-	///-------Transform and draw the 6 Key --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(0.45f, 1.0f, 5.15f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the 6 Key --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(0.80f, 1.0f, 5.15f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-	
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-
-	///-------Transform and draw the 7 Key --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(1.15f, 1.0f, 5.15f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the 8 Key --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(1.5f, 1.0f, 5.15f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the 9 Key --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(1.85f, 1.0f, 5.15f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the backspace Key --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.375f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(2.15f, 1.0f, 5.15f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the q Key --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-1.55f, 1.0f, 5.5f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the w Key --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-1.25f, 1.0f, 5.5f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the w Key --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-.9f, 1.0f, 5.5f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the e Key --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-.55f, 1.0f, 5.5f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the r Key --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-.20f, 1.0f, 5.5f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the r Key --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(.15f, 1.0f, 5.5f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-	
-	///-------Transform and draw the T Key --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(.5f, 1.0f, 5.5f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-	glBindVertexArray(0);
+	case GLFW_KEY_I:
+		gPickMode = (gPickMode == PICK_RAYCAST) ? PICK_ID_BUFFER : PICK_RAYCAST;
+		if (gPickMode == PICK_ID_BUFFER)
+			cout << "Picking: ID buffer" << endl;
+		else
+			cout << "Picking: raycast" << endl;
+		break;
 
-	///-------Transform and draw the Y Key --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(.85f, 1.0f, 5.5f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the U Key --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(1.2f, 1.0f, 5.5f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-	///-------Transform and draw the I Key --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(1.55f, 1.0f, 5.5f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the O Key --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(1.9f, 1.0f, 5.5f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the O Key --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(2.25f, 1.0f, 5.5f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-
-	///-------Transform and draw the A keyboard body --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.5f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-1.52f, 1.0f, 5.85));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	///-------Transform and draw the S keyboard body --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-1.17f, 1.0f, 5.85));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the D keyboard body --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-0.82f, 1.0f, 5.85));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the F keyboard body --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-0.82f, 1.0f, 5.85));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the G keyboard body --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-0.47f, 1.0f, 5.85));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
+	case GLFW_KEY_H:
+		gOcclusionMode = OcclusionMode((gOcclusionMode + 1) % 3);
+		if (gOcclusionMode == OCCLUSION_OFF)
+			cout << "Occlusion culling: off" << endl;
+		else if (gOcclusionMode == OCCLUSION_GPU)
+			cout << "Occlusion culling: GPU depth pyramid" << endl;
+		else
+			cout << "Occlusion culling: CPU depth pyramid" << endl;
+		break;
 
+	case GLFW_KEY_Z:
+		gDepthPrepass = !gDepthPrepass;
+		if (gDepthPrepass)
+			cout << "Depth pre-pass: on" << endl;
+		else
+			cout << "Depth pre-pass: off" << endl;
+		break;
 
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the H keyboard body --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-0.12f, 1.0f, 5.85));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the J keyboard body --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(0.23f, 1.0f, 5.85));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-
-	///-------Transform and draw the K keyboard body --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	case GLFW_KEY_X:
+		gOverdrawStats = !gOverdrawStats;
+		if (gOverdrawStats)
+			cout << "Overdraw statistics: on" << endl;
+		else
+			cout << "Overdraw statistics: off" << endl;
+		break;
 
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(0.58f, 1.0f, 5.85));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the L keyboard body --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	case GLFW_KEY_L:
+		gLightingMode = LightingMode((gLightingMode + 1) % 3);
+		if (gLightingMode == LIGHTS_OFF)
+			cout << "Clustered lighting: off" << endl;
+		else if (gLightingMode == LIGHTS_CPU)
+			cout << "Clustered lighting: " << gClusters.lights.size() << " lights, clusters built on the CPU" << endl;
+		else
+			cout << "Clustered lighting: " << gClusters.lights.size() << " lights, clusters built on the GPU" << endl;
+		break;
 
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(0.93f, 1.0f, 5.85));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the ; keyboard body --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	case GLFW_KEY_K:
+		gShadows = !gShadows; // reported by the render side, which counts the cascades
+		break;
 
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(1.28f, 1.0f, 5.85));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
+	case GLFW_KEY_G:
+		gShadingMode = (gShadingMode == SHADING_FORWARD) ? SHADING_DEFERRED : SHADING_FORWARD;
+		if (gShadingMode == SHADING_DEFERRED)
+			cout << "Shading: deferred, G-buffer lit in one fullscreen pass" << endl;
+		else
+			cout << "Shading: forward" << endl;
+		break;
 
+	case GLFW_KEY_V:
+		gPacingMode = FramePacer::Mode((gPacingMode + 1) % FramePacer::MODE_COUNT);
+		gReportPacing = true; // the frame times of the old mode first
+		if (gPacingMode == FramePacer::MODE_FIXED)
+			cout << "Frame pacing: fixed " << gTargetFps << " fps" << endl;
+		else
+			cout << "Frame pacing: " << FramePacer::UModeName(gPacingMode) << endl;
+		break;
 
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the ' keyboard body --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(1.63f, 1.0f, 5.85));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
+	case GLFW_KEY_F:
+		gReportPacing = true;
+		break;
 
+	case GLFW_KEY_B:
+		gScene.SetHierarchicalCulling(!gScene.HierarchicalCulling());
+		if (gScene.HierarchicalCulling())
+			cout << "Culling: BVH, " << gScene.Hierarchy().NodeCount() << " nodes" << endl;
+		else
+			cout << "Culling: every node" << endl;
+		break;
 
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the ENTER keyboard body --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.5f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(2.15f, 1.0f, 5.85));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-
-	///-------Transform and draw the Z keyboard body --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-1.15f, 1.0f, 6.2f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the X keyboard body --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-.8f, 1.0f, 6.2f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-
-	///-------Transform and draw the C keyboard body --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-.45f, 1.0f, 6.2f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the V keyboard body --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-.1f, 1.0f, 6.2f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the V keyboard body --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(.25f, 1.0f, 6.2f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the B keyboard body --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(.6f, 1.0f, 6.2f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the N keyboard body --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(.95f, 1.0f, 6.2f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the M keyboard body --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(.95f, 1.0f, 6.2f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the , keyboard body --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(1.3f, 1.0f, 6.2f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the . keyboard body --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(1.65f, 1.0f, 6.2f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the right shift keyboard body --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.75f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(1.95f, 1.0f, 6.2f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-
-	///-------Transform and draw the option keyboard body --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-1.5f, 1.0f, 6.55f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the mac button keyboard body --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.5f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-1.05f, 1.0f, 6.55f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the space keyboard body --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(2.0f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(0.25f, 1.0f, 6.55f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the space keyboard body --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.5f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(1.55f, 1.0f, 6.55f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	///-------Transform and draw the space keyboard body --------
-
-	glBindVertexArray(meshes.gBoxMesh.vao);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.25f, 0.25f, 0.25f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(2.0f, 1.0f, 6.55f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform1i(glGetUniformLocation(gProgramId, "useTexture"), 0); // Enable texturing
-	glUniform4f(glGetUniformLocation(gProgramId, "objectColor"), 0.7f, 0.7f, 0.5f, 1.0f);
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+	default:
+		break;
+	}
+}
 
-	//clear vertex array
-	glBindVertexArray(0);
 
-	// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-	glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+// Camera between two simulation ticks, alpha 0 is from and 1 is to
+Camera UInterpolateCamera(const Camera& from, const Camera& to, float alpha)
+{
+	Camera camera(glm::mix(from.Position, to.Position, alpha), to.WorldUp,
+		glm::mix(from.Yaw, to.Yaw, alpha), glm::mix(from.Pitch, to.Pitch, alpha));
+	camera.MovementSpeed = to.MovementSpeed;
+	camera.MouseSensitivity = to.MouseSensitivity;
+	camera.Zoom = glm::mix(from.Zoom, to.Zoom, alpha);
+	return camera;
 }
 
 
@@ -1994,6 +1885,17 @@ void UProcessInput(GLFWwindow* window)
 	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
 		glfwSetWindowShouldClose(window, true);
 
+	if (gMouseOffset != glm::vec2(0.0f))
+	{
+		gCamera.ProcessMouseMovement(gMouseOffset.x, gMouseOffset.y);
+		gMouseOffset = glm::vec2(0.0f);
+	}
+	if (gScrollOffset != 0.0f)
+	{
+		gCamera.ProcessMouseScroll(gScrollOffset);
+		gScrollOffset = 0.0f;
+	}
+
 	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
 		gCamera.ProcessKeyboard(FORWARD, gDeltaTime);
 	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
@@ -2014,50 +1916,17 @@ void UProcessInput(GLFWwindow* window)
 
 }
 
-bool UCreateTexture(const char* filename, GLuint& textureId)
+// Load and flip images first .. first + count - 1 of the TextureImage array in context, as a job
+void UDecodeImages(void* context, size_t first, size_t count)
 {
-	int width, height, channels;
-	unsigned char* image = stbi_load(filename, &width, &height, &channels, 0);
-	if (image)
+	TextureImage* images = static_cast<TextureImage*>(context);
+	for (size_t i = first; i < first + count; i++)
 	{
-		flipImageVertically(image, width, height, channels);
-
-		glGenTextures(1, &textureId);
-		glBindTexture(GL_TEXTURE_2D, textureId);
-
-		// set the texture wrapping parameters
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		// set texture filtering parameters
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		if (channels == 3)
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-		else if (channels == 4)
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-		else
-		{
-			cout << "Not implemented to handle image with " << channels << " channels" << endl;
-			return false;
-		}
-
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		stbi_image_free(image);
-		glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
-
-		return true;
+		TextureImage& image = images[i];
+		image.pixels = stbi_load(image.filename, &image.width, &image.height, &image.channels, 0);
+		if (image.pixels)
+			flipImageVertically(image.pixels, image.width, image.height, image.channels);
 	}
-
-	// Error loading the image
-	return false;
-}
-
-
-void UDestroyTexture(GLuint textureId)
-{
-	glGenTextures(1, &textureId);
 }
 
 
@@ -0,0 +1,172 @@
+///////////////////////////////////////////////////////////////////////////////
+// materials.cpp
+// =============
+// surface materials in one storage buffer, their textures in one array
+///////////////////////////////////////////////////////////////////////////////
+
+#include "materials.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+	// Sort order of the material IDs
+	bool Less(const Materials::Material &a, const Materials::Material &b)
+	{
+		if (a.variant != b.variant)
+			return a.variant < b.variant;
+		if (a.textureLayer != b.textureLayer)
+			return a.textureLayer < b.textureLayer;
+		if (a.specularStrength != b.specularStrength)
+			return a.specularStrength < b.specularStrength;
+		for (int i = 0; i < 4; i++)
+		{
+			if (a.color[i] != b.color[i])
+				return a.color[i] < b.color[i];
+		}
+		return false;
+	}
+
+	bool Equal(const Materials::Material &a, const Materials::Material &b)
+	{
+		return !Less(a, b) && !Less(b, a);
+	}
+
+	// Image as RGBA at width x height, bilinear between texel centers and
+	// wrapping around like the GL_REPEAT sampler does
+	void ResampleLayer(const Materials::Image &image, GLsizei width, GLsizei height, std::vector<unsigned char> &rgba)
+	{
+		rgba.resize(size_t(width) * height * 4);
+		auto texel = [&image](int x, int y, int channel)
+		{
+			x = (x % image.width + image.width) % image.width;
+			y = (y % image.height + image.height) % image.height;
+			if (channel == 3 && image.channels == 3)
+				return 255.0f;
+			return float(image.pixels[(size_t(y) * image.width + x) * image.channels + channel]);
+		};
+
+		for (GLsizei y = 0; y < height; y++)
+		{
+			float sourceY = (y + 0.5f) * image.height / height - 0.5f;
+			int y0 = int(std::floor(sourceY));
+			float fy = sourceY - y0;
+			for (GLsizei x = 0; x < width; x++)
+			{
+				float sourceX = (x + 0.5f) * image.width / width - 0.5f;
+				int x0 = int(std::floor(sourceX));
+				float fx = sourceX - x0;
+				unsigned char *out = &rgba[(size_t(y) * width + x) * 4];
+				for (int channel = 0; channel < 4; channel++)
+				{
+					float top = texel(x0, y0, channel) * (1.0f - fx) + texel(x0 + 1, y0, channel) * fx;
+					float bottom = texel(x0, y0 + 1, channel) * (1.0f - fx) + texel(x0 + 1, y0 + 1, channel) * fx;
+					out[channel] = (unsigned char)(std::min(255.0f, top * (1.0f - fy) + bottom * fy + 0.5f));
+				}
+			}
+		}
+	}
+}
+
+std::uint32_t Materials::UAdd(GLMaterials &materials, const Material &material)
+{
+	for (size_t i = 0; i < materials.materials.size(); i++)
+	{
+		if (Equal(materials.materials[i], material))
+			return std::uint32_t(i);
+	}
+	materials.materials.push_back(material);
+	return std::uint32_t(materials.materials.size() - 1);
+}
+
+void Materials::USort(GLMaterials &materials, std::uint32_t *ids, size_t count)
+{
+	std::vector<std::uint32_t> order(materials.materials.size());
+	for (size_t i = 0; i < order.size(); i++)
+		order[i] = std::uint32_t(i);
+	std::sort(order.begin(), order.end(), [&materials](std::uint32_t a, std::uint32_t b)
+	{
+		return Less(materials.materials[a], materials.materials[b]);
+	});
+
+	std::vector<Material> sorted(order.size());
+	std::vector<std::uint32_t> sortedId(order.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		sorted[i] = materials.materials[order[i]];
+		sortedId[order[i]] = std::uint32_t(i);
+	}
+	materials.materials.swap(sorted);
+
+	for (size_t i = 0; i < count; i++)
+		ids[i] = sortedId[ids[i]];
+}
+
+///////////////////////////////////////////////////
+//	UCreateMaterials(GLMaterials&, const Image*, size_t)
+//
+//	Layers are RGBA8 with mipmaps, like the single
+//	textures they replace
+///////////////////////////////////////////////////
+bool Materials::UCreateMaterials(GLMaterials &materials, const Image *images, size_t count)
+{
+	// keep at least one material allocated so the buffer can always be bound
+	glGenBuffers(1, &materials.buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, materials.buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(Material) * std::max<size_t>(materials.materials.size(), 1),
+		NULL, GL_STATIC_DRAW);
+	if (!materials.materials.empty())
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(Material) * materials.materials.size(), materials.materials.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	materials.layerWidth = 1;
+	materials.layerHeight = 1;
+	materials.layerCount = GLsizei(std::max<size_t>(count, 1));
+	for (size_t i = 0; i < count; i++)
+	{
+		if (!images[i].pixels || (images[i].channels != 3 && images[i].channels != 4))
+		{
+			std::cout << "Not implemented to handle image with " << images[i].channels << " channels" << std::endl;
+			return false;
+		}
+		materials.layerWidth = std::max<GLsizei>(materials.layerWidth, images[i].width);
+		materials.layerHeight = std::max<GLsizei>(materials.layerHeight, images[i].height);
+	}
+
+	glGenTextures(1, &materials.textures);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, materials.textures);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, materials.layerWidth, materials.layerHeight, materials.layerCount,
+		0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+	std::vector<unsigned char> rgba;
+	for (size_t i = 0; i < count; i++)
+	{
+		ResampleLayer(images[i], materials.layerWidth, materials.layerHeight, rgba);
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, GLint(i), materials.layerWidth, materials.layerHeight, 1,
+			GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+	}
+
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	return true;
+}
+
+void Materials::UDestroyMaterials(GLMaterials &materials)
+{
+	glDeleteBuffers(1, &materials.buffer);
+	glDeleteTextures(1, &materials.textures);
+	materials = GLMaterials();
+}
+
+void Materials::UBind(const GLMaterials &materials)
+{
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_BINDING, materials.buffer);
+	glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, materials.textures);
+}
@@ -0,0 +1,92 @@
+///////////////////////////////////////////////////////////////////////////////
+// materials.h
+// ===========
+// surface materials in one storage buffer, their textures in one array
+//
+// A material is a color, a texture layer, a specular strength and the shader
+// variant (pipeline) drawing it. Every distinct material is stored once in a
+// shader storage buffer bound at MATERIAL_BINDING and every texture is a
+// layer of one GL_TEXTURE_2D_ARRAY, so the surface shaders look everything
+// up from a material index and a draw changes a single uniform instead of
+// binding a texture and setting the color and texture flags.
+//
+// Material IDs are indices into the sorted list: by variant, then texture
+// layer, then the rest. Draws in material ID order bind each pipeline once
+// and walk the texture layers in order.
+//
+// All layers of an array share one size, images of other sizes are
+// resampled to the largest width and height when the array is created.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Materials
+{
+
+public:
+	// Storage buffer binding and texture unit read by the surface shaders
+	static const GLuint MATERIAL_BINDING = 6;
+	static const GLuint TEXTURE_UNIT = 0;
+
+	static const GLint NO_TEXTURE = -1;
+
+	// Shader variants, the pipeline numbers of the command lists
+	enum Variant
+	{
+		VARIANT_SURFACE = 0,	// lit surface, forward or G-buffer
+		VARIANT_COUNT
+	};
+
+	// One material, std430 layout (32 bytes)
+	struct Material
+	{
+		glm::vec4 color = glm::vec4(1.0f);	// used without a texture
+		GLint textureLayer = NO_TEXTURE;
+		float specularStrength = 1.0f;		// scales the specular of both lights
+		GLuint variant = VARIANT_SURFACE;
+		float padding = 0.0f;
+	};
+
+	// Decoded image, rows bottom up
+	struct Image
+	{
+		const unsigned char *pixels;
+		int width;
+		int height;
+		int channels;	// 3 or 4
+	};
+
+	struct GLMaterials
+	{
+		std::vector<Material> materials;	// index is the material ID
+		GLuint buffer = 0;
+		GLuint textures = 0;				// GL_TEXTURE_2D_ARRAY
+		GLsizei layerWidth = 0;
+		GLsizei layerHeight = 0;
+		GLsizei layerCount = 0;
+	};
+
+public:
+	// Add a material unless an equal one is there, returns its ID
+	static std::uint32_t UAdd(GLMaterials &materials, const Material &material);
+
+	// Put the materials in ID order and rewrite ids, IDs returned by UAdd(),
+	// to the sorted IDs
+	static void USort(GLMaterials &materials, std::uint32_t *ids, size_t count);
+
+	// Upload the materials and the images, image i becomes texture layer i.
+	// Must be called on the thread that owns the GL context.
+	static bool UCreateMaterials(GLMaterials &materials, const Image *images, size_t count);
+	static void UDestroyMaterials(GLMaterials &materials);
+
+	// Bind the material buffer and the texture array
+	static void UBind(const GLMaterials &materials);
+};
@@ -0,0 +1,350 @@
+///////////////////////////////////////////////////////////////////////////////
+// meshcache.cpp
+// =============
+// share GPU meshes between users that request the same generator parameters
+///////////////////////////////////////////////////////////////////////////////
+
+#include "meshcache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+	// Disk cache file layout: header, then interleaved floats, then indices
+	const char diskMagic[4] = { 'M', 'S', 'H', '1' };
+
+	// Part of every generator hash. Bump it whenever a generator changes its
+	// output, files written by the old generators then no longer match.
+	// 2: torus normals fixed
+	const std::uint32_t generatorVersion = 2;
+
+	struct DiskHeader
+	{
+		char magic[4];
+		std::uint32_t floatCount;
+		std::uint64_t generatorHash;
+		std::uint32_t indexCount;
+		std::uint32_t reserved;
+	};
+
+	// FNV-1a over raw bytes
+	std::uint64_t HashBytes(std::uint64_t hash, const void *bytes, std::size_t size)
+	{
+		const unsigned char *p = static_cast<const unsigned char *>(bytes);
+		for (std::size_t i = 0; i < size; i++)
+		{
+			hash ^= p[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	template<typename T>
+	std::uint64_t HashValue(std::uint64_t hash, const T &value)
+	{
+		return HashBytes(hash, &value, sizeof(value));
+	}
+}
+
+MeshCache::MeshParams MeshCache::MeshParams::Make(Shape shape, Meshes::VertexFormat format)
+{
+	MeshParams params;
+	params.shape = shape;
+	params.segments = 0;
+	params.subSegments = 0;
+	params.radius = 0.0f;
+	params.innerRadius = 0.0f;
+	params.format = format;
+	return params;
+}
+
+MeshCache::MeshParams MeshCache::MeshParams::Cylinder(int segments, float topRadius, Meshes::VertexFormat format)
+{
+	MeshParams params = Make(SHAPE_CYLINDER, format);
+	params.segments = segments;
+	params.radius = topRadius;
+	return params;
+}
+
+MeshCache::MeshParams MeshCache::MeshParams::Torus(int mainSegments, int tubeSegments, float mainRadius, float tubeRadius, Meshes::VertexFormat format)
+{
+	MeshParams params = Make(SHAPE_TORUS, format);
+	params.segments = mainSegments;
+	params.subSegments = tubeSegments;
+	params.radius = mainRadius;
+	params.innerRadius = tubeRadius;
+	return params;
+}
+
+bool MeshCache::MeshParams::operator==(const MeshParams &other) const
+{
+	return shape == other.shape
+		&& segments == other.segments
+		&& subSegments == other.subSegments
+		&& radius == other.radius
+		&& innerRadius == other.innerRadius
+		&& format == other.format;
+}
+
+std::size_t MeshCache::ParamsHash::operator()(const MeshParams &params) const
+{
+	return std::size_t(HashValue(UHashGenerator(params), int(params.format)));
+}
+
+MeshCache::MeshCache() : mJobs(nullptr)
+{
+	std::memset(&mStats, 0, sizeof(mStats));
+}
+
+MeshCache::~MeshCache()
+{
+	// GL objects can only be released while the context is alive, so owners
+	// are expected to call Clear() before tearing the window down
+	if (!mEntries.empty())
+		std::cerr << "MeshCache destroyed with " << mEntries.size() << " meshes still allocated" << std::endl;
+}
+
+///////////////////////////////////////////////////
+//	UHashGenerator(const MeshParams&)
+//
+//	Hash the generator version and the fields that
+//	decide the generated vertex data. The vertex
+//	format is left out so float and packed meshes
+//	share a disk entry.
+///////////////////////////////////////////////////
+std::uint64_t MeshCache::UHashGenerator(const MeshParams &params)
+{
+	std::uint64_t hash = 14695981039346656037ull;
+	hash = HashValue(hash, generatorVersion);
+	hash = HashValue(hash, int(params.shape));
+	hash = HashValue(hash, params.segments);
+	hash = HashValue(hash, params.subSegments);
+	hash = HashValue(hash, params.radius);
+	hash = HashValue(hash, params.innerRadius);
+	return hash;
+}
+
+void MeshCache::SetDiskCacheDirectory(const std::string &directory)
+{
+	mDiskDirectory = directory;
+}
+
+void MeshCache::SetJobs(Jobs::Scheduler *jobs)
+{
+	mJobs = jobs;
+}
+
+const Meshes::GLMesh *MeshCache::Acquire(const MeshParams &params)
+{
+	const Meshes::GLMesh *mesh;
+	Acquire(&params, 1, &mesh);
+	return mesh;
+}
+
+///////////////////////////////////////////////////
+//	Acquire(const MeshParams*, size_t, const GLMesh**)
+//
+//	Look the parameters up and hand out the shared
+//	meshes. Every distinct miss gets its entry at
+//	once, so repeats in the list count as hits, and
+//	its vertex data is loaded from disk when
+//	possible, otherwise generated, then packed, all
+//	misses in parallel. Saving to disk and the
+//	upload stay on the calling thread: float and
+//	packed meshes share a disk file. The packed
+//	copy is dropped after the upload.
+///////////////////////////////////////////////////
+void MeshCache::Acquire(const MeshParams *params, size_t count, const Meshes::GLMesh **meshes)
+{
+	struct Miss
+	{
+		const MeshParams *params;
+		Entry *entry;
+		bool loaded;
+	};
+	std::vector<Miss> misses;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		auto found = mEntries.find(params[i]);
+		if (found != mEntries.end())
+		{
+			found->second.refCount++;
+			mStats.hits++;
+			meshes[i] = &found->second.mesh;
+			continue;
+		}
+
+		Entry &entry = mEntries[params[i]];
+		entry.refCount = 1;
+		entry.mesh.format = params[i].format;
+		meshes[i] = &entry.mesh;
+
+		Miss miss;
+		miss.params = &params[i];
+		miss.entry = &entry;
+		miss.loaded = false;
+		misses.push_back(miss);
+	}
+
+	auto build = [this, &misses](size_t i)
+	{
+		Miss &miss = misses[i];
+		Meshes::MeshData &data = miss.entry->data;
+		miss.loaded = ULoadFromDisk(*miss.params, data);
+		if (!miss.loaded)
+			data = UGenerate(*miss.params);
+		Meshes::UPackMesh(miss.entry->mesh, data);
+	};
+	if (mJobs)
+		Jobs::UParallelFor(*mJobs, misses.size(), 1, build);
+	else
+	{
+		for (size_t i = 0; i < misses.size(); i++)
+			build(i);
+	}
+
+	for (Miss &miss : misses)
+	{
+		if (miss.loaded)
+		{
+			mStats.loadedFromDisk++;
+		}
+		else
+		{
+			mStats.generated++;
+			USaveToDisk(*miss.params, miss.entry->data);
+		}
+
+		Meshes::UUploadMesh(miss.entry->mesh, miss.entry->data);
+		miss.entry->data.packed = std::vector<Meshes::PackedVertex>();
+		mStats.uploaded++;
+	}
+}
+
+const Meshes::MeshData *MeshCache::Data(const MeshParams &params) const
+{
+	auto found = mEntries.find(params);
+	return (found == mEntries.end()) ? NULL : &found->second.data;
+}
+
+void MeshCache::Release(const MeshParams &params)
+{
+	auto found = mEntries.find(params);
+	if (found == mEntries.end())
+	{
+		std::cerr << "MeshCache::Release called for a mesh that is not cached" << std::endl;
+		return;
+	}
+
+	if (--found->second.refCount == 0)
+	{
+		Meshes::UDestroyMesh(found->second.mesh);
+		mEntries.erase(found);
+	}
+}
+
+void MeshCache::Clear()
+{
+	for (auto &entry : mEntries)
+		Meshes::UDestroyMesh(entry.second.mesh);
+	mEntries.clear();
+}
+
+int MeshCache::RefCount(const MeshParams &params) const
+{
+	auto found = mEntries.find(params);
+	return (found == mEntries.end()) ? 0 : found->second.refCount;
+}
+
+///////////////////////////////////////////////////
+//	UGenerate(const MeshParams&)
+//
+//	Run the generator matching the parameters
+///////////////////////////////////////////////////
+Meshes::MeshData MeshCache::UGenerate(const MeshParams &params)
+{
+	switch (params.shape)
+	{
+	case SHAPE_PLANE:		return Meshes::UGeneratePlaneMesh();
+	case SHAPE_PRISM:		return Meshes::UGeneratePrismMesh();
+	case SHAPE_BOX:			return Meshes::UGenerateBoxMesh();
+	case SHAPE_CONE:		return Meshes::UGenerateConeMesh();
+	case SHAPE_PYRAMID3:	return Meshes::UGeneratePyramid3Mesh();
+	case SHAPE_PYRAMID4:	return Meshes::UGeneratePyramid4Mesh();
+	case SHAPE_SPHERE:		return Meshes::UGenerateSphereMesh();
+	case SHAPE_CYLINDER:	return Meshes::UGenerateCylinderMesh(params.segments, params.radius);
+	case SHAPE_TORUS:		return Meshes::UGenerateTorusMesh(params.segments, params.subSegments, params.radius, params.innerRadius);
+	}
+	return Meshes::MeshData();
+}
+
+std::string MeshCache::UDiskPath(const MeshParams &params) const
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.mesh", (unsigned long long)UHashGenerator(params));
+	return mDiskDirectory + "/" + name;
+}
+
+///////////////////////////////////////////////////
+//	ULoadFromDisk(const MeshParams&, MeshData&)
+//
+//	Read previously generated vertex data. Returns
+//	false when caching is off, the file is missing
+//	or it was written for different parameters.
+///////////////////////////////////////////////////
+bool MeshCache::ULoadFromDisk(const MeshParams &params, Meshes::MeshData &data) const
+{
+	if (mDiskDirectory.empty())
+		return false;
+
+	std::ifstream file(UDiskPath(params), std::ios::binary);
+	if (!file)
+		return false;
+
+	DiskHeader header;
+	if (!file.read(reinterpret_cast<char *>(&header), sizeof(header))
+		|| std::memcmp(header.magic, diskMagic, sizeof(diskMagic)) != 0
+		|| header.generatorHash != UHashGenerator(params))
+		return false;
+
+	data.verts.resize(header.floatCount);
+	data.indices.resize(header.indexCount);
+	file.read(reinterpret_cast<char *>(data.verts.data()), sizeof(GLfloat) * data.verts.size());
+	file.read(reinterpret_cast<char *>(data.indices.data()), sizeof(GLuint) * data.indices.size());
+	if (!file)
+	{
+		std::cout << "Ignoring truncated mesh cache file " << UDiskPath(params) << std::endl;
+		data = Meshes::MeshData();
+		return false;
+	}
+	return true;
+}
+
+void MeshCache::USaveToDisk(const MeshParams &params, const Meshes::MeshData &data) const
+{
+	if (mDiskDirectory.empty())
+		return;
+
+	std::ofstream file(UDiskPath(params), std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		std::cout << "Could not write mesh cache file " << UDiskPath(params) << std::endl;
+		return;
+	}
+
+	DiskHeader header;
+	std::memcpy(header.magic, diskMagic, sizeof(diskMagic));
+	header.floatCount = std::uint32_t(data.verts.size());
+	header.generatorHash = UHashGenerator(params);
+	header.indexCount = std::uint32_t(data.indices.size());
+	header.reserved = 0;
+
+	file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char *>(data.verts.data()), sizeof(GLfloat) * data.verts.size());
+	file.write(reinterpret_cast<const char *>(data.indices.data()), sizeof(GLuint) * data.indices.size());
+}
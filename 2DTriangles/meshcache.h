@@ -0,0 +1,132 @@
+///////////////////////////////////////////////////////////////////////////////
+// meshcache.h
+// ===========
+// share GPU meshes between users that request the same generator parameters
+//
+// Meshes are keyed by a hash of the parameters they were generated from, so
+// a primitive requested by many scene nodes is generated and uploaded once.
+// Entries are reference counted and destroyed when the last user releases
+// them. Generated vertex data can optionally be kept on disk so later runs
+// skip the generator entirely.
+//
+// Meshes acquired together are built together: the misses are loaded or
+// generated and packed as jobs, only their upload runs one after another on
+// the thread owning the GL context.
+//
+// The generated (float) vertex data stays with each cached mesh, so users
+// that need the triangles on the CPU, like meshlet building and picking,
+// read it from the cache instead of running the generator again.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "meshes.h"
+#include "jobs.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+class MeshCache
+{
+
+public:
+
+	// Generators the cache knows how to run
+	enum Shape
+	{
+		SHAPE_PLANE,
+		SHAPE_PRISM,
+		SHAPE_BOX,
+		SHAPE_CONE,
+		SHAPE_PYRAMID3,
+		SHAPE_PYRAMID4,
+		SHAPE_SPHERE,
+		SHAPE_CYLINDER,		// segments, radius = top radius
+		SHAPE_TORUS			// segments x subSegments, radius = main radius, innerRadius = tube radius
+	};
+
+	// Everything that decides the contents of a cached mesh
+	struct MeshParams
+	{
+		Shape shape;
+		int segments;
+		int subSegments;
+		float radius;
+		float innerRadius;
+		Meshes::VertexFormat format;
+
+		static MeshParams Make(Shape shape, Meshes::VertexFormat format = Meshes::VERTEX_FORMAT_FLOAT);
+		static MeshParams Cylinder(int segments, float topRadius = 1.0f, Meshes::VertexFormat format = Meshes::VERTEX_FORMAT_FLOAT);
+		static MeshParams Torus(int mainSegments, int tubeSegments, float mainRadius, float tubeRadius, Meshes::VertexFormat format = Meshes::VERTEX_FORMAT_FLOAT);
+
+		bool operator==(const MeshParams &other) const;
+	};
+
+	// Counters for checking that sharing actually happens
+	struct Stats
+	{
+		int hits;			// Acquire() calls served by an existing entry
+		int generated;		// meshes built by running a generator
+		int loadedFromDisk;	// meshes built from the disk cache
+		int uploaded;		// meshes uploaded to the GPU
+	};
+
+public:
+	MeshCache();
+	~MeshCache();
+
+	// Cache generated vertex data in this directory, empty to disable
+	void SetDiskCacheDirectory(const std::string &directory);
+
+	// Build missing meshes as jobs of this scheduler, NULL builds them on
+	// the calling thread
+	void SetJobs(Jobs::Scheduler *jobs);
+
+	// Return the shared mesh for these parameters, creating it on first use.
+	// Must be called on the thread that owns the GL context.
+	const Meshes::GLMesh *Acquire(const MeshParams &params);
+
+	// Same for count meshes at once, meshes[i] is the mesh of params[i]
+	void Acquire(const MeshParams *params, size_t count, const Meshes::GLMesh **meshes);
+
+	// Vertex data of a cached mesh, NULL when these parameters are not cached
+	const Meshes::MeshData *Data(const MeshParams &params) const;
+
+	// Drop one reference, destroying the mesh when nobody uses it anymore
+	void Release(const MeshParams &params);
+
+	// Destroy every cached mesh regardless of reference counts
+	void Clear();
+
+	int RefCount(const MeshParams &params) const;
+	const Stats &GetStats() const { return mStats; }
+
+	// Hash of the generator inputs, independent of the vertex format
+	static std::uint64_t UHashGenerator(const MeshParams &params);
+
+	// Run the generator for these parameters without touching the cache
+	static Meshes::MeshData UGenerate(const MeshParams &params);
+
+private:
+	struct ParamsHash
+	{
+		std::size_t operator()(const MeshParams &params) const;
+	};
+
+	struct Entry
+	{
+		Meshes::GLMesh mesh;
+		Meshes::MeshData data;	// without the packed vertices, those live on the GPU
+		int refCount;
+	};
+
+	bool ULoadFromDisk(const MeshParams &params, Meshes::MeshData &data) const;
+	void USaveToDisk(const MeshParams &params, const Meshes::MeshData &data) const;
+	std::string UDiskPath(const MeshParams &params) const;
+
+	std::unordered_map<MeshParams, Entry, ParamsHash> mEntries;
+	std::string mDiskDirectory;
+	Jobs::Scheduler *mJobs;
+	Stats mStats;
+};
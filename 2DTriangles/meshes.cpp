@@ -8,65 +8,66 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "meshes.h"
-
+#include "normals.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <tuple>
 #include <vector>
 
 namespace
 {
 	const double M_PI = 3.14159265358979323846f;
 	const double M_PI_2 = 1.571428571428571;
-}
 
-///////////////////////////////////////////////////
-//	CreateMeshes()
-//
-//	Create all the following 3D meshes:
-//		plane, pyramid, cube, cylinder, torus, sphere
-///////////////////////////////////////////////////
-void Meshes::CreateMeshes()
-{
-	UCreatePlaneMesh(gPlaneMesh);
-	UCreatePrismMesh(gPrismMesh);
-	UCreateBoxMesh(gBoxMesh);
-	UCreateConeMesh(gConeMesh);
-	UCreateCylinderMesh(gCylinderMesh);
-	UCreateTaperedCylinderMesh(gTaperedCylinderMesh);
-	UCreatePyramid3Mesh(gPyramid3Mesh);
-	UCreatePyramid4Mesh(gPyramid4Mesh);
-	UCreateSphereMesh(gSphereMesh);
-	UCreateTorusMesh(gTorusMesh);
-}
+	// total float values per each type of the interleaved vertex data
+	const GLuint floatsPerVertex = 3;
+	const GLuint floatsPerNormal = 3;
+	const GLuint floatsPerUV = 2;
+	const GLuint floatsPerInterleavedVertex = floatsPerVertex + floatsPerNormal + floatsPerUV;
 
-///////////////////////////////////////////////////
-//	DestroyMeshes()
-//
-//	Destroy the created meshes
-///////////////////////////////////////////////////
-void Meshes::DestroyMeshes()
-{
-	UDestroyMesh(gBoxMesh);
-	UDestroyMesh(gConeMesh);
-	UDestroyMesh(gCylinderMesh);
-	UDestroyMesh(gPlaneMesh);
-	UDestroyMesh(gPyramid3Mesh);
-	UDestroyMesh(gPyramid4Mesh);
-	UDestroyMesh(gPrismMesh);
-	UDestroyMesh(gSphereMesh);
-	UDestroyMesh(gTorusMesh);
+	// Convert a value in [-1, 1] to a signed normalized 16 bit integer
+	GLshort PackSnorm16(float value)
+	{
+		value = std::min(std::max(value, -1.0f), 1.0f);
+		return (GLshort)std::lround(value * 32767.0f);
+	}
+
+	// Convert a value in [0, 1] to an unsigned normalized 16 bit integer
+	GLushort PackUnorm16(float value)
+	{
+		value = std::min(std::max(value, 0.0f), 1.0f);
+		return (GLushort)std::lround(value * 65535.0f);
+	}
+
+	// Convert a unit vector into the GL_INT_2_10_10_10_REV layout (x in the lowest bits)
+	GLuint PackNormal2_10_10_10(const glm::vec3 &normal)
+	{
+		GLuint packed = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			float value = std::min(std::max(normal[i], -1.0f), 1.0f);
+			GLint component = (GLint)std::lround(value * 511.0f);
+			packed |= ((GLuint)component & 0x3FF) << (10 * i);
+		}
+		return packed;
+	}
 }
 
 ///////////////////////////////////////////////////
-//	UCreatePlaneMesh(GLMesh&)
-//
-//	mesh: reference to mesh structure for storing data
+//	UGeneratePlaneMesh()
 //
-//	Create a plane mesh and store it in a VAO/VBO
+//	Generate the vertex data for a plane mesh
 // 
 //  Correct triangle drawing command:
 //
-//	glDrawElements(GL_TRIANGLES, meshes.gPlaneMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+//	glDrawElements(GL_TRIANGLES, mesh.nIndices, GL_UNSIGNED_INT, (void*)0);
 ///////////////////////////////////////////////////
-void Meshes::UCreatePlaneMesh(GLMesh &mesh)
+Meshes::MeshData Meshes::UGeneratePlaneMesh()
 {
 	// Vertex data
 	GLfloat verts[] = {
@@ -83,53 +84,23 @@ void Meshes::UCreatePlaneMesh(GLMesh &mesh)
 		0,3,2
 	};
 
-	// total float values per each type
-	const GLuint floatsPerVertex = 3;
-	const GLuint floatsPerNormal = 3;
-	const GLuint floatsPerUV = 2;
-
-	// store vertex and index count
-	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-	mesh.nIndices = sizeof(indices) / sizeof(indices[0]);
-
-	// Generate the VAO for the mesh
-	glGenVertexArrays(1, &mesh.vao);
-	glBindVertexArray(mesh.vao);	// activate the VAO
-
-	// Create VBOs for the mesh
-	glGenBuffers(2, mesh.vbos);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
-	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends data to the GPU
-
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]); // Activates the buffer
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-	// Strides between vertex coordinates
-	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
-
-	// Create Vertex Attribute Pointers
-	glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-	glEnableVertexAttribArray(0);
-
-	glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-	glEnableVertexAttribArray(1);
-
-	glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-	glEnableVertexAttribArray(2);
+	// return the vertex and index data for upload
+	MeshData data;
+	data.verts.assign(std::begin(verts), std::end(verts));
+	data.indices.assign(std::begin(indices), std::end(indices));
+	return data;
 }
 
 ///////////////////////////////////////////////////
-//	UCreatePyramid3Mesh(GLMesh&)
-//
-//	mesh: reference to mesh structure for storing data
+//	UGeneratePyramid3Mesh()
 //
-//	Create a pyramid mesh and store it in a VAO/VBO
+//	Generate the vertex data for a pyramid mesh
 //
 //  Correct triangle drawing command:
 //
-//	glDrawArrays(GL_TRIANGLE_STRIP, 0, meshes.gPyramid3Mesh.nVertices);
+//	glDrawArrays(GL_TRIANGLE_STRIP, 0, mesh.nVertices);
 ///////////////////////////////////////////////////
-void Meshes::UCreatePyramid3Mesh(GLMesh &mesh)
+Meshes::MeshData Meshes::UGeneratePyramid3Mesh()
 {
 	// Vertex data
 	GLfloat verts[] = {
@@ -156,44 +127,22 @@ void Meshes::UCreatePyramid3Mesh(GLMesh &mesh)
 		-0.5f, -0.5f, 0.5f,		0.0f, -1.0f, 0.0f,	0.0f, 1.0f,     //front bottom left
 	};
 
-	const GLuint floatsPerVertex = 3;	// Number of coordinates per vertex
-	const GLuint floatsPerColor = 3;	// Number of values per vertex color
-	const GLuint floatsPerUV = 2;		// Number of texture coordinate values
-
-	// Calculate total defined vertices
-	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerColor + floatsPerUV));
-
-	glGenVertexArrays(1, &mesh.vao);			// Creates 1 VAO
-	glGenBuffers(1, mesh.vbos);					// Creates 1 VBO
-	glBindVertexArray(mesh.vao);				// Activates the VAO
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]);	// Activates the VBO
-	// Sends vertex or coordinate data to the GPU
-	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW);
-
-	// Strides between sets of attribute data
-	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerColor + floatsPerUV);
-
-	// Creates the Vertex Attribute Pointers
-	glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, (void*)0);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, floatsPerColor, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* floatsPerVertex));
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* (floatsPerVertex + floatsPerColor)));
-	glEnableVertexAttribArray(2);
+	// return the vertex data for upload
+	MeshData data;
+	data.verts.assign(std::begin(verts), std::end(verts));
+	return data;
 }
 
 ///////////////////////////////////////////////////
-//	UCreatePyramid4Mesh(GLMesh&)
+//	UGeneratePyramid4Mesh()
 //
-//	mesh: reference to mesh structure for storing data
-//
-//	Create a pyramid mesh and store it in a VAO/VBO
+//	Generate the vertex data for a pyramid mesh
 //
 //  Correct triangle drawing command:
 //
-//	glDrawArrays(GL_TRIANGLE_STRIP, 0, meshes.gPyramid4Mesh.nVertices);
+//	glDrawArrays(GL_TRIANGLE_STRIP, 0, mesh.nVertices);
 ///////////////////////////////////////////////////
-void Meshes::UCreatePyramid4Mesh(GLMesh &mesh)
+Meshes::MeshData Meshes::UGeneratePyramid4Mesh()
 {
 	// Vertex data
 	GLfloat verts[] = {
@@ -229,44 +178,22 @@ void Meshes::UCreatePyramid4Mesh(GLMesh &mesh)
 		0.0f, 0.5f, 0.0f,		0.0f, 0.0f, 1.0f,	0.5f, 1.0f,		//top point
 	};
 
-	const GLuint floatsPerVertex = 3;	// Number of coordinates per vertex
-	const GLuint floatsPerColor = 3;	// Number of values per vertex color
-	const GLuint floatsPerUV = 2;		// Number of texture coordinate values
-
-	// Calculate total defined vertices
-	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerColor + floatsPerUV));
-
-	glGenVertexArrays(1, &mesh.vao);			// Creates 1 VAO
-	glGenBuffers(1, mesh.vbos);					// Creates 1 VBO
-	glBindVertexArray(mesh.vao);				// Activates the VAO
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]);	// Activates the VBO
-	// Sends vertex or coordinate data to the GPU
-	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW);
-
-	// Strides between sets of attribute data
-	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerColor + floatsPerUV);
-
-	// Creates the Vertex Attribute Pointers
-	glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, (void*)0);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, floatsPerColor, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* floatsPerVertex));
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* (floatsPerVertex + floatsPerColor)));
-	glEnableVertexAttribArray(2);
+	// return the vertex data for upload
+	MeshData data;
+	data.verts.assign(std::begin(verts), std::end(verts));
+	return data;
 }
 
 ///////////////////////////////////////////////////
-//	UCreatePrismMesh(GLMesh&)
+//	UGeneratePrismMesh()
 //
-//	mesh: reference to mesh structure for storing data
-//
-//	Create a pyramid mesh and store it in a VAO/VBO
+//	Generate the vertex data for a pyramid mesh
 //
 //	Correct triangle drawing command:
 //
-//	glDrawArrays(GL_TRIANGLE_STRIP, 0, meshes.gPrismMesh.nVertices);
+//	glDrawArrays(GL_TRIANGLE_STRIP, 0, mesh.nVertices);
 ///////////////////////////////////////////////////
-void Meshes::UCreatePrismMesh(GLMesh &mesh)
+Meshes::MeshData Meshes::UGeneratePrismMesh()
 {
 	// Vertex data
 	GLfloat verts[] = {
@@ -317,46 +244,22 @@ void Meshes::UCreatePrismMesh(GLMesh &mesh)
 
 	};
 
-	const GLuint floatsPerVertex = 3;
-	const GLuint floatsPerNormal = 3;
-	const GLuint floatsPerUV = 2;
-
-	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-
-	glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-	glBindVertexArray(mesh.vao);
-
-	// Create 2 buffers: first one for the vertex data; second one for the indices
-	glGenBuffers(1, mesh.vbos);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
-	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-	// Strides between vertex coordinates is 6 (x, y, z, r, g, b, a). A tightly packed stride is 0.
-	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);// The number of floats before each
-
-	// Create Vertex Attribute Pointers
-	glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-	glEnableVertexAttribArray(0);
-
-	glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-	glEnableVertexAttribArray(1);
-
-	glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-	glEnableVertexAttribArray(2);
+	// return the vertex data for upload
+	MeshData data;
+	data.verts.assign(std::begin(verts), std::end(verts));
+	return data;
 }
 
 ///////////////////////////////////////////////////
-//	UCreateBoxMesh(GLMesh&)
+//	UGenerateBoxMesh()
 //
-//	mesh: reference to mesh structure for storing data
-//
-//	Create a cube mesh and store it in a VAO/VBO
+//	Generate the vertex data for a cube mesh
 //
 //	Correct triangle drawing command:
 //
-//	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+//	glDrawElements(GL_TRIANGLES, mesh.nIndices, GL_UNSIGNED_INT, (void*)0);
 ///////////////////////////////////////////////////
-void Meshes::UCreateBoxMesh(GLMesh &mesh)
+Meshes::MeshData Meshes::UGenerateBoxMesh()
 {
 	// Position and Color data
 	GLfloat verts[] = {
@@ -416,51 +319,24 @@ void Meshes::UCreateBoxMesh(GLMesh &mesh)
 		20,23,22
 	};
 
-	const GLuint floatsPerVertex = 3;
-	const GLuint floatsPerNormal = 3;
-	const GLuint floatsPerUV = 2;
-
-	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-	mesh.nIndices = sizeof(indices) / sizeof(indices[0]);
-
-	glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-	glBindVertexArray(mesh.vao);
-
-	// Create 2 buffers: first one for the vertex data; second one for the indices
-	glGenBuffers(2, mesh.vbos);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
-	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]); // Activates the buffer
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-	// Strides between vertex coordinates is 6 (x, y, z, r, g, b, a). A tightly packed stride is 0.
-	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);// The number of floats before each
-
-	// Create Vertex Attribute Pointers
-	glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-	glEnableVertexAttribArray(0);
-
-	glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-	glEnableVertexAttribArray(1);
-
-	glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-	glEnableVertexAttribArray(2);
+	// return the vertex and index data for upload
+	MeshData data;
+	data.verts.assign(std::begin(verts), std::end(verts));
+	data.indices.assign(std::begin(indices), std::end(indices));
+	return data;
 }
 
 ///////////////////////////////////////////////////
-//	UCreateConeMesh(GLMesh&)
-//
-//	mesh: reference to mesh structure for storing data
+//	UGenerateConeMesh()
 //
-//	Create a cone mesh and store it in a VAO/VBO
+//	Generate the vertex data for a cone mesh
 //
 //  Correct triangle drawing commands:
 //
 //	glDrawArrays(GL_TRIANGLE_FAN, 0, 36);		//bottom
 //	glDrawArrays(GL_TRIANGLE_STRIP, 36, 108);	//sides
 ///////////////////////////////////////////////////
-void Meshes::UCreateConeMesh(GLMesh &mesh)
+Meshes::MeshData Meshes::UGenerateConeMesh()
 {
 	GLfloat verts[] = {
 		// cone bottom			// normals			// texture coords
@@ -613,70 +489,66 @@ void Meshes::UCreateConeMesh(GLMesh &mesh)
 		1.0f, 0.0f, 0.0f,		0.993150651f, 0.0f, 0.116841137f, 	1.0f, 0.5f
 	};
 
-	// total float values per each type
-	const GLuint floatsPerVertex = 3;
-	const GLuint floatsPerNormal = 3;
-	const GLuint floatsPerUV = 2;
-
-	// store vertex and index count
-	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-	mesh.nIndices = 0;
-
-	// Create VAO
-	glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-	glBindVertexArray(mesh.vao);
-
-	// Create VBO
-	glGenBuffers(1, mesh.vbos);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
-	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-	// Strides between vertex coordinates
-	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
-
-	// Create Vertex Attribute Pointers
-	glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, (void*)0);
-	glEnableVertexAttribArray(0);
-
-	glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex)));
-	glEnableVertexAttribArray(1);
+	// return the vertex data for upload
+	MeshData data;
+	data.verts.assign(std::begin(verts), std::end(verts));
+	return data;
+}
 
-	glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-	glEnableVertexAttribArray(2);
+///////////////////////////////////////////////////
+//	CalculateTriangleNormal(p0, p1, p2)
+//
+//	Unit normal of a counter-clockwise triangle
+///////////////////////////////////////////////////
+glm::vec3 Meshes::CalculateTriangleNormal(glm::vec3 p0, glm::vec3 p1, glm::vec3 p2)
+{
+	return Normals::UTriangleNormal(p0, p1, p2);
 }
 
-void Meshes::CalculateTriangleNormal(glm::vec3 p0, glm::vec3 p1, glm::vec3 p2)
+///////////////////////////////////////////////////
+//	UCalculateNormals(MeshData&)
+//
+//	Replace the normals of an indexed mesh with
+//	smooth, angle weighted vertex normals. Vertices
+//	sharing a position share a normal, so this is
+//	meant for smooth closed surfaces, not shapes
+//	with hard edges.
+///////////////////////////////////////////////////
+void Meshes::UCalculateNormals(MeshData &data)
 {
-	glm::vec3 Normal(0, 0, 0);
-	float v1x = p1.x - p0.x;
-	float v1y = p1.y - p0.y;
-	float v1z = p1.z - p0.z;
-	float v2x = p2.x - p1.x;
-	float v2y = p2.y - p1.y;
-	float v2z = p2.z - p1.z;
-	Normal.x = v1y * v2z - v1z * v2y;
-	Normal.y = v1z * v2x - v1x * v2z;
-	Normal.y = v1x * v2y - v1y * v2x;
-	float len = (float)sqrt(Normal.x * Normal.x + Normal.y * Normal.y + Normal.z * Normal.z);
-	if (len == 0)
+	const size_t nVertices = data.verts.size() / floatsPerInterleavedVertex;
+	std::vector<float> x(nVertices), y(nVertices), z(nVertices);
+	std::vector<float> nx(nVertices), ny(nVertices), nz(nVertices);
+	std::vector<GLuint> weld(nVertices);
+
+	// split the positions out and weld vertices with identical positions
+	std::map<std::tuple<float, float, float>, GLuint> firstAtPosition;
+	for (size_t i = 0; i < nVertices; i++)
 	{
-		//throw Exception();
+		const GLfloat *vert = &data.verts[i * floatsPerInterleavedVertex];
+		x[i] = vert[0];
+		y[i] = vert[1];
+		z[i] = vert[2];
+		weld[i] = firstAtPosition.insert(std::make_pair(std::make_tuple(x[i], y[i], z[i]), GLuint(i))).first->second;
 	}
-	else
+
+	Normals::UVertexNormals(x.data(), y.data(), z.data(), nVertices,
+		data.indices.data(), data.indices.size() / 3, weld.data(),
+		nx.data(), ny.data(), nz.data());
+
+	for (size_t i = 0; i < nVertices; i++)
 	{
-		Normal.x /= len;
-		Normal.y /= len;
-		Normal.z /= len;
+		GLfloat *vert = &data.verts[i * floatsPerInterleavedVertex + floatsPerVertex];
+		vert[0] = nx[i];
+		vert[1] = ny[i];
+		vert[2] = nz[i];
 	}
-	//return Normal;
 }
 
 ///////////////////////////////////////////////////
-//	UCreateCylinderMesh(GLMesh&)
-//
-//	mesh: reference to mesh structure for storing data
+//	UGenerateCylinderMesh()
 //
-//	Create a cylinder mesh and store it in a VAO/VBO
+//	Generate the vertex data for a cylinder mesh
 //
 //  Correct triangle drawing commands:
 //
@@ -684,7 +556,7 @@ void Meshes::CalculateTriangleNormal(glm::vec3 p0, glm::vec3 p1, glm::vec3 p2)
 //	glDrawArrays(GL_TRIANGLE_FAN, 36, 36);		//top
 //	glDrawArrays(GL_TRIANGLE_STRIP, 72, 146);	//sides
 ///////////////////////////////////////////////////
-void Meshes::UCreateCylinderMesh(GLMesh &mesh)
+Meshes::MeshData Meshes::UGenerateCylinderMesh()
 {
 	GLfloat verts[] = {
 		// cylinder bottom		// normals			// texture coords
@@ -912,44 +784,16 @@ void Meshes::UCreateCylinderMesh(GLMesh &mesh)
 		1.0f, 0.0f, 0.0f,		0.993150651f, 0.0f, 0.116841137f,	1.0, 0.0
 	};
 
-	// total float values per each type
-	const GLuint floatsPerVertex = 3;
-	const GLuint floatsPerNormal = 3;
-	const GLuint floatsPerUV = 2;
-
-	// store vertex and index count
-	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-	mesh.nIndices = 0;
-
-	// Create VAO
-	glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-	glBindVertexArray(mesh.vao);
-
-	// Create VBO
-	glGenBuffers(1, mesh.vbos);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
-	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-	// Strides between vertex coordinates
-	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
-
-	// Create Vertex Attribute Pointers
-	glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, (void*)0);
-	glEnableVertexAttribArray(0);
-
-	glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex)));
-	glEnableVertexAttribArray(1);
-
-	glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-	glEnableVertexAttribArray(2);
+	// return the vertex data for upload
+	MeshData data;
+	data.verts.assign(std::begin(verts), std::end(verts));
+	return data;
 }
 
 ///////////////////////////////////////////////////
-//	UCreateTaperedCylinderMesh(GLMesh&)
-//
-//	mesh: reference to mesh structure for storing data
+//	UGenerateTaperedCylinderMesh()
 //
-//	Create a tapered cylinder mesh and store it in a VAO/VBO
+//	Generate the vertex data for a tapered cylinder mesh
 //
 //  Correct triangle drawing commands:
 //
@@ -957,7 +801,7 @@ void Meshes::UCreateCylinderMesh(GLMesh &mesh)
 //	glDrawArrays(GL_TRIANGLE_FAN, 36, 72);		//top
 //	glDrawArrays(GL_TRIANGLE_STRIP, 72, 146);	//sides
 ///////////////////////////////////////////////////
-void Meshes::UCreateTaperedCylinderMesh(GLMesh &mesh)
+Meshes::MeshData Meshes::UGenerateTaperedCylinderMesh()
 {
 	GLfloat verts[] = {
 		// cylinder bottom		// normals			// texture coords
@@ -1185,251 +1029,171 @@ void Meshes::UCreateTaperedCylinderMesh(GLMesh &mesh)
 		1.0f, 0.0f, 0.0f,		0.993150651f, 0.5f, 0.116841137f,	1.0, 0.0
 	};
 
-	// total float values per each type
-	const GLuint floatsPerVertex = 3;
-	const GLuint floatsPerNormal = 3;
-	const GLuint floatsPerUV = 2;
+	// return the vertex data for upload
+	MeshData data;
+	data.verts.assign(std::begin(verts), std::end(verts));
+	return data;
+}
 
-	// store vertex and index count
-	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-	mesh.nIndices = 0;
+///////////////////////////////////////////////////
+//	UGenerateCylinderMesh(int, float)
+//
+//	Generate an indexed cylinder with the given number
+//	of radial segments. The bottom has radius 1 at y = 0
+//	and the top has topRadius at y = 1, so a top radius
+//	below 1 gives a tapered cylinder.
+//
+//	Correct triangle drawing command:
+//
+//	glDrawElements(GL_TRIANGLES, mesh.nIndices, GL_UNSIGNED_INT, NULL);
+///////////////////////////////////////////////////
+Meshes::MeshData Meshes::UGenerateCylinderMesh(int segments, float topRadius)
+{
+	MeshData data;
+	data.verts.reserve(size_t(4 * segments + 4) * floatsPerInterleavedVertex);
+	data.indices.reserve(size_t(segments) * 12);
+	const float angleStep = 2.0f * float(M_PI) / float(segments);
 
-	// Create VAO
-	glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-	glBindVertexArray(mesh.vao);
+	// slope of the side, used to tilt the side normals of a tapered cylinder
+	const float slope = 1.0f - topRadius;
 
-	// Create VBO
-	glGenBuffers(1, mesh.vbos);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
-	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+	auto addVertex = [&data](float x, float y, float z, glm::vec3 n, float u, float v)
+	{
+		GLfloat vertex[] = { x, y, z, n.x, n.y, n.z, u, v };
+		data.verts.insert(data.verts.end(), std::begin(vertex), std::end(vertex));
+	};
 
-	// Strides between vertex coordinates
-	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
+	// caps: a center vertex followed by the ring, bottom first
+	for (int cap = 0; cap < 2; cap++)
+	{
+		const float y = float(cap);
+		const float radius = (cap == 0) ? 1.0f : topRadius;
+		const glm::vec3 normal(0.0f, (cap == 0) ? -1.0f : 1.0f, 0.0f);
+		const GLuint center = GLuint(data.verts.size() / floatsPerInterleavedVertex);
 
-	// Create Vertex Attribute Pointers
-	glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, (void*)0);
-	glEnableVertexAttribArray(0);
+		addVertex(0.0f, y, 0.0f, normal, 0.5f, 0.5f);
+		for (int i = 0; i < segments; i++)
+		{
+			const float c = cos(angleStep * i);
+			const float s = sin(angleStep * i);
+			addVertex(radius * c, y, radius * s, normal, 0.5f + 0.5f * c, 0.5f + 0.5f * s);
+		}
+		for (int i = 0; i < segments; i++)
+		{
+			const GLuint a = center + 1 + i;
+			const GLuint b = center + 1 + (i + 1) % segments;
+			// keep the winding counter-clockwise when seen from outside
+			data.indices.push_back(center);
+			data.indices.push_back(cap == 0 ? a : b);
+			data.indices.push_back(cap == 0 ? b : a);
+		}
+	}
 
-	glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex)));
-	glEnableVertexAttribArray(1);
+	// sides: one extra column so the texture seam gets its own vertices
+	const GLuint side = GLuint(data.verts.size() / floatsPerInterleavedVertex);
+	for (int i = 0; i <= segments; i++)
+	{
+		const float c = cos(angleStep * i);
+		const float s = sin(angleStep * i);
+		const glm::vec3 normal = glm::normalize(glm::vec3(c, slope, s));
+		const float u = float(i) / float(segments);
 
-	glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-	glEnableVertexAttribArray(2);
+		addVertex(c, 0.0f, s, normal, u, 0.0f);
+		addVertex(topRadius * c, 1.0f, topRadius * s, normal, u, 1.0f);
+	}
+	for (int i = 0; i < segments; i++)
+	{
+		const GLuint bottom0 = side + 2 * i;
+		const GLuint top0 = bottom0 + 1;
+		const GLuint bottom1 = bottom0 + 2;
+		const GLuint top1 = bottom0 + 3;
+
+		data.indices.push_back(bottom0);
+		data.indices.push_back(top0);
+		data.indices.push_back(bottom1);
+		data.indices.push_back(bottom1);
+		data.indices.push_back(top0);
+		data.indices.push_back(top1);
+	}
+
+	return data;
 }
 
 ///////////////////////////////////////////////////
-//	UCreateTorusMesh(GLMesh&)
-//
-//	mesh: reference to mesh structure for storing data
+//	UGenerateTorusMesh(int, int, float, float)
 //
-//	Create a torus mesh and store it in a VAO/VBO
+//	Generate the vertex data for a torus mesh with
+//	the given ring/tube resolution and radii
 //
 //	Correct triangle drawing command:
 //
-//	glDrawArrays(GL_TRIANGLES, 0, meshes.gTorusMesh.nVertices);
+//	glDrawElements(GL_TRIANGLES, mesh.nIndices, GL_UNSIGNED_INT, (void*)0);
 ///////////////////////////////////////////////////
-void Meshes::UCreateTorusMesh(GLMesh &mesh)
+Meshes::MeshData Meshes::UGenerateTorusMesh(int mainSegments, int tubeSegments, float mainRadius, float tubeRadius)
 {
-	int _mainSegments = 30;
-	int _tubeSegments = 30;
-	float _mainRadius = 1.0f;
-	float _tubeRadius = .1f;
-
-	auto mainSegmentAngleStep = glm::radians(360.0f / float(_mainSegments));
-	auto tubeSegmentAngleStep = glm::radians(360.0f / float(_tubeSegments));
-
-	std::vector<glm::vec3> vertex_list;
-	std::vector<std::vector<glm::vec3>> segments_list;
-	std::vector<glm::vec2> texture_coords;
-	glm::vec3 center(0.0f, 0.0f, 0.0f);
-	glm::vec3 normal;
-	glm::vec3 vertex;
-	glm::vec2 text_coord;
-
-	// generate the torus vertices
-	auto currentMainSegmentAngle = 0.0f;
-	for (auto i = 0; i < _mainSegments; i++)
+	MeshData data;
+	data.verts.reserve(size_t(mainSegments + 1) * (tubeSegments + 1) * floatsPerInterleavedVertex);
+	data.indices.reserve(size_t(mainSegments) * tubeSegments * 6);
+	const float mainSegmentAngleStep = 2.0f * float(M_PI) / float(mainSegments);
+	const float tubeSegmentAngleStep = 2.0f * float(M_PI) / float(tubeSegments);
+
+	// generate the torus vertices, with one extra ring and tube column so the
+	// texture seams get their own vertices. The angles wrap around so seam
+	// vertices land exactly on the first ones and get welded for the normals.
+	for (int i = 0; i <= mainSegments; i++)
 	{
 		// Calculate sine and cosine of main segment angle
-		auto sinMainSegment = sin(currentMainSegmentAngle);
-		auto cosMainSegment = cos(currentMainSegmentAngle);
-		auto currentTubeSegmentAngle = 0.0f;
-		std::vector<glm::vec3> segment_points;
-		for (auto j = 0; j < _tubeSegments; j++)
+		const float sinMainSegment = sin(mainSegmentAngleStep * (i % mainSegments));
+		const float cosMainSegment = cos(mainSegmentAngleStep * (i % mainSegments));
+
+		for (int j = 0; j <= tubeSegments; j++)
 		{
 			// Calculate sine and cosine of tube segment angle
-			auto sinTubeSegment = sin(currentTubeSegmentAngle);
-			auto cosTubeSegment = cos(currentTubeSegmentAngle);
+			const float sinTubeSegment = sin(tubeSegmentAngleStep * (j % tubeSegments));
+			const float cosTubeSegment = cos(tubeSegmentAngleStep * (j % tubeSegments));
 
 			// Calculate vertex position on the surface of torus
-			auto surfacePosition = glm::vec3(
-				(_mainRadius + _tubeRadius * cosTubeSegment)*cosMainSegment,
-				(_mainRadius + _tubeRadius * cosTubeSegment)*sinMainSegment,
-				_tubeRadius*sinTubeSegment);
-
-			//vertex_list.push_back(surfacePosition);
-			segment_points.push_back(surfacePosition);
-
-			// Update current tube angle
-			currentTubeSegmentAngle += tubeSegmentAngleStep;
+			GLfloat vertex[] = {
+				(mainRadius + tubeRadius * cosTubeSegment) * cosMainSegment,
+				(mainRadius + tubeRadius * cosTubeSegment) * sinMainSegment,
+				tubeRadius * sinTubeSegment,
+				0.0f, 0.0f, 0.0f,	// filled in by UCalculateNormals()
+				float(i) / float(mainSegments),
+				float(j) / float(tubeSegments)
+			};
+			data.verts.insert(data.verts.end(), std::begin(vertex), std::end(vertex));
 		}
-		segments_list.push_back(segment_points);
-		segment_points.clear();
-
-		// Update main segment angle
-		currentMainSegmentAngle += mainSegmentAngleStep;
 	}
 
-	float horizontalStep = 1.0 / _mainSegments;
-	float verticalStep = 1.0 / _tubeSegments;
-	float u = 0.0;
-	float v = 0.0;
-
-	// connect the various segments together, forming triangles
-	for (int i = 0; i < _mainSegments; i++)
+	// connect the segments together, two triangles per quad
+	for (int i = 0; i < mainSegments; i++)
 	{
-		for (int j = 0; j < _tubeSegments; j++)
+		for (int j = 0; j < tubeSegments; j++)
 		{
-			if (((i + 1) < _mainSegments) && ((j + 1) < _tubeSegments))
-			{
-				vertex_list.push_back(segments_list[i][j]);
-				texture_coords.push_back(glm::vec2(u, v));
-				vertex_list.push_back(segments_list[i][j + 1]);
-				texture_coords.push_back(glm::vec2(u, v+verticalStep));
-				vertex_list.push_back(segments_list[i + 1][j + 1]);
-				texture_coords.push_back(glm::vec2(u+horizontalStep, v+verticalStep));
-				vertex_list.push_back(segments_list[i][j]);
-				texture_coords.push_back(glm::vec2(u, v));
-				vertex_list.push_back(segments_list[i + 1][j]);
-				texture_coords.push_back(glm::vec2(u+horizontalStep, v));
-				vertex_list.push_back(segments_list[i + 1][j + 1]);
-				texture_coords.push_back(glm::vec2(u+horizontalStep, v-verticalStep));
-				vertex_list.push_back(segments_list[i][j]);
-				texture_coords.push_back(glm::vec2(u, v));
-			}
-			else
-			{
-				if (((i + 1) == _mainSegments) && ((j + 1) == _tubeSegments))
-				{
-					vertex_list.push_back(segments_list[i][j]);
-					texture_coords.push_back(glm::vec2(u, v));
-					vertex_list.push_back(segments_list[i][0]);
-					texture_coords.push_back(glm::vec2(u, 0));
-					vertex_list.push_back(segments_list[0][0]);
-					texture_coords.push_back(glm::vec2(0, 0));
-					vertex_list.push_back(segments_list[i][j]);
-					texture_coords.push_back(glm::vec2(u, v));
-					vertex_list.push_back(segments_list[0][j]);
-					texture_coords.push_back(glm::vec2(0, v));
-					vertex_list.push_back(segments_list[0][0]);
-					texture_coords.push_back(glm::vec2(0, 0));
-					vertex_list.push_back(segments_list[i][j]);
-					texture_coords.push_back(glm::vec2(u, v));
-				}
-				else if ((i + 1) == _mainSegments)
-				{
-					vertex_list.push_back(segments_list[i][j]);
-					texture_coords.push_back(glm::vec2(u, v));
-					vertex_list.push_back(segments_list[i][j + 1]);
-					texture_coords.push_back(glm::vec2(u, v+verticalStep));
-					vertex_list.push_back(segments_list[0][j + 1]);
-					texture_coords.push_back(glm::vec2(0, v+verticalStep));
-					vertex_list.push_back(segments_list[i][j]);
-					texture_coords.push_back(glm::vec2(u, v));
-					vertex_list.push_back(segments_list[0][j]);
-					texture_coords.push_back(glm::vec2(0, v));
-					vertex_list.push_back(segments_list[0][j + 1]);
-					texture_coords.push_back(glm::vec2(0, v+verticalStep));
-					vertex_list.push_back(segments_list[i][j]);
-					texture_coords.push_back(glm::vec2(u, v));
-				}
-				else if ((j + 1) == _tubeSegments)
-				{
-					vertex_list.push_back(segments_list[i][j]);
-					texture_coords.push_back(glm::vec2(u, v));
-					vertex_list.push_back(segments_list[i][0]);
-					texture_coords.push_back(glm::vec2(u, 0));
-					vertex_list.push_back(segments_list[i + 1][0]);
-					texture_coords.push_back(glm::vec2(u+horizontalStep, 0));
-					vertex_list.push_back(segments_list[i][j]);
-					texture_coords.push_back(glm::vec2(u, v));
-					vertex_list.push_back(segments_list[i + 1][j]);
-					texture_coords.push_back(glm::vec2(u+horizontalStep, v));
-					vertex_list.push_back(segments_list[i + 1][0]);
-					texture_coords.push_back(glm::vec2(u+horizontalStep, 0));
-					vertex_list.push_back(segments_list[i][j]);
-					texture_coords.push_back(glm::vec2(u, v));
-				}
-				
-			}
-			v += verticalStep;
-		}
-		v = 0.0;
-		u += horizontalStep;
-	}
+			const GLuint current = GLuint(i * (tubeSegments + 1) + j);
+			const GLuint next = current + GLuint(tubeSegments + 1);
 
-	std::vector<GLfloat> combined_values;
-
-	// combine interleaved vertices, normals, and texture coords
-	for (int i = 0; i < vertex_list.size(); i++)
-	{
-		vertex = vertex_list[i];
-		normal = normalize(vertex);
-		text_coord = texture_coords[i];
-		combined_values.push_back(vertex.x);
-		combined_values.push_back(vertex.y);
-		combined_values.push_back(vertex.z);
-		combined_values.push_back(normal.x);
-		combined_values.push_back(normal.y);
-		combined_values.push_back(normal.z);
-		combined_values.push_back(text_coord.x);
-		combined_values.push_back(text_coord.y);
+			GLuint quad[] = { current, next, current + 1, current + 1, next, next + 1 };
+			data.indices.insert(data.indices.end(), std::begin(quad), std::end(quad));
+		}
 	}
 
-	// total float values per each type
-	const GLuint floatsPerVertex = 3;
-	const GLuint floatsPerNormal = 3;
-	const GLuint floatsPerUV = 2;
-
-	// store vertex and index count
-	mesh.nVertices = vertex_list.size();
-	mesh.nIndices = 0;
-
-	// Create VAO
-	glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-	glBindVertexArray(mesh.vao);
-
-	// Create VBOs
-	glGenBuffers(1, mesh.vbos);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
-	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * combined_values.size(), combined_values.data(), GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+	UCalculateNormals(data);
 
-	// Strides between vertex coordinates
-	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
-
-	// Create Vertex Attribute Pointers
-	glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-	glEnableVertexAttribArray(0);
-
-	glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-	glEnableVertexAttribArray(1);
-
-	glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-	glEnableVertexAttribArray(2);
+	// return the vertex and index data for upload
+	return data;
 }
 
 ///////////////////////////////////////////////////
-//	UCreateSphereMesh(GLMesh&)
+//	UGenerateSphereMesh()
 //
-//	mesh: reference to mesh structure for storing data
-//
-//	Create a sphere mesh and store it in a VAO/VBO
+//	Generate the vertex data for a sphere mesh
 //
 //  Correct triangle drawing command:
 //
-//	glDrawElements(GL_TRIANGLES, meshes.gSphereMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+//	glDrawElements(GL_TRIANGLES, mesh.nIndices, GL_UNSIGNED_INT, (void*)0);
 ///////////////////////////////////////////////////
-void Meshes::UCreateSphereMesh(GLMesh &mesh)
+Meshes::MeshData Meshes::UGenerateSphereMesh()
 {
 	GLfloat verts[] = {
 		// vertex data					// texture coords			// index
@@ -2254,20 +2018,12 @@ void Meshes::UCreateSphereMesh(GLMesh &mesh)
 		247,256,248
 	};
 
-	// total float values per each type
-	const GLuint floatsPerVertex = 3;
-	const GLuint floatsPerNormal = 3;
-	const GLuint floatsPerUV = 2;
-
-	// store vertex and index count
-	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex));
-	mesh.nIndices = sizeof(indices) / (sizeof(indices[0]));
-
 	glm::vec3 normal;
 	glm::vec3 vert;
 	glm::vec3 center(0.0f, 0.0f, 0.0f);
 	float u, v;
 	std::vector<GLfloat> combined_values;
+	combined_values.reserve(sizeof(verts) / sizeof(verts[0]) / 5 * floatsPerInterleavedVertex);
 
 	// combine interleaved vertices, normals, and texture coords
 	for (int i = 0; i < sizeof(verts) / (sizeof(verts[0])); i += 5)
@@ -2286,34 +2042,238 @@ void Meshes::UCreateSphereMesh(GLMesh &mesh)
 		combined_values.push_back(verts[i + 4]);
 	}
 
+	// return the vertex and index data for upload
+	MeshData data;
+	data.verts = std::move(combined_values);
+	data.indices.assign(std::begin(indices), std::end(indices));
+	return data;
+}
+
+///////////////////////////////////////////////////
+//	UPackMesh(GLMesh&, MeshData&)
+//
+//	mesh: mesh whose format selects the vertex layout
+//	data: generated vertex data to pack
+//
+//	Compute the dequantization parameters for the mesh
+//	and, for VERTEX_FORMAT_PACKED, fill data.packed.
+//	Touches no GL state, so it can run on any thread.
+///////////////////////////////////////////////////
+void Meshes::UPackMesh(GLMesh &mesh, MeshData &data)
+{
+	const GLfloat *verts = data.verts.data();
+	GLuint nVertices = data.verts.size() / floatsPerInterleavedVertex;
+
+	// store vertex and index count
+	mesh.nVertices = nVertices;
+	mesh.nIndices = data.indices.size();
+
+	UComputeBounds(mesh, data);
+
+	if (mesh.format != VERTEX_FORMAT_PACKED || nVertices == 0)
+	{
+		// full precision data needs no dequantization
+		mesh.positionOffset = glm::vec3(0.0f);
+		mesh.positionScale = glm::vec3(1.0f);
+		mesh.uvOffset = glm::vec2(0.0f);
+		mesh.uvScale = glm::vec2(1.0f);
+		data.packed.clear();
+		return;
+	}
+
+	// find the texture coordinate bounds used for quantization, the
+	// position bounds were found above
+	glm::vec2 minUV(verts[6], verts[7]);
+	glm::vec2 maxUV = minUV;
+	for (GLuint i = 0; i < nVertices; i++)
+	{
+		const GLfloat *vert = verts + i * floatsPerInterleavedVertex;
+		for (int j = 0; j < 2; j++)
+		{
+			minUV[j] = std::min(minUV[j], vert[6 + j]);
+			maxUV[j] = std::max(maxUV[j], vert[6 + j]);
+		}
+	}
+
+	// position = offset + scale * snorm, uv = offset + scale * unorm
+	mesh.positionOffset = (mesh.boundsMin + mesh.boundsMax) * 0.5f;
+	mesh.positionScale = (mesh.boundsMax - mesh.boundsMin) * 0.5f;
+	mesh.uvOffset = minUV;
+	mesh.uvScale = maxUV - minUV;
+	for (int j = 0; j < 3; j++)
+	{
+		if (mesh.positionScale[j] == 0.0f)
+			mesh.positionScale[j] = 1.0f;
+	}
+	for (int j = 0; j < 2; j++)
+	{
+		if (mesh.uvScale[j] == 0.0f)
+			mesh.uvScale[j] = 1.0f;
+	}
+
+	data.packed.resize(nVertices);
+	for (GLuint i = 0; i < nVertices; i++)
+	{
+		const GLfloat *vert = verts + i * floatsPerInterleavedVertex;
+		PackedVertex &packed = data.packed[i];
+		for (int j = 0; j < 3; j++)
+			packed.position[j] = PackSnorm16((vert[j] - mesh.positionOffset[j]) / mesh.positionScale[j]);
+		packed.position[3] = 0;
+		packed.normal = PackNormal2_10_10_10(glm::vec3(vert[3], vert[4], vert[5]));
+		for (int j = 0; j < 2; j++)
+			packed.uv[j] = PackUnorm16((vert[6 + j] - mesh.uvOffset[j]) / mesh.uvScale[j]);
+	}
+}
+
+///////////////////////////////////////////////////
+//	UComputeBounds(GLMesh&, const MeshData&)
+//
+//	Store the model space bounding box of the mesh
+//	and a bounding sphere around the box center
+///////////////////////////////////////////////////
+void Meshes::UComputeBounds(GLMesh &mesh, const MeshData &data)
+{
+	const GLfloat *verts = data.verts.data();
+	const GLuint nVertices = GLuint(data.verts.size() / floatsPerInterleavedVertex);
+
+	mesh.boundsMin = glm::vec3(0.0f);
+	mesh.boundsMax = glm::vec3(0.0f);
+	mesh.boundsCenter = glm::vec3(0.0f);
+	mesh.boundsRadius = 0.0f;
+	if (nVertices == 0)
+		return;
+
+	mesh.boundsMin = glm::vec3(verts[0], verts[1], verts[2]);
+	mesh.boundsMax = mesh.boundsMin;
+	for (GLuint i = 1; i < nVertices; i++)
+	{
+		const glm::vec3 position(verts[i * floatsPerInterleavedVertex + 0],
+			verts[i * floatsPerInterleavedVertex + 1],
+			verts[i * floatsPerInterleavedVertex + 2]);
+		mesh.boundsMin = glm::min(mesh.boundsMin, position);
+		mesh.boundsMax = glm::max(mesh.boundsMax, position);
+	}
+
+	mesh.boundsCenter = (mesh.boundsMin + mesh.boundsMax) * 0.5f;
+	for (GLuint i = 0; i < nVertices; i++)
+	{
+		const glm::vec3 position(verts[i * floatsPerInterleavedVertex + 0],
+			verts[i * floatsPerInterleavedVertex + 1],
+			verts[i * floatsPerInterleavedVertex + 2]);
+		mesh.boundsRadius = std::max(mesh.boundsRadius, glm::length(position - mesh.boundsCenter));
+	}
+}
+
+///////////////////////////////////////////////////
+//	UUploadMesh(GLMesh&, const MeshData&)
+//
+//	mesh: reference to mesh structure for storing data
+//	data: vertex data prepared by UPackMesh()
+//
+//	Store the vertex data in a VAO/VBO using the
+//	vertex format selected in mesh.format
+///////////////////////////////////////////////////
+void Meshes::UUploadMesh(GLMesh &mesh, const MeshData &data)
+{
 	// Create VAO
-	glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
+	glGenVertexArrays(1, &mesh.vao);
 	glBindVertexArray(mesh.vao);
 
-	// Create VBOs
-	glGenBuffers(2, mesh.vbos);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the vertex buffer
-	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * combined_values.size(), combined_values.data(), GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+	// Create the buffers: first one for the vertex data; second one for the indices
+	mesh.vbos[1] = 0;
+	glGenBuffers(data.indices.empty() ? 1 : 2, mesh.vbos);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]); // Activates the buffer
+
+	if (!data.packed.empty())
+	{
+		glBufferData(GL_ARRAY_BUFFER, sizeof(PackedVertex) * data.packed.size(), data.packed.data(), GL_STATIC_DRAW); // Sends vertex data to the GPU
+
+		// Strides between vertex coordinates
+		GLint stride = sizeof(PackedVertex);
+
+		// Create Vertex Attribute Pointers, normalized so the shader receives floats
+		glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, stride, (void*)offsetof(PackedVertex, position));
+		glEnableVertexAttribArray(0);
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]); // Activates the index buffer
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+		glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)offsetof(PackedVertex, normal));
+		glEnableVertexAttribArray(1);
 
-	// Strides between vertex coordinates
-	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
+		glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(PackedVertex, uv));
+		glEnableVertexAttribArray(2);
+	}
+	else
+	{
+		glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * data.verts.size(), data.verts.data(), GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
 
-	// Create Vertex Attribute Pointers
-	glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
+		// Strides between vertex coordinates
+		GLint stride = sizeof(float) * floatsPerInterleavedVertex;
+
+		// Create Vertex Attribute Pointers
+		glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
+		glEnableVertexAttribArray(0);
+
+		glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
+		glEnableVertexAttribArray(1);
+
+		glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
+		glEnableVertexAttribArray(2);
+	}
+
+	if (!data.indices.empty())
+	{
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]); // Activates the buffer
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * data.indices.size(), data.indices.data(), GL_STATIC_DRAW);
+	}
+
+	// Position only stream: same encoding as attribute 0 above so depth
+	// only passes produce exactly the same depth values
+	glGenVertexArrays(1, &mesh.positionVao);
+	glBindVertexArray(mesh.positionVao);
+	glGenBuffers(1, &mesh.positionVbo);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.positionVbo);
+
+	if (!data.packed.empty())
+	{
+		std::vector<GLshort> positions(data.packed.size() * 4);
+		for (size_t i = 0; i < data.packed.size(); i++)
+		{
+			for (int j = 0; j < 4; j++)
+				positions[i * 4 + j] = data.packed[i].position[j];
+		}
+		glBufferData(GL_ARRAY_BUFFER, sizeof(GLshort) * positions.size(), positions.data(), GL_STATIC_DRAW);
+		glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, sizeof(GLshort) * 4, 0);
+	}
+	else
+	{
+		const size_t nVertices = data.verts.size() / floatsPerInterleavedVertex;
+		std::vector<GLfloat> positions(nVertices * floatsPerVertex);
+		for (size_t i = 0; i < nVertices; i++)
+		{
+			for (GLuint j = 0; j < floatsPerVertex; j++)
+				positions[i * floatsPerVertex + j] = data.verts[i * floatsPerInterleavedVertex + j];
+		}
+		glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * positions.size(), positions.data(), GL_STATIC_DRAW);
+		glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, sizeof(float) * floatsPerVertex, 0);
+	}
 	glEnableVertexAttribArray(0);
 
-	glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-	glEnableVertexAttribArray(1);
+	if (!data.indices.empty())
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]);
 
-	glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-	glEnableVertexAttribArray(2);
+	glBindVertexArray(0);
 }
 
+///////////////////////////////////////////////////
+//	UDestroyMesh(GLMesh&)
+//
+//	Release the GL objects owned by a mesh
+///////////////////////////////////////////////////
 void Meshes::UDestroyMesh(GLMesh &mesh)
 {
 	glDeleteVertexArrays(1, &mesh.vao);
 	glDeleteBuffers(2, mesh.vbos);
+	glDeleteVertexArrays(1, &mesh.positionVao);
+	glDeleteBuffers(1, &mesh.positionVbo);
+	mesh.positionVao = 0;
+	mesh.positionVbo = 0;
 }
\ No newline at end of file
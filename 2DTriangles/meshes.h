@@ -13,11 +13,20 @@
 
 #include <glm/glm.hpp>
 
+#include <vector>
+
 class Meshes
 {
 
 public:
 
+	// Vertex layouts a mesh can be stored with on the GPU
+	enum VertexFormat
+	{
+		VERTEX_FORMAT_FLOAT,	// float position, normal and texture coords (32 bytes)
+		VERTEX_FORMAT_PACKED	// snorm16 position, 2_10_10_10 normal, unorm16 texture coords (16 bytes)
+	};
+
 	// Stores the GL data relative to a given mesh
 	struct GLMesh
 	{
@@ -25,36 +34,68 @@ public:
 		GLuint vbos[2];     // Handles for the vertex buffer objects
 		GLuint nVertices;	// Number of vertices for the mesh
 		GLuint nIndices;    // Number of indices for the mesh
+
+		// Position only copy of the vertices for depth only passes, shares the index buffer
+		GLuint positionVao = 0;
+		GLuint positionVbo = 0;
+
+		VertexFormat format = VERTEX_FORMAT_FLOAT;	// Layout to use, set before UPackMesh()
+
+		// Dequantization applied in the vertex shader: value = offset + scale * attribute
+		glm::vec3 positionOffset;
+		glm::vec3 positionScale;
+		glm::vec2 uvOffset;
+		glm::vec2 uvScale;
+
+		// Model space bounds, filled in by UPackMesh()
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+		glm::vec3 boundsCenter;	// bounding sphere around the box center
+		float boundsRadius;
+	};
+
+	// Layout of one vertex stored with VERTEX_FORMAT_PACKED (16 bytes)
+	struct PackedVertex
+	{
+		GLshort position[4];	// snorm16 position relative to the mesh bounds, w is padding
+		GLuint normal;			// normal packed as GL_INT_2_10_10_10_REV
+		GLushort uv[2];			// unorm16 texture coords relative to the mesh UV bounds
 	};
 
-	GLMesh gBoxMesh;
-	GLMesh gConeMesh;
-	GLMesh gCylinderMesh;
-	GLMesh gTaperedCylinderMesh;
-	GLMesh gPlaneMesh;
-	GLMesh gPrismMesh;
-	GLMesh gSphereMesh;
-	GLMesh gPyramid3Mesh;
-	GLMesh gPyramid4Mesh;
-	GLMesh gTorusMesh;
+	// CPU side data for a mesh, produced by the generators without touching GL
+	struct MeshData
+	{
+		std::vector<GLfloat> verts;			// interleaved positions, normals and texture coords
+		std::vector<GLuint> indices;		// empty for non-indexed meshes
+		std::vector<PackedVertex> packed;	// filled by UPackMesh() for VERTEX_FORMAT_PACKED meshes
+	};
 
 public:
-	void CreateMeshes();
-	void DestroyMeshes();
-
-private:
-	void UCreatePlaneMesh(GLMesh &mesh);
-	void UCreatePrismMesh(GLMesh &mesh);
-	void UCreateBoxMesh(GLMesh &mesh);
-	void UCreateConeMesh(GLMesh &mesh);
-	void UCreateCylinderMesh(GLMesh &mesh);
-	void UCreateTaperedCylinderMesh(GLMesh &mesh);
-	void UCreateTorusMesh(GLMesh &mesh);
-	void UCreatePyramid3Mesh(GLMesh &mesh);
-	void UCreatePyramid4Mesh(GLMesh &mesh);
-	void UCreateSphereMesh(GLMesh &mesh);
-
-	void UDestroyMesh(GLMesh &mesh);
-
-	void CalculateTriangleNormal(glm::vec3 px, glm::vec3 py, glm::vec3 pz);
+	// CPU phase: pure generators that are safe to run on any thread
+	static MeshData UGeneratePlaneMesh();
+	static MeshData UGeneratePrismMesh();
+	static MeshData UGenerateBoxMesh();
+	static MeshData UGenerateConeMesh();
+	static MeshData UGenerateCylinderMesh();
+	static MeshData UGenerateTaperedCylinderMesh();
+	static MeshData UGenerateTorusMesh(int mainSegments = 30, int tubeSegments = 30, float mainRadius = 1.0f, float tubeRadius = 0.1f);
+	static MeshData UGeneratePyramid3Mesh();
+	static MeshData UGeneratePyramid4Mesh();
+	static MeshData UGenerateSphereMesh();
+
+	// Parametric primitives, indexed GL_TRIANGLES
+	static MeshData UGenerateCylinderMesh(int segments, float topRadius = 1.0f);
+
+	// Smooth angle weighted normals for an indexed mesh
+	static void UCalculateNormals(MeshData &data);
+
+	// Unit normal of a counter-clockwise triangle
+	static glm::vec3 CalculateTriangleNormal(glm::vec3 p0, glm::vec3 p1, glm::vec3 p2);
+
+	static void UPackMesh(GLMesh &mesh, MeshData &data);
+	static void UComputeBounds(GLMesh &mesh, const MeshData &data);
+
+	// GL phase: must run on the thread that owns the GL context
+	static void UUploadMesh(GLMesh &mesh, const MeshData &data);
+	static void UDestroyMesh(GLMesh &mesh);
 };
\ No newline at end of file
@@ -0,0 +1,379 @@
+///////////////////////////////////////////////////////////////////////////////
+// meshlets.cpp
+// ============
+// split indexed triangle meshes into small clusters (meshlets) that can be
+// culled one by one before drawing
+///////////////////////////////////////////////////////////////////////////////
+
+#include "meshlets.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#ifndef GLSL
+#define GLSL(Version, Source) "#version " #Version " core \n" #Source
+#endif
+
+namespace
+{
+	const GLuint floatsPerInterleavedVertex = 8;
+	const GLuint workGroupSize = 64;
+
+	/* Meshlet cull compute shader: one invocation per meshlet */
+	const GLchar *cullShaderSource = GLSL(440,
+		layout(local_size_x = 64) in;
+
+	struct Meshlet
+	{
+		vec4 sphere;	// center, radius
+		vec4 cone;		// axis, cutoff
+		vec4 apex;
+		uvec4 range;	// first index, index count, vertex count, unused
+	};
+
+	struct DrawCommand
+	{
+		uint count;
+		uint instanceCount;
+		uint firstIndex;
+		int baseVertex;
+		uint baseInstance;
+	};
+
+	layout(std430, binding = 0) readonly buffer MeshletBuffer { Meshlet meshlets[]; };
+	layout(std430, binding = 1) writeonly buffer CommandBuffer { DrawCommand commands[]; };
+
+	uniform vec4 frustumPlanes[6];
+	uniform vec4 eye;
+	uniform uint meshletCount;
+
+	void main()
+	{
+		uint i = gl_GlobalInvocationID.x;
+		if (i >= meshletCount)
+			return;
+
+		Meshlet m = meshlets[i];
+		bool visible = true;
+
+		// bounding sphere against the frustum planes
+		for (int p = 0; p < 6; p++)
+			visible = visible && (dot(frustumPlanes[p].xyz, m.sphere.xyz) + frustumPlanes[p].w >= -m.sphere.w);
+
+		// normal cone: skip clusters facing away from the viewer
+		vec3 view = (eye.w == 0.0f) ? eye.xyz : normalize(m.apex.xyz - eye.xyz);
+		visible = visible && (dot(view, m.cone.xyz) < m.cone.w);
+
+		commands[i] = DrawCommand(m.range.y, visible ? 1u : 0u, m.range.x, 0, 0u);
+	}
+	);
+
+	glm::vec3 Position(const Meshes::MeshData &data, GLuint vertex)
+	{
+		const GLfloat *p = &data.verts[vertex * floatsPerInterleavedVertex];
+		return glm::vec3(p[0], p[1], p[2]);
+	}
+
+	///////////////////////////////////////////////////
+	//	ComputeBounds(Meshlet&, const MeshData&)
+	//
+	//	Bounding sphere around the meshlet vertices and
+	//	the normal cone of its triangles, following the
+	//	apex/cutoff formulation used by meshoptimizer
+	///////////////////////////////////////////////////
+	void ComputeBounds(Meshlets::Meshlet &meshlet, const Meshes::MeshData &data)
+	{
+		const GLuint *indices = &data.indices[meshlet.firstIndex];
+		const GLuint triangleCount = meshlet.indexCount / 3;
+
+		// sphere centered on the bounding box, radius to the farthest vertex
+		glm::vec3 minimum = Position(data, indices[0]);
+		glm::vec3 maximum = minimum;
+		for (GLuint i = 1; i < meshlet.indexCount; i++)
+		{
+			glm::vec3 p = Position(data, indices[i]);
+			minimum = glm::min(minimum, p);
+			maximum = glm::max(maximum, p);
+		}
+		meshlet.center = (minimum + maximum) * 0.5f;
+		meshlet.radius = 0.0f;
+		for (GLuint i = 0; i < meshlet.indexCount; i++)
+			meshlet.radius = std::max(meshlet.radius, glm::length(Position(data, indices[i]) - meshlet.center));
+
+		// the cone is disabled until proven usable
+		meshlet.coneAxis = glm::vec3(0.0f);
+		meshlet.coneCutoff = 1.0f;
+		meshlet.coneApex = meshlet.center;
+
+		// unit normal and one corner of every non-degenerate triangle
+		std::vector<glm::vec3> normals;
+		std::vector<glm::vec3> corners;
+		normals.reserve(triangleCount);
+		corners.reserve(triangleCount);
+		glm::vec3 axis(0.0f);
+		for (GLuint t = 0; t < triangleCount; t++)
+		{
+			glm::vec3 p0 = Position(data, indices[t * 3 + 0]);
+			glm::vec3 p1 = Position(data, indices[t * 3 + 1]);
+			glm::vec3 p2 = Position(data, indices[t * 3 + 2]);
+			glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+			float length = glm::length(n);
+			if (length == 0.0f)
+				continue;
+			normals.push_back(n / length);
+			corners.push_back(p0);
+			axis += normals.back();
+		}
+
+		float axisLength = glm::length(axis);
+		if (normals.empty() || axisLength == 0.0f)
+			return;
+		axis /= axisLength;
+
+		float minDot = 1.0f;
+		for (const glm::vec3 &n : normals)
+			minDot = std::min(minDot, glm::dot(axis, n));
+
+		// triangles spread over (nearly) a hemisphere can always be seen from somewhere
+		if (minDot <= 0.1f)
+			return;
+
+		// move the apex back along the axis until every triangle plane lies in front of it
+		float maxT = 0.0f;
+		for (size_t t = 0; t < normals.size(); t++)
+			maxT = std::max(maxT, glm::dot(meshlet.center - corners[t], normals[t]) / glm::dot(axis, normals[t]));
+
+		meshlet.coneAxis = axis;
+		meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+		meshlet.coneApex = meshlet.center - axis * maxT;
+	}
+}
+
+///////////////////////////////////////////////////
+//	UBuildMeshlets(MeshData&)
+//
+//	Greedily walk the triangles in index order,
+//	starting a new meshlet whenever the next
+//	triangle would exceed the vertex or triangle
+//	limit. Taking triangles in order means every
+//	meshlet is a contiguous range of the existing
+//	index buffer, so nothing has to be re-uploaded.
+///////////////////////////////////////////////////
+std::vector<Meshlets::Meshlet> Meshlets::UBuildMeshlets(const Meshes::MeshData &data)
+{
+	std::vector<Meshlet> meshlets;
+	const GLuint vertexCount = GLuint(data.verts.size() / floatsPerInterleavedVertex);
+	const GLuint indexCount = GLuint(data.indices.size()) / 3 * 3;
+
+	// which meshlet last used each vertex, to count unique vertices
+	std::vector<GLuint> lastMeshlet(vertexCount, GLuint(-1));
+
+	Meshlet current = Meshlet();
+	GLuint currentIndex = 0;
+	for (GLuint i = 0; i < indexCount; i += 3)
+	{
+		GLuint newVertices = 0;
+		for (GLuint k = 0; k < 3; k++)
+		{
+			if (lastMeshlet[data.indices[i + k]] != currentIndex)
+				newVertices++;
+		}
+		if (current.indexCount > 0
+			&& (current.vertexCount + newVertices > MAX_VERTICES || current.indexCount / 3 + 1 > MAX_TRIANGLES))
+		{
+			meshlets.push_back(current);
+			current = Meshlet();
+			current.firstIndex = i;
+			currentIndex++;
+		}
+
+		for (GLuint k = 0; k < 3; k++)
+		{
+			GLuint vertex = data.indices[i + k];
+			if (lastMeshlet[vertex] != currentIndex)
+			{
+				lastMeshlet[vertex] = currentIndex;
+				current.vertexCount++;
+			}
+		}
+		current.indexCount += 3;
+	}
+	if (current.indexCount > 0)
+		meshlets.push_back(current);
+
+	for (Meshlet &meshlet : meshlets)
+		ComputeBounds(meshlet, data);
+
+	return meshlets;
+}
+
+///////////////////////////////////////////////////
+//	UCreateMeshlets(GLMeshlets&, const GLMesh&, const MeshData&)
+//
+//	Build the meshlets, upload them to an SSBO and
+//	allocate the indirect command buffer
+///////////////////////////////////////////////////
+bool Meshlets::UCreateMeshlets(GLMeshlets &meshlets, const Meshes::GLMesh &mesh, const Meshes::MeshData &data)
+{
+	if (data.indices.empty() || mesh.vbos[1] == 0)
+	{
+		std::cerr << "Meshlets need an indexed triangle mesh" << std::endl;
+		return false;
+	}
+
+	meshlets.meshlets = UBuildMeshlets(data);
+	meshlets.commands.reserve(meshlets.meshlets.size());
+
+	glGenBuffers(1, &meshlets.meshletBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshlets.meshletBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(Meshlet) * meshlets.meshlets.size(), meshlets.meshlets.data(), GL_STATIC_DRAW);
+
+	glGenBuffers(1, &meshlets.commandBuffer);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, meshlets.commandBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) * meshlets.meshlets.size(), NULL, GL_DYNAMIC_DRAW);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	return true;
+}
+
+void Meshlets::UDestroyMeshlets(GLMeshlets &meshlets)
+{
+	glDeleteBuffers(1, &meshlets.meshletBuffer);
+	glDeleteBuffers(1, &meshlets.commandBuffer);
+	meshlets.meshletBuffer = 0;
+	meshlets.commandBuffer = 0;
+	meshlets.meshlets.clear();
+	meshlets.commands.clear();
+}
+
+bool Meshlets::UIsMeshletVisible(const Meshlet &meshlet, const Frustum &frustum, const glm::vec4 &eye)
+{
+	if (!frustum.IntersectsSphere(meshlet.center, meshlet.radius))
+		return false;
+
+	glm::vec3 view = (eye.w == 0.0f) ? glm::vec3(eye) : glm::normalize(meshlet.coneApex - glm::vec3(eye));
+	return glm::dot(view, meshlet.coneAxis) < meshlet.coneCutoff;
+}
+
+///////////////////////////////////////////////////
+//	UCullMeshlets(GLMeshlets&, StreamBuffer::GLStreamBuffer&, const Frustum&, const glm::vec4&, StreamBuffer::Allocation&)
+//
+//	Build the indirect draw list from the meshlets
+//	that pass the frustum and normal cone tests
+///////////////////////////////////////////////////
+GLuint Meshlets::UCullMeshlets(GLMeshlets &meshlets, StreamBuffer::GLStreamBuffer &stream, const Frustum &frustum, const glm::vec4 &eye, StreamBuffer::Allocation &commands)
+{
+	meshlets.commands.clear();
+	for (const Meshlet &meshlet : meshlets.meshlets)
+	{
+		if (!UIsMeshletVisible(meshlet, frustum, eye))
+			continue;
+
+		DrawElementsIndirectCommand command;
+		command.count = meshlet.indexCount;
+		command.instanceCount = 1;
+		command.firstIndex = meshlet.firstIndex;
+		command.baseVertex = 0;
+		command.baseInstance = 0;
+		meshlets.commands.push_back(command);
+	}
+
+	// indirect commands only need 4 byte alignment
+	const GLsizeiptr size = sizeof(DrawElementsIndirectCommand) * meshlets.commands.size();
+	if (!meshlets.commands.empty() && !StreamBuffer::UWrite(stream, meshlets.commands.data(), size, sizeof(GLuint), commands))
+	{
+		commands.buffer = meshlets.commandBuffer;
+		commands.offset = 0;
+		commands.size = size;
+		commands.pointer = nullptr;
+
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, meshlets.commandBuffer);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, size, meshlets.commands.data());
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+	return GLuint(meshlets.commands.size());
+}
+
+///////////////////////////////////////////////////
+//	UCreateCullProgram(GLuint&)
+//
+//	Compile and link the meshlet cull compute shader
+///////////////////////////////////////////////////
+bool Meshlets::UCreateCullProgram(GLuint &programId)
+{
+	int success = 0;
+	char infoLog[512];
+
+	programId = glCreateProgram();
+	GLuint computeShaderId = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(computeShaderId, 1, &cullShaderSource, NULL);
+	glCompileShader(computeShaderId);
+	glGetShaderiv(computeShaderId, GL_COMPILE_STATUS, &success);
+	if (!success)
+	{
+		glGetShaderInfoLog(computeShaderId, sizeof(infoLog), NULL, infoLog);
+		std::cout << "ERROR::SHADER::COMPUTE::COMPILATION_FAILED\n" << infoLog << std::endl;
+		glDeleteShader(computeShaderId);
+		return false;
+	}
+
+	glAttachShader(programId, computeShaderId);
+	glLinkProgram(programId);
+	glDeleteShader(computeShaderId);
+	glGetProgramiv(programId, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
+		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+		return false;
+	}
+	return true;
+}
+
+///////////////////////////////////////////////////
+//	UCullMeshletsGPU(const GLMeshlets&, GLuint, const Frustum&, const glm::vec4&)
+//
+//	Run the cull shader over every meshlet. The
+//	caller's program is restored afterwards so this
+//	can sit between ordinary draws.
+///////////////////////////////////////////////////
+void Meshlets::UCullMeshletsGPU(const GLMeshlets &meshlets, GLuint programId, const Frustum &frustum, const glm::vec4 &eye)
+{
+	GLint previousProgram = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+
+	const GLuint count = GLuint(meshlets.meshlets.size());
+	glUseProgram(programId);
+	glUniform4fv(glGetUniformLocation(programId, "frustumPlanes"), Frustum::PLANE_COUNT, &frustum.planes[0][0]);
+	glUniform4fv(glGetUniformLocation(programId, "eye"), 1, &eye[0]);
+	glUniform1ui(glGetUniformLocation(programId, "meshletCount"), count);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, meshlets.meshletBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, meshlets.commandBuffer);
+	glDispatchCompute((count + workGroupSize - 1) / workGroupSize, 1, 1);
+
+	// the commands are consumed as indirect draw arguments
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+	glUseProgram(GLuint(previousProgram));
+}
+
+void Meshlets::UDrawMeshlets(const GLMeshlets &meshlets, GLuint count)
+{
+	if (count == 0)
+		return;
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, meshlets.commandBuffer);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0, GLsizei(count), 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void Meshlets::UDrawMeshlets(const StreamBuffer::Allocation &commands, GLuint count)
+{
+	if (count == 0)
+		return;
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commands.buffer);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)commands.offset, GLsizei(count), 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
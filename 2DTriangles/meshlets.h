@@ -0,0 +1,96 @@
+///////////////////////////////////////////////////////////////////////////////
+// meshlets.h
+// ==========
+// split indexed triangle meshes into small clusters (meshlets) that can be
+// culled one by one before drawing
+//
+// Each meshlet has at most MAX_VERTICES unique vertices and MAX_TRIANGLES
+// triangles, a bounding sphere and a normal cone. Culling rejects meshlets
+// outside the frustum and meshlets whose triangles all face away from the
+// viewer, then the survivors are drawn with glMultiDrawElementsIndirect.
+// Culling runs either on the CPU or in a compute shader.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "meshes.h"
+#include "frustum.h"
+#include "streambuffer.h"
+
+class Meshlets
+{
+
+public:
+	static const GLuint MAX_VERTICES = 64;
+	static const GLuint MAX_TRIANGLES = 124;
+
+	// Bounds and index range of one cluster, laid out to match the
+	// std430 buffer read by the cull shader (64 bytes)
+	struct Meshlet
+	{
+		glm::vec3 center;		// bounding sphere in model space
+		float radius;
+		glm::vec3 coneAxis;		// average facing direction of the triangles
+		float coneCutoff;		// 1 when the triangles face too many ways to cull
+		glm::vec3 coneApex;
+		float padding;
+		GLuint firstIndex;		// range in the mesh index buffer
+		GLuint indexCount;
+		GLuint vertexCount;		// unique vertices referenced
+		GLuint padding2;
+	};
+
+	// Layout expected by glMultiDrawElementsIndirect
+	struct DrawElementsIndirectCommand
+	{
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+
+	// Meshlets of one mesh plus the GL buffers used to cull and draw them
+	struct GLMeshlets
+	{
+		std::vector<Meshlet> meshlets;
+		std::vector<DrawElementsIndirectCommand> commands;	// CPU culling output
+		GLuint meshletBuffer = 0;	// SSBO with the meshlets
+		GLuint commandBuffer = 0;	// one indirect command per meshlet
+	};
+
+public:
+	// Cluster the triangles of an indexed mesh, each meshlet covering a
+	// contiguous range of its index buffer
+	static std::vector<Meshlet> UBuildMeshlets(const Meshes::MeshData &data);
+
+	// Build meshlets for an uploaded indexed mesh along with the buffers
+	// used to cull and draw them. Returns false for non-indexed meshes.
+	static bool UCreateMeshlets(GLMeshlets &meshlets, const Meshes::GLMesh &mesh, const Meshes::MeshData &data);
+	static void UDestroyMeshlets(GLMeshlets &meshlets);
+
+	// CPU culling: frustum in model space (clip * model), eye is the model
+	// space camera position (w = 1) or view direction (w = 0, orthographic).
+	// Fills meshlets.commands with the visible meshlets and returns their
+	// count. The commands are written to the stream buffer, or to the
+	// command buffer when the ring is full, commands tells where.
+	static GLuint UCullMeshlets(GLMeshlets &meshlets, StreamBuffer::GLStreamBuffer &stream, const Frustum &frustum, const glm::vec4 &eye, StreamBuffer::Allocation &commands);
+
+	// GPU culling: writes one command per meshlet, culled ones with no instances
+	static bool UCreateCullProgram(GLuint &programId);
+	static void UCullMeshletsGPU(const GLMeshlets &meshlets, GLuint programId, const Frustum &frustum, const glm::vec4 &eye);
+
+	// Draw the first count commands of the command buffer, or of the range
+	// UCullMeshlets wrote, with the mesh VAO bound
+	static void UDrawMeshlets(const GLMeshlets &meshlets, GLuint count);
+	static void UDrawMeshlets(const StreamBuffer::Allocation &commands, GLuint count);
+
+	// Meshlet visibility test shared by the CPU path
+	static bool UIsMeshletVisible(const Meshlet &meshlet, const Frustum &frustum, const glm::vec4 &eye);
+};
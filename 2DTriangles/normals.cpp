@@ -0,0 +1,291 @@
+///////////////////////////////////////////////////////////////////////////////
+// normals.cpp
+// ===========
+// face and vertex normal computation for triangle meshes
+///////////////////////////////////////////////////////////////////////////////
+
+#include "normals.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+	///////////////////////////////////////////////////
+	//	Scalar kernels, also used for the tails of the
+	//	vector loops
+	///////////////////////////////////////////////////
+	void FaceNormalsScalar(const float *x, const float *y, const float *z, const GLuint *indices,
+		size_t begin, size_t end, float *nx, float *ny, float *nz)
+	{
+		for (size_t t = begin; t < end; t++)
+		{
+			const GLuint i0 = indices[t * 3 + 0];
+			const GLuint i1 = indices[t * 3 + 1];
+			const GLuint i2 = indices[t * 3 + 2];
+			glm::vec3 n = Normals::UTriangleNormal(
+				glm::vec3(x[i0], y[i0], z[i0]),
+				glm::vec3(x[i1], y[i1], z[i1]),
+				glm::vec3(x[i2], y[i2], z[i2]));
+			nx[t] = n.x;
+			ny[t] = n.y;
+			nz[t] = n.z;
+		}
+	}
+
+	void NormalizeScalar(float *x, float *y, float *z, size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			float length = std::sqrt(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+			if (length > 0.0f)
+			{
+				x[i] /= length;
+				y[i] /= length;
+				z[i] /= length;
+			}
+		}
+	}
+
+#if SIMD_X86
+	///////////////////////////////////////////////////
+	//	SSE kernels, 4 triangles / vectors per step
+	///////////////////////////////////////////////////
+	size_t FaceNormalsSSE(const float *x, const float *y, const float *z, const GLuint *indices,
+		size_t triangleCount, float *nx, float *ny, float *nz)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		size_t t = 0;
+		for (; t + 4 <= triangleCount; t += 4)
+		{
+			const GLuint *tri = indices + t * 3;
+			__m128 p0x = _mm_setr_ps(x[tri[0]], x[tri[3]], x[tri[6]], x[tri[9]]);
+			__m128 p0y = _mm_setr_ps(y[tri[0]], y[tri[3]], y[tri[6]], y[tri[9]]);
+			__m128 p0z = _mm_setr_ps(z[tri[0]], z[tri[3]], z[tri[6]], z[tri[9]]);
+			__m128 e1x = _mm_sub_ps(_mm_setr_ps(x[tri[1]], x[tri[4]], x[tri[7]], x[tri[10]]), p0x);
+			__m128 e1y = _mm_sub_ps(_mm_setr_ps(y[tri[1]], y[tri[4]], y[tri[7]], y[tri[10]]), p0y);
+			__m128 e1z = _mm_sub_ps(_mm_setr_ps(z[tri[1]], z[tri[4]], z[tri[7]], z[tri[10]]), p0z);
+			__m128 e2x = _mm_sub_ps(_mm_setr_ps(x[tri[2]], x[tri[5]], x[tri[8]], x[tri[11]]), p0x);
+			__m128 e2y = _mm_sub_ps(_mm_setr_ps(y[tri[2]], y[tri[5]], y[tri[8]], y[tri[11]]), p0y);
+			__m128 e2z = _mm_sub_ps(_mm_setr_ps(z[tri[2]], z[tri[5]], z[tri[8]], z[tri[11]]), p0z);
+
+			// n = e1 x e2
+			__m128 cx = _mm_sub_ps(_mm_mul_ps(e1y, e2z), _mm_mul_ps(e1z, e2y));
+			__m128 cy = _mm_sub_ps(_mm_mul_ps(e1z, e2x), _mm_mul_ps(e1x, e2z));
+			__m128 cz = _mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e1y, e2x));
+
+			__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy)), _mm_mul_ps(cz, cz)));
+			__m128 valid = _mm_cmpgt_ps(length, zero);
+			__m128 inverse = _mm_and_ps(_mm_div_ps(_mm_set1_ps(1.0f), length), valid);
+
+			_mm_storeu_ps(nx + t, _mm_mul_ps(cx, inverse));
+			_mm_storeu_ps(ny + t, _mm_mul_ps(cy, inverse));
+			_mm_storeu_ps(nz + t, _mm_mul_ps(cz, inverse));
+		}
+		return t;
+	}
+
+	size_t NormalizeSSE(float *x, float *y, float *z, size_t count)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 vx = _mm_loadu_ps(x + i);
+			__m128 vy = _mm_loadu_ps(y + i);
+			__m128 vz = _mm_loadu_ps(z + i);
+			__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz)));
+			__m128 valid = _mm_cmpgt_ps(length, zero);
+			__m128 inverse = _mm_div_ps(_mm_set1_ps(1.0f), length);
+
+			// zero length vectors keep their (zero) value
+			_mm_storeu_ps(x + i, _mm_or_ps(_mm_and_ps(valid, _mm_mul_ps(vx, inverse)), _mm_andnot_ps(valid, vx)));
+			_mm_storeu_ps(y + i, _mm_or_ps(_mm_and_ps(valid, _mm_mul_ps(vy, inverse)), _mm_andnot_ps(valid, vy)));
+			_mm_storeu_ps(z + i, _mm_or_ps(_mm_and_ps(valid, _mm_mul_ps(vz, inverse)), _mm_andnot_ps(valid, vz)));
+		}
+		return i;
+	}
+
+	///////////////////////////////////////////////////
+	//	AVX2 kernels, 8 triangles / vectors per step
+	//	using hardware gathers for the indexed loads
+	///////////////////////////////////////////////////
+	SIMD_TARGET_AVX2 size_t FaceNormalsAVX2(const float *x, const float *y, const float *z, const GLuint *indices,
+		size_t triangleCount, float *nx, float *ny, float *nz)
+	{
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256i cornerOffsets = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+		size_t t = 0;
+		for (; t + 8 <= triangleCount; t += 8)
+		{
+			const int *tri = reinterpret_cast<const int *>(indices + t * 3);
+			__m256i i0 = _mm256_i32gather_epi32(tri + 0, cornerOffsets, 4);
+			__m256i i1 = _mm256_i32gather_epi32(tri + 1, cornerOffsets, 4);
+			__m256i i2 = _mm256_i32gather_epi32(tri + 2, cornerOffsets, 4);
+
+			__m256 p0x = _mm256_i32gather_ps(x, i0, 4);
+			__m256 p0y = _mm256_i32gather_ps(y, i0, 4);
+			__m256 p0z = _mm256_i32gather_ps(z, i0, 4);
+			__m256 e1x = _mm256_sub_ps(_mm256_i32gather_ps(x, i1, 4), p0x);
+			__m256 e1y = _mm256_sub_ps(_mm256_i32gather_ps(y, i1, 4), p0y);
+			__m256 e1z = _mm256_sub_ps(_mm256_i32gather_ps(z, i1, 4), p0z);
+			__m256 e2x = _mm256_sub_ps(_mm256_i32gather_ps(x, i2, 4), p0x);
+			__m256 e2y = _mm256_sub_ps(_mm256_i32gather_ps(y, i2, 4), p0y);
+			__m256 e2z = _mm256_sub_ps(_mm256_i32gather_ps(z, i2, 4), p0z);
+
+			__m256 cx = _mm256_sub_ps(_mm256_mul_ps(e1y, e2z), _mm256_mul_ps(e1z, e2y));
+			__m256 cy = _mm256_sub_ps(_mm256_mul_ps(e1z, e2x), _mm256_mul_ps(e1x, e2z));
+			__m256 cz = _mm256_sub_ps(_mm256_mul_ps(e1x, e2y), _mm256_mul_ps(e1y, e2x));
+
+			__m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, cx), _mm256_mul_ps(cy, cy)), _mm256_mul_ps(cz, cz)));
+			__m256 valid = _mm256_cmp_ps(length, zero, _CMP_GT_OQ);
+			__m256 inverse = _mm256_and_ps(_mm256_div_ps(_mm256_set1_ps(1.0f), length), valid);
+
+			_mm256_storeu_ps(nx + t, _mm256_mul_ps(cx, inverse));
+			_mm256_storeu_ps(ny + t, _mm256_mul_ps(cy, inverse));
+			_mm256_storeu_ps(nz + t, _mm256_mul_ps(cz, inverse));
+		}
+		return t;
+	}
+
+	SIMD_TARGET_AVX2 size_t NormalizeAVX2(float *x, float *y, float *z, size_t count)
+	{
+		const __m256 zero = _mm256_setzero_ps();
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 vx = _mm256_loadu_ps(x + i);
+			__m256 vy = _mm256_loadu_ps(y + i);
+			__m256 vz = _mm256_loadu_ps(z + i);
+			__m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy)), _mm256_mul_ps(vz, vz)));
+			__m256 valid = _mm256_cmp_ps(length, zero, _CMP_GT_OQ);
+			__m256 inverse = _mm256_div_ps(_mm256_set1_ps(1.0f), length);
+
+			_mm256_storeu_ps(x + i, _mm256_blendv_ps(vx, _mm256_mul_ps(vx, inverse), valid));
+			_mm256_storeu_ps(y + i, _mm256_blendv_ps(vy, _mm256_mul_ps(vy, inverse), valid));
+			_mm256_storeu_ps(z + i, _mm256_blendv_ps(vz, _mm256_mul_ps(vz, inverse), valid));
+		}
+		return i;
+	}
+#endif
+
+	// Angle between the edges leaving corner p towards a and b
+	float CornerAngle(const glm::vec3 &p, const glm::vec3 &a, const glm::vec3 &b)
+	{
+		glm::vec3 u = a - p;
+		glm::vec3 v = b - p;
+		float lengths = glm::length(u) * glm::length(v);
+		if (lengths == 0.0f)
+			return 0.0f;
+		return std::acos(std::min(std::max(glm::dot(u, v) / lengths, -1.0f), 1.0f));
+	}
+}
+
+///////////////////////////////////////////////////
+//	UTriangleNormal(p0, p1, p2)
+//
+//	Cross product of the two edges leaving p0,
+//	normalized. Degenerate triangles give zero.
+///////////////////////////////////////////////////
+glm::vec3 Normals::UTriangleNormal(const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2)
+{
+	glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+	float length = glm::length(normal);
+	if (length == 0.0f)
+		return glm::vec3(0.0f);
+	return normal / length;
+}
+
+void Normals::UFaceNormals(const float *x, const float *y, const float *z,
+	const GLuint *indices, size_t triangleCount,
+	float *nx, float *ny, float *nz)
+{
+	size_t done = 0;
+#if SIMD_X86
+	switch (Simd::UInstructionSet())
+	{
+	case Simd::INSTRUCTIONS_AVX2:
+		done = FaceNormalsAVX2(x, y, z, indices, triangleCount, nx, ny, nz);
+		break;
+	case Simd::INSTRUCTIONS_SSE:
+		done = FaceNormalsSSE(x, y, z, indices, triangleCount, nx, ny, nz);
+		break;
+	default:
+		break;
+	}
+#endif
+	FaceNormalsScalar(x, y, z, indices, done, triangleCount, nx, ny, nz);
+}
+
+void Normals::UNormalize(float *x, float *y, float *z, size_t count)
+{
+	size_t done = 0;
+#if SIMD_X86
+	switch (Simd::UInstructionSet())
+	{
+	case Simd::INSTRUCTIONS_AVX2:
+		done = NormalizeAVX2(x, y, z, count);
+		break;
+	case Simd::INSTRUCTIONS_SSE:
+		done = NormalizeSSE(x, y, z, count);
+		break;
+	default:
+		break;
+	}
+#endif
+	NormalizeScalar(x, y, z, done, count);
+}
+
+///////////////////////////////////////////////////
+//	UVertexNormals(...)
+//
+//	Batch the face normals, scatter them into the
+//	(welded) vertices weighted by corner angle,
+//	then batch normalize the sums
+///////////////////////////////////////////////////
+void Normals::UVertexNormals(const float *x, const float *y, const float *z, size_t vertexCount,
+	const GLuint *indices, size_t triangleCount, const GLuint *weld,
+	float *nx, float *ny, float *nz)
+{
+	std::vector<float> faceX(triangleCount);
+	std::vector<float> faceY(triangleCount);
+	std::vector<float> faceZ(triangleCount);
+	UFaceNormals(x, y, z, indices, triangleCount, faceX.data(), faceY.data(), faceZ.data());
+
+	std::fill(nx, nx + vertexCount, 0.0f);
+	std::fill(ny, ny + vertexCount, 0.0f);
+	std::fill(nz, nz + vertexCount, 0.0f);
+
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		const GLuint *tri = indices + t * 3;
+		const glm::vec3 corners[3] = {
+			glm::vec3(x[tri[0]], y[tri[0]], z[tri[0]]),
+			glm::vec3(x[tri[1]], y[tri[1]], z[tri[1]]),
+			glm::vec3(x[tri[2]], y[tri[2]], z[tri[2]])
+		};
+		for (int k = 0; k < 3; k++)
+		{
+			float angle = CornerAngle(corners[k], corners[(k + 1) % 3], corners[(k + 2) % 3]);
+			GLuint target = weld ? weld[tri[k]] : tri[k];
+			nx[target] += faceX[t] * angle;
+			ny[target] += faceY[t] * angle;
+			nz[target] += faceZ[t] * angle;
+		}
+	}
+
+	UNormalize(nx, ny, nz, vertexCount);
+
+	// welded vertices take the normal accumulated on their representative
+	if (weld)
+	{
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			nx[v] = nx[weld[v]];
+			ny[v] = ny[weld[v]];
+			nz[v] = nz[weld[v]];
+		}
+	}
+}
@@ -0,0 +1,42 @@
+///////////////////////////////////////////////////////////////////////////////
+// normals.h
+// =========
+// face and vertex normal computation for triangle meshes
+//
+// Positions and normals are passed as separate x, y and z arrays (SoA) so
+// the batched kernels can process 8 (AVX2) or 4 (SSE) triangles per step,
+// with a scalar fallback chosen at runtime through simd.h.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+class Normals
+{
+
+public:
+	// Unit normal of a counter-clockwise triangle, zero when degenerate
+	static glm::vec3 UTriangleNormal(const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2);
+
+	// Unit normal of every triangle in an index list
+	static void UFaceNormals(const float *x, const float *y, const float *z,
+		const GLuint *indices, size_t triangleCount,
+		float *nx, float *ny, float *nz);
+
+	// Smooth vertex normals: each triangle contributes its face normal
+	// weighted by the angle at the corner. Vertices mapping to the same
+	// weld index share one normal, which smooths across UV seams; the
+	// weld target of a vertex must map to itself. Pass NULL for weld to
+	// treat every vertex separately.
+	static void UVertexNormals(const float *x, const float *y, const float *z, size_t vertexCount,
+		const GLuint *indices, size_t triangleCount, const GLuint *weld,
+		float *nx, float *ny, float *nz);
+
+	// Normalize count vectors in place, zero length vectors stay zero
+	static void UNormalize(float *x, float *y, float *z, size_t count);
+};
@@ -0,0 +1,96 @@
+///////////////////////////////////////////////////////////////////////////////
+// renderthread.cpp
+// ================
+// a thread owning the GL context, fed with frame packets by the main thread
+///////////////////////////////////////////////////////////////////////////////
+
+#include "renderthread.h"
+
+namespace
+{
+	void Push(RenderThread::SlotQueue &queue, int slot)
+	{
+		queue.slots[(queue.first + queue.count) % RenderThread::PACKET_COUNT] = slot;
+		queue.count++;
+	}
+
+	int Pop(RenderThread::SlotQueue &queue)
+	{
+		int slot = queue.slots[queue.first];
+		queue.first = (queue.first + 1) % RenderThread::PACKET_COUNT;
+		queue.count--;
+		return slot;
+	}
+
+	void RenderLoop(RenderThread::Thread &thread, GLFWwindow *window, std::function<void(int)> render)
+	{
+		glfwMakeContextCurrent(window);
+
+		std::unique_lock<std::mutex> lock(thread.mutex);
+		for (;;)
+		{
+			thread.changed.wait(lock, [&thread]() { return thread.submitted.count > 0 || thread.stopping; });
+			if (thread.submitted.count == 0)
+				break;
+
+			int slot = Pop(thread.submitted);
+			lock.unlock();
+
+			render(slot);
+
+			lock.lock();
+			Push(thread.free, slot);
+			thread.changed.notify_all();
+		}
+
+		glfwMakeContextCurrent(NULL);
+	}
+}
+
+void RenderThread::UStart(Thread &thread, GLFWwindow *window, std::function<void(int)> render)
+{
+	thread.free = SlotQueue();
+	thread.submitted = SlotQueue();
+	for (int slot = 0; slot < PACKET_COUNT; slot++)
+		Push(thread.free, slot);
+	thread.stopping = false;
+	thread.running = true;
+
+	glfwMakeContextCurrent(NULL);
+	thread.thread = std::thread(RenderLoop, std::ref(thread), window, render);
+}
+
+void RenderThread::UStop(Thread &thread, GLFWwindow *window)
+{
+	if (!thread.running)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(thread.mutex);
+		thread.stopping = true;
+	}
+	thread.changed.notify_all();
+	thread.thread.join();
+	thread.running = false;
+
+	glfwMakeContextCurrent(window);
+}
+
+int RenderThread::UAcquire(Thread &thread)
+{
+	std::unique_lock<std::mutex> lock(thread.mutex);
+	if (thread.free.count == 0)
+		thread.waits++;
+	thread.changed.wait(lock, [&thread]() { return thread.free.count > 0; });
+
+	return Pop(thread.free);
+}
+
+void RenderThread::USubmit(Thread &thread, int slot)
+{
+	{
+		std::lock_guard<std::mutex> lock(thread.mutex);
+		Push(thread.submitted, slot);
+	}
+	thread.changed.notify_all();
+}
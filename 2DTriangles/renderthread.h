@@ -0,0 +1,69 @@
+///////////////////////////////////////////////////////////////////////////////
+// renderthread.h
+// ==============
+// a thread owning the GL context, fed with frame packets by the main thread
+//
+// The caller keeps PACKET_COUNT frame packets, everything one frame needs to
+// be drawn (matrices, draw list, settings), and only the slot numbers move
+// between the threads. The main thread acquires a free slot, fills it and
+// submits it; the render thread draws submitted slots in order and hands
+// them back. With three slots the main thread can build frame N + 1 while
+// frame N waits and frame N - 1 is being submitted to GL, and it blocks
+// when it gets that far ahead.
+//
+// A submitted packet belongs to the render thread until it is handed back,
+// so neither side needs a lock around its contents. The slot queues are
+// fixed rings, handing a slot over never allocates.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GLFW/glfw3.h>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+class RenderThread
+{
+
+public:
+	static const int PACKET_COUNT = 3;
+
+	// First in, first out, every slot is in at most one queue
+	struct SlotQueue
+	{
+		int slots[PACKET_COUNT];
+		int first = 0;
+		int count = 0;
+	};
+
+	struct Thread
+	{
+		std::thread thread;
+		std::mutex mutex;
+		std::condition_variable changed;
+		SlotQueue free;			// slots the main thread may fill
+		SlotQueue submitted;	// slots waiting for the render thread, oldest first
+		bool stopping = false;
+		bool running = false;
+
+		unsigned long long waits = 0;	// times the main thread found no free slot
+	};
+
+public:
+	// Release the window's context on the calling thread and start a thread
+	// that makes it current and calls render(slot) for every submitted slot
+	static void UStart(Thread &thread, GLFWwindow *window, std::function<void(int)> render);
+
+	// Render what is still submitted, stop the thread and make the context
+	// current on the calling thread again
+	static void UStop(Thread &thread, GLFWwindow *window);
+
+	// Next free slot, waits while every slot is in flight
+	static int UAcquire(Thread &thread);
+
+	// Queue a filled slot for rendering
+	static void USubmit(Thread &thread, int slot);
+};
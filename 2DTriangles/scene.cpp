@@ -0,0 +1,257 @@
+///////////////////////////////////////////////////////////////////////////////
+// scene.cpp
+// =========
+// the list of objects drawn every frame and their world space bounds
+///////////////////////////////////////////////////////////////////////////////
+
+#include "scene.h"
+
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+	const size_t floatsPerInterleavedVertex = 8;
+
+	// Moller-Trumbore, returns the distance along the ray or a negative
+	// value. Both faces count as hits.
+	float RayTriangleDistance(const glm::vec3 &origin, const glm::vec3 &direction,
+		const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2)
+	{
+		const float epsilon = 1e-8f;
+		glm::vec3 edge1 = p1 - p0;
+		glm::vec3 edge2 = p2 - p0;
+		glm::vec3 p = glm::cross(direction, edge2);
+		float determinant = glm::dot(edge1, p);
+		if (std::fabs(determinant) < epsilon)
+			return -1.0f;
+
+		float inverseDeterminant = 1.0f / determinant;
+		glm::vec3 s = origin - p0;
+		float u = glm::dot(s, p) * inverseDeterminant;
+		if (u < 0.0f || u > 1.0f)
+			return -1.0f;
+
+		glm::vec3 q = glm::cross(s, edge1);
+		float v = glm::dot(direction, q) * inverseDeterminant;
+		if (v < 0.0f || u + v > 1.0f)
+			return -1.0f;
+
+		return glm::dot(edge2, q) * inverseDeterminant;
+	}
+}
+
+Scene::Scene() : mHierarchical(true), mVersion(0)
+{
+	Entities::UCreateWorld(mWorld);
+}
+
+Scene::~Scene()
+{
+	if (!mParams.empty())
+		std::cerr << "Scene destroyed with " << mParams.size() << " meshes still acquired" << std::endl;
+	Entities::UDestroyWorld(mWorld);
+}
+
+///////////////////////////////////////////////////
+//	Create(MeshCache&, GLMaterials&, const SceneNode*, size_t, VertexFormat)
+//
+//	Acquire a shared mesh for every node, nodes
+//	with the same shape share one GLMesh, and the
+//	same color and texture one material
+///////////////////////////////////////////////////
+bool Scene::Create(MeshCache &cache, Materials::GLMaterials &materials, const SceneNode *nodes, size_t count, Meshes::VertexFormat format)
+{
+	mNodes.assign(nodes, nodes + count);
+	mParams.resize(count);
+	mInverseModels.resize(count);
+	mEntities.resize(count);
+	mVisible.assign(count, 1);
+	Entities::UReserve(mWorld, NODE_COMPONENTS, count);
+	std::vector<std::uint32_t> materialIds(count);
+
+	// all meshes in one go, so the cache builds the missing ones in parallel
+	std::vector<const Meshes::GLMesh *> glMeshes(count);
+	for (size_t i = 0; i < count; i++)
+		mParams[i] = MeshCache::MeshParams::Make(mNodes[i].shape, format);
+	cache.Acquire(mParams.data(), count, glMeshes.data());
+
+	// nodes are drawn and picked as indexed triangle lists, the strip and fan
+	// generators have no indices
+	for (size_t i = 0; i < count; i++)
+	{
+		if (glMeshes[i]->nIndices == 0)
+		{
+			std::cerr << "Scene node " << mNodes[i].name << " has a mesh without indices" << std::endl;
+			Destroy(cache);
+			return false;
+		}
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		// keep one CPU copy of the triangles per distinct mesh
+		size_t pick = 0;
+		while (pick < mPickMeshes.size() && !(mPickMeshes[pick].params == mParams[i]))
+			pick++;
+		if (pick == mPickMeshes.size())
+		{
+			const Meshes::MeshData &data = *cache.Data(mParams[i]);
+			PickMesh mesh;
+			mesh.params = mParams[i];
+			size_t vertexCount = data.verts.size() / floatsPerInterleavedVertex;
+			mesh.positions.resize(vertexCount);
+			for (size_t v = 0; v < vertexCount; v++)
+			{
+				const GLfloat *vert = &data.verts[v * floatsPerInterleavedVertex];
+				mesh.positions[v] = glm::vec3(vert[0], vert[1], vert[2]);
+			}
+			mesh.indices = data.indices;
+			mPickMeshes.push_back(mesh);
+		}
+
+		const SceneNode &node = mNodes[i];
+		Entities::MeshRef meshRef;
+		meshRef.mesh = glMeshes[i];
+		meshRef.pick = std::uint32_t(pick);
+		Materials::Material material;
+		material.color = node.color;
+		if (node.texture != SCENE_TEXTURE_NONE)
+			material.textureLayer = GLint(node.texture - SCENE_TEXTURE_CASE);
+		materialIds[i] = Materials::UAdd(materials, material);
+
+		mEntities[i] = Entities::UCreate(mWorld, NODE_COMPONENTS);
+		Entities::USetMesh(mWorld, mEntities[i], meshRef);
+		Entities::USetTransform(mWorld, mEntities[i], node.position, Transforms::UAxisRotation(glm::radians(node.angle), node.axis), node.scale);
+	}
+
+	// material IDs are only final once sorted
+	Materials::USort(materials, materialIds.data(), count);
+	for (size_t i = 0; i < count; i++)
+	{
+		Entities::Material material;
+		material.id = materialIds[i];
+		Entities::USetMaterial(mWorld, mEntities[i], material);
+	}
+
+	// every model matrix and world box in one batch
+	Entities::UUpdateTransforms(mWorld.archetypes[NODE_COMPONENTS], 0, count);
+	for (size_t i = 0; i < count; i++)
+		PlaceNode(i);
+
+	std::vector<glm::vec3> boxMin(count), boxMax(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		boxMin[i] = BoundsCenter(i) - BoundsExtent(i);
+		boxMax[i] = BoundsCenter(i) + BoundsExtent(i);
+	}
+	mBvh.Build(boxMin.data(), boxMax.data(), count);
+	return true;
+}
+
+void Scene::Destroy(MeshCache &cache)
+{
+	for (size_t i = 0; i < mParams.size(); i++)
+		cache.Release(mParams[i]);
+
+	mNodes.clear();
+	mParams.clear();
+	mInverseModels.clear();
+	Entities::UDestroyWorld(mWorld);
+	mEntities.clear();
+	mPickMeshes.clear();
+	mVisible.clear();
+	mBvh.Build(NULL, NULL, 0);
+}
+
+void Scene::UpdateNode(size_t index)
+{
+	const SceneNode &node = mNodes[index];
+	Entities::USetTransform(mWorld, mEntities[index], node.position, Transforms::UAxisRotation(glm::radians(node.angle), node.axis), node.scale);
+	Entities::UUpdateTransforms(mWorld.archetypes[NODE_COMPONENTS], index, 1);
+	PlaceNode(index);
+
+	// moved nodes only refit the hierarchy, Create() builds it once
+	if (!mBvh.Empty())
+		mBvh.Refit(index, BoundsCenter(index) - BoundsExtent(index), BoundsCenter(index) + BoundsExtent(index));
+}
+
+void Scene::PlaceNode(size_t index)
+{
+	mInverseModels[index] = glm::inverse(Nodes().models[index]);
+	mVersion++;
+}
+
+size_t Scene::Cull(const Frustum &frustum)
+{
+	if (mNodes.empty())
+		return 0;
+
+	if (mHierarchical && !mBvh.Empty())
+		return mBvh.Cull(frustum, mVisible.data());
+
+	return Entities::UCull(Nodes(), frustum, 0, mNodes.size(), mVisible.data());
+}
+
+size_t Scene::Cull(const Frustum &frustum, std::vector<unsigned char> &visible) const
+{
+	visible.resize(mNodes.size());
+	if (mNodes.empty())
+		return 0;
+
+	return Cull(frustum, 0, mNodes.size(), visible.data());
+}
+
+size_t Scene::Cull(const Frustum &frustum, size_t first, size_t count, unsigned char *visible) const
+{
+	return Entities::UCull(Nodes(), frustum, first, count, visible);
+}
+
+glm::vec3 Scene::BoundsCenter(size_t index) const
+{
+	const Entities::Archetype &nodes = Nodes();
+	return glm::vec3(nodes.centerX[index], nodes.centerY[index], nodes.centerZ[index]);
+}
+
+glm::vec3 Scene::BoundsExtent(size_t index) const
+{
+	const Entities::Archetype &nodes = Nodes();
+	return glm::vec3(nodes.extentX[index], nodes.extentY[index], nodes.extentZ[index]);
+}
+
+///////////////////////////////////////////////////
+//	Raycast(const glm::vec3&, const glm::vec3&, size_t&, float&)
+//
+//	The ray is moved into each candidate's model
+//	space without renormalizing, so distances stay
+//	in world units
+///////////////////////////////////////////////////
+bool Scene::Raycast(const glm::vec3 &origin, const glm::vec3 &direction, size_t &node, float &distance) const
+{
+	std::uint32_t item;
+	if (!mBvh.Raycast(origin, direction, 1e30f, URayNodeDistance, const_cast<Scene *>(this), item, distance))
+		return false;
+
+	node = item;
+	return true;
+}
+
+float Scene::URayNodeDistance(void *context, std::uint32_t node,
+	const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance)
+{
+	const Scene &scene = *static_cast<const Scene *>(context);
+	const PickMesh &mesh = scene.mPickMeshes[scene.Nodes().meshes[node].pick];
+	const glm::mat4 &inverseModel = scene.mInverseModels[node];
+	glm::vec3 localOrigin = glm::vec3(inverseModel * glm::vec4(origin, 1.0f));
+	glm::vec3 localDirection = glm::vec3(inverseModel * glm::vec4(direction, 0.0f));
+
+	float closest = -1.0f;
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+	{
+		float t = RayTriangleDistance(localOrigin, localDirection,
+			mesh.positions[mesh.indices[i]], mesh.positions[mesh.indices[i + 1]], mesh.positions[mesh.indices[i + 2]]);
+		if (t >= 0.0f && t <= maxDistance && (closest < 0.0f || t < closest))
+			closest = t;
+	}
+	return closest;
+}
@@ -0,0 +1,147 @@
+///////////////////////////////////////////////////////////////////////////////
+// scene.h
+// =======
+// the list of objects drawn every frame and their world space bounds
+//
+// Every node names a cached mesh, a transform and a surface. The scene owns
+// an entity world and every node is an entity with a transform, a mesh, a
+// material and world bounds, so the node data lives in the dense arrays of
+// that one archetype, in node order: row i is node i. The bounds arrays are
+// SoA centers and extents so the frustum test can run over many nodes at
+// once, and the bounds are also kept in a BVH so whole groups of nodes (a
+// row of keys) can be accepted or rejected with one test. Only the nodes
+// that pass are drawn. Other objects, like the point lights, are entities
+// of the same world with other components.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "meshes.h"
+#include "meshcache.h"
+#include "frustum.h"
+#include "bvh.h"
+#include "entities.h"
+#include "materials.h"
+
+// Which of the loaded textures a node samples, the textures are the layers
+// of the material texture array in this order
+enum SceneTexture
+{
+	SCENE_TEXTURE_NONE,
+	SCENE_TEXTURE_CASE,
+	SCENE_TEXTURE_LOGO
+};
+
+// Description of one drawn object
+struct SceneNode
+{
+	const char *name;
+	MeshCache::Shape shape;
+	glm::vec3 scale;
+	float angle;			// rotation in degrees around axis
+	glm::vec3 axis;
+	glm::vec3 position;
+	glm::vec4 color;		// used when texture is SCENE_TEXTURE_NONE
+	SceneTexture texture;
+};
+
+class Scene
+{
+
+public:
+	static const Entities::Mask NODE_COMPONENTS = Entities::COMPONENT_TRANSFORM | Entities::COMPONENT_MESH
+		| Entities::COMPONENT_MATERIAL | Entities::COMPONENT_BOUNDS;
+
+	Scene();
+	~Scene();
+
+	// Acquire the meshes of every node from the cache, add their materials
+	// to materials and place the nodes. Fails when a mesh is not indexed.
+	// Must be called on the thread that owns the GL context, before the
+	// materials are uploaded.
+	bool Create(MeshCache &cache, Materials::GLMaterials &materials, const SceneNode *nodes, size_t count, Meshes::VertexFormat format);
+
+	// Release the meshes acquired by Create()
+	void Destroy(MeshCache &cache);
+
+	// Recompute the transform and world bounds after a node was moved
+	void UpdateNode(size_t index);
+
+	// Mark the nodes touching the frustum visible, returns how many are
+	size_t Cull(const Frustum &frustum);
+
+	// Same test into caller owned flags, one per node. Tests every node
+	// without the BVH and changes nothing, so it may run on another thread.
+	size_t Cull(const Frustum &frustum, std::vector<unsigned char> &visible) const;
+
+	// Same test for nodes first .. first + count - 1 only, visible holds count flags
+	size_t Cull(const Frustum &frustum, size_t first, size_t count, unsigned char *visible) const;
+
+	// Cull through the BVH (default) or by testing every node
+	void SetHierarchicalCulling(bool enabled) { mHierarchical = enabled; }
+	bool HierarchicalCulling() const { return mHierarchical; }
+	const Bvh &Hierarchy() const { return mBvh; }
+
+	size_t Count() const { return mNodes.size(); }
+	const SceneNode &Node(size_t index) const { return mNodes[index]; }
+	SceneNode &Node(size_t index) { return mNodes[index]; }
+	const Meshes::GLMesh &Mesh(size_t index) const { return *Nodes().meshes[index].mesh; }
+	const MeshCache::MeshParams &Params(size_t index) const { return mParams[index]; }
+	const glm::mat4 &Model(size_t index) const { return Nodes().models[index]; }
+	std::uint32_t Material(size_t index) const { return Nodes().materials[index].id; }
+	bool IsVisible(size_t index) const { return mVisible[index] != 0; }
+
+	// Changes whenever a node is placed, so caches of rendered data know to refresh
+	unsigned long long Version() const { return mVersion; }
+
+	// Closest node hit by origin + t * direction, found through the BVH and
+	// then tested exactly against the triangles of the candidate meshes
+	bool Raycast(const glm::vec3 &origin, const glm::vec3 &direction, size_t &node, float &distance) const;
+
+	// World space bounding box of a node as center and half extent
+	glm::vec3 BoundsCenter(size_t index) const;
+	glm::vec3 BoundsExtent(size_t index) const;
+
+	// Entities of the scene. More may be created, but none with
+	// NODE_COMPONENTS, that archetype holds the nodes.
+	Entities::World &World() { return mWorld; }
+	const Entities::World &World() const { return mWorld; }
+	const Entities::Archetype &Nodes() const { return mWorld.archetypes[NODE_COMPONENTS]; }
+
+private:
+	// CPU copy of a mesh's triangles for exact ray tests
+	struct PickMesh
+	{
+		MeshCache::MeshParams params;
+		std::vector<glm::vec3> positions;
+		std::vector<GLuint> indices;
+	};
+
+	// Inverse model of a node from its model matrix
+	void PlaceNode(size_t index);
+
+	static float URayNodeDistance(void *context, std::uint32_t node,
+		const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance);
+
+	std::vector<SceneNode> mNodes;
+	std::vector<MeshCache::MeshParams> mParams;		// of every acquired mesh
+	std::vector<glm::mat4> mInverseModels;
+
+	Entities::World mWorld;
+	std::vector<Entities::Entity> mEntities;		// of every node
+
+	std::vector<PickMesh> mPickMeshes;
+	std::vector<unsigned char> mVisible;
+
+	Bvh mBvh;
+	bool mHierarchical;
+	unsigned long long mVersion;
+};
@@ -0,0 +1,268 @@
+///////////////////////////////////////////////////////////////////////////////
+// shadows.cpp
+// ===========
+// cascaded shadow maps for the two scene lights
+///////////////////////////////////////////////////////////////////////////////
+
+#include "shadows.h"
+
+#include <glm/gtx/transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+	// Blend of logarithmic and uniform split distances, 1 is fully logarithmic
+	const float splitBlend = 0.5f;
+
+	// Cascades are fitted this much larger than needed so small camera moves
+	// stay inside the cached map
+	const float cascadeMargin = 1.25f;
+
+	// Light view depth range holding every node, so casters between the
+	// light and the camera view are never clipped away
+	void FitLightDepth(Shadows::GLShadows &shadows, const Scene &scene, int light)
+	{
+		float nearest = 1e30f;
+		float farthest = -1e30f;
+		for (size_t i = 0; i < scene.Count(); i++)
+		{
+			glm::vec3 center = scene.BoundsCenter(i);
+			glm::vec3 extent = scene.BoundsExtent(i);
+			for (int corner = 0; corner < 8; corner++)
+			{
+				glm::vec3 position = center + glm::vec3((corner & 1) ? extent.x : -extent.x,
+					(corner & 2) ? extent.y : -extent.y,
+					(corner & 4) ? extent.z : -extent.z);
+				float depth = -(shadows.lightViews[light] * glm::vec4(position, 1.0f)).z;
+				nearest = std::min(nearest, depth);
+				farthest = std::max(farthest, depth);
+			}
+		}
+		shadows.lightNear[light] = nearest - 1.0f;
+		shadows.lightFar[light] = farthest + 1.0f;
+	}
+
+	// Draw the nodes touching a cascade into its layer
+	void DrawCascade(Shadows::GLShadows &shadows, const Scene &scene, const glm::mat4 &lightView, const glm::mat4 &lightProjection, int layer)
+	{
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadows.texture, 0, layer);
+		glClear(GL_DEPTH_BUFFER_BIT);
+
+		glUniformMatrix4fv(shadows.depth.viewLoc, 1, GL_FALSE, glm::value_ptr(lightView));
+		glUniformMatrix4fv(shadows.depth.projectionLoc, 1, GL_FALSE, glm::value_ptr(lightProjection));
+
+		scene.Cull(Frustum(lightProjection * lightView), shadows.casters);
+		for (size_t i = 0; i < scene.Count(); i++)
+		{
+			if (shadows.casters[i])
+				DepthPrepass::UDrawDepth(shadows.depth, scene.Mesh(i), scene.Model(i));
+		}
+		shadows.cascadesDrawn++;
+	}
+}
+
+///////////////////////////////////////////////////
+//	UCreateShadows(GLShadows&)
+//
+//	One depth array for every cascade of every
+//	light, compared in hardware when sampled
+///////////////////////////////////////////////////
+bool Shadows::UCreateShadows(GLShadows &shadows)
+{
+	if (!DepthPrepass::UCreateDepthPrepass(shadows.depth))
+		return false;
+
+	glGenTextures(1, &shadows.texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, shadows.texture);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT32F, MAP_SIZE, MAP_SIZE, LIGHT_COUNT * CASCADE_COUNT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+	// outside a map counts as lit
+	const GLfloat border[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	glGenFramebuffers(1, &shadows.framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, shadows.framebuffer);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadows.texture, 0, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cerr << "Shadow map framebuffer incomplete: 0x" << std::hex << status << std::dec << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void Shadows::UDestroyShadows(GLShadows &shadows)
+{
+	DepthPrepass::UDestroyDepthPrepass(shadows.depth);
+	glDeleteTextures(1, &shadows.texture);
+	glDeleteFramebuffers(1, &shadows.framebuffer);
+	shadows = GLShadows();
+}
+
+void Shadows::UInvalidate(GLShadows &shadows)
+{
+	shadows.lightsValid = false;
+}
+
+///////////////////////////////////////////////////
+//	UUpdate(GLShadows&, Scene&, const glm::vec3*, const glm::vec3&, const glm::mat4&, const glm::mat4&, float)
+//
+//	Every cascade is fitted to a bounding sphere of
+//	its slice of the view, so turning the camera does
+//	not change its size. The sphere is compared with
+//	the area the cached map covers and the map is only
+//	drawn again when the sphere sticks out of it or
+//	is much smaller. New areas are snapped to whole
+//	texels so static shadows do not shimmer.
+///////////////////////////////////////////////////
+void Shadows::UUpdate(GLShadows &shadows, const Scene &scene, const glm::vec3 lightPositions[LIGHT_COUNT], const glm::vec3 &target,
+	const glm::mat4 &view, const glm::mat4 &projection, float nearPlane)
+{
+	// light frames, all cascades of a light go when it or the scene moves
+	bool sceneMoved = !shadows.lightsValid || shadows.sceneVersion != scene.Version();
+	for (int light = 0; light < LIGHT_COUNT; light++)
+	{
+		if (!sceneMoved && shadows.lightPositions[light] == lightPositions[light])
+			continue;
+
+		glm::vec3 direction = glm::normalize(target - lightPositions[light]);
+		glm::vec3 up = std::fabs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		shadows.lightPositions[light] = lightPositions[light];
+		shadows.lightViews[light] = glm::lookAt(glm::vec3(0.0f), direction, up);
+		FitLightDepth(shadows, scene, light);
+		for (int cascade = 0; cascade < CASCADE_COUNT; cascade++)
+			shadows.cascades[light][cascade].valid = false;
+	}
+	shadows.sceneVersion = scene.Version();
+	shadows.lightsValid = true;
+
+	glm::mat4 inverseProjection = glm::inverse(projection);
+	glm::mat4 inverseView = glm::inverse(view);
+
+	GLint previousFramebuffer = 0;
+	GLint previousProgram = 0;
+	GLint previousViewport[4];
+	bool drawing = false;
+
+	float splitNear = nearPlane;
+	for (int cascade = 0; cascade < CASCADE_COUNT; cascade++)
+	{
+		float fraction = float(cascade + 1) / CASCADE_COUNT;
+		float logSplit = nearPlane * std::pow(SHADOW_DISTANCE / nearPlane, fraction);
+		float uniformSplit = nearPlane + (SHADOW_DISTANCE - nearPlane) * fraction;
+		float splitFar = splitBlend * logSplit + (1.0f - splitBlend) * uniformSplit;
+		shadows.splits[cascade] = splitFar;
+
+		// world space corners of this slice of the view, the rays through
+		// the screen corners work for both projections
+		glm::vec3 corners[8];
+		for (int corner = 0; corner < 4; corner++)
+		{
+			float ndcX = (corner & 1) ? 1.0f : -1.0f;
+			float ndcY = (corner & 2) ? 1.0f : -1.0f;
+			glm::vec4 nearPoint = inverseProjection * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+			glm::vec4 farPoint = inverseProjection * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+			glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+			glm::vec3 direction = glm::vec3(farPoint) / farPoint.w - origin;
+			glm::vec3 sliceNear = origin + direction * ((-splitNear - origin.z) / direction.z);
+			glm::vec3 sliceFar = origin + direction * ((-splitFar - origin.z) / direction.z);
+			corners[corner] = glm::vec3(inverseView * glm::vec4(sliceNear, 1.0f));
+			corners[corner + 4] = glm::vec3(inverseView * glm::vec4(sliceFar, 1.0f));
+		}
+		splitNear = splitFar;
+
+		glm::vec3 center(0.0f);
+		for (const glm::vec3 &corner : corners)
+			center += corner;
+		center /= 8.0f;
+		float radius = 0.0f;
+		for (const glm::vec3 &corner : corners)
+			radius = std::max(radius, glm::length(corner - center));
+
+		for (int light = 0; light < LIGHT_COUNT; light++)
+		{
+			Cascade &map = shadows.cascades[light][cascade];
+			glm::vec3 lightCenter = glm::vec3(shadows.lightViews[light] * glm::vec4(center, 1.0f));
+			if (map.valid
+				&& map.boxMin.x <= lightCenter.x - radius && map.boxMin.y <= lightCenter.y - radius
+				&& map.boxMax.x >= lightCenter.x + radius && map.boxMax.y >= lightCenter.y + radius
+				&& map.boxMax.x - map.boxMin.x <= 4.0f * radius)
+				continue;
+
+			float halfSize = radius * cascadeMargin;
+			float texel = 2.0f * halfSize / MAP_SIZE;
+			glm::vec2 snapped(std::floor(lightCenter.x / texel + 0.5f) * texel, std::floor(lightCenter.y / texel + 0.5f) * texel);
+			map.boxMin = snapped - glm::vec2(halfSize, halfSize);
+			map.boxMax = snapped + glm::vec2(halfSize, halfSize);
+			glm::mat4 lightProjection = glm::ortho(map.boxMin.x, map.boxMax.x, map.boxMin.y, map.boxMax.y,
+				shadows.lightNear[light], shadows.lightFar[light]);
+			map.viewProjection = lightProjection * shadows.lightViews[light];
+			map.valid = true;
+
+			if (!drawing)
+			{
+				glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+				glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+				glGetIntegerv(GL_VIEWPORT, previousViewport);
+
+				glBindFramebuffer(GL_FRAMEBUFFER, shadows.framebuffer);
+				glViewport(0, 0, MAP_SIZE, MAP_SIZE);
+				glUseProgram(shadows.depth.program);
+				glEnable(GL_DEPTH_TEST);
+				glDepthMask(GL_TRUE);
+				glDepthFunc(GL_LESS);
+				glEnable(GL_DEPTH_CLAMP);
+				glEnable(GL_POLYGON_OFFSET_FILL);
+				glPolygonOffset(2.0f, 4.0f);
+				drawing = true;
+			}
+			DrawCascade(shadows, scene, shadows.lightViews[light], lightProjection, light * CASCADE_COUNT + cascade);
+		}
+	}
+
+	if (drawing)
+	{
+		glDisable(GL_POLYGON_OFFSET_FILL);
+		glDisable(GL_DEPTH_CLAMP);
+		glBindVertexArray(0);
+		glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+		glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+		glUseProgram(previousProgram);
+	}
+}
+
+void Shadows::UBind(const GLShadows &shadows, GLuint program)
+{
+	// light clip space to texture space
+	const glm::mat4 bias = glm::translate(glm::vec3(0.5f)) * glm::scale(glm::vec3(0.5f));
+
+	glm::mat4 matrices[LIGHT_COUNT * CASCADE_COUNT];
+	for (int light = 0; light < LIGHT_COUNT; light++)
+	{
+		for (int cascade = 0; cascade < CASCADE_COUNT; cascade++)
+			matrices[light * CASCADE_COUNT + cascade] = bias * shadows.cascades[light][cascade].viewProjection;
+	}
+
+	glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, shadows.texture);
+	glActiveTexture(GL_TEXTURE0);
+
+	glUniformMatrix4fv(glGetUniformLocation(program, "shadowMatrices"), LIGHT_COUNT * CASCADE_COUNT, GL_FALSE, glm::value_ptr(matrices[0]));
+	glUniform1fv(glGetUniformLocation(program, "shadowSplits"), CASCADE_COUNT, shadows.splits);
+}
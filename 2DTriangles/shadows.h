@@ -0,0 +1,89 @@
+///////////////////////////////////////////////////////////////////////////////
+// shadows.h
+// =========
+// cascaded shadow maps for the two scene lights
+//
+// Each light gets CASCADE_COUNT orthographic shadow maps along its direction
+// towards the scene, covering consecutive depth ranges of the camera view
+// so the near objects get fine texels and the large planes still get some.
+// All maps are layers of one depth texture array sampled with hardware
+// depth comparison and a 3x3 PCF kernel.
+//
+// The shadow pass draws the position only stream of every mesh with the
+// depth pre-pass program. A cascade is cached: it is only drawn again when
+// the camera moves its depth range out of the area the map covers, when a
+// light moves, or when a scene node moves.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "depthprepass.h"
+#include "scene.h"
+
+class Shadows
+{
+
+public:
+	static const int LIGHT_COUNT = 2;
+	static const int CASCADE_COUNT = 3;
+	static const GLsizei MAP_SIZE = 1024;
+
+	// Texture unit the shading program samples the maps from
+	static const GLint TEXTURE_UNIT = 3;
+
+	// Part of the camera view covered by shadows, as a view depth
+	static constexpr float SHADOW_DISTANCE = 60.0f;
+
+	// One orthographic shadow map
+	struct Cascade
+	{
+		glm::vec2 boxMin;			// covered area in light view space
+		glm::vec2 boxMax;
+		glm::mat4 viewProjection;	// world to light clip space
+		bool valid = false;
+	};
+
+	struct GLShadows
+	{
+		GLuint texture = 0;		// depth array, layer = light * CASCADE_COUNT + cascade
+		GLuint framebuffer = 0;
+		DepthPrepass::GLDepthPrepass depth;	// depth only program shared with the pre-pass
+
+		glm::vec3 lightPositions[LIGHT_COUNT];
+		glm::mat4 lightViews[LIGHT_COUNT];
+		float lightNear[LIGHT_COUNT];	// light view depth range holding the whole scene
+		float lightFar[LIGHT_COUNT];
+		unsigned long long sceneVersion = 0;
+		bool lightsValid = false;
+
+		Cascade cascades[LIGHT_COUNT][CASCADE_COUNT];
+		float splits[CASCADE_COUNT];	// far view depth of every cascade
+
+		std::vector<unsigned char> casters;	// nodes touching the cascade being drawn
+
+		unsigned long long cascadesDrawn = 0;	// cache misses so far
+	};
+
+public:
+	static bool UCreateShadows(GLShadows &shadows);
+	static void UDestroyShadows(GLShadows &shadows);
+
+	// Fit the cascades to the camera and draw the ones that are out of date.
+	// Lights point from their position at target. Casters are culled into
+	// the pass's own flags, the scene is only read.
+	static void UUpdate(GLShadows &shadows, const Scene &scene, const glm::vec3 lightPositions[LIGHT_COUNT], const glm::vec3 &target,
+		const glm::mat4 &view, const glm::mat4 &projection, float nearPlane);
+
+	// Draw every cascade again on the next update
+	static void UInvalidate(GLShadows &shadows);
+
+	// Bind the maps and set the uniforms read by the shading program, which
+	// must be in use
+	static void UBind(const GLShadows &shadows, GLuint program);
+};
@@ -0,0 +1,92 @@
+///////////////////////////////////////////////////////////////////////////////
+// simd.cpp
+// ========
+// runtime selection of the widest x86 vector instruction set the CPU supports
+///////////////////////////////////////////////////////////////////////////////
+
+#include "simd.h"
+
+#if SIMD_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace
+{
+#if SIMD_X86
+	void CpuId(int leaf, int subleaf, unsigned registers[4])
+	{
+#if defined(_MSC_VER)
+		int values[4];
+		__cpuidex(values, leaf, subleaf);
+		for (int i = 0; i < 4; i++)
+			registers[i] = unsigned(values[i]);
+#else
+		__cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+	}
+
+	// XCR0, tells which register states the OS saves on context switches
+	unsigned long long ReadXcr0()
+	{
+#if defined(_MSC_VER)
+		return _xgetbv(0);
+#else
+		unsigned eax, edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+	}
+#endif
+
+	Simd::InstructionSet Detect()
+	{
+#if SIMD_X86
+		unsigned registers[4];
+		CpuId(0, 0, registers);
+		const unsigned maxLeaf = registers[0];
+
+		CpuId(1, 0, registers);
+		const bool osxsave = (registers[2] & (1u << 27)) != 0;
+		const bool avx = (registers[2] & (1u << 28)) != 0;
+
+		// AVX2 also needs the OS to preserve the YMM registers
+		if (maxLeaf >= 7 && osxsave && avx && (ReadXcr0() & 0x6) == 0x6)
+		{
+			CpuId(7, 0, registers);
+			if (registers[1] & (1u << 5))
+				return Simd::INSTRUCTIONS_AVX2;
+		}
+		return Simd::INSTRUCTIONS_SSE;
+#else
+		return Simd::INSTRUCTIONS_SCALAR;
+#endif
+	}
+
+	Simd::InstructionSet gDetected = Detect();
+	Simd::InstructionSet gActive = gDetected;
+}
+
+Simd::InstructionSet Simd::UInstructionSet()
+{
+	return gActive;
+}
+
+Simd::InstructionSet Simd::USetMaxInstructionSet(InstructionSet maximum)
+{
+	gActive = (maximum < gDetected) ? maximum : gDetected;
+	return gActive;
+}
+
+const char *Simd::UInstructionSetName(InstructionSet instructions)
+{
+	switch (instructions)
+	{
+	case INSTRUCTIONS_AVX2:	return "AVX2";
+	case INSTRUCTIONS_SSE:	return "SSE";
+	default:				return "scalar";
+	}
+}
@@ -0,0 +1,47 @@
+///////////////////////////////////////////////////////////////////////////////
+// simd.h
+// ======
+// runtime selection of the widest x86 vector instruction set the CPU supports
+//
+// Kernels are written three times (AVX2, SSE, scalar). SSE2 is the baseline
+// on every x86 target this project builds for, AVX2 code is compiled per
+// function (SIMD_TARGET_AVX2) and only called when the CPU and OS report
+// support for it. Other architectures always take the scalar path.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#else
+#define SIMD_X86 0
+#endif
+
+// Marks a function as containing AVX2 code. MSVC accepts the intrinsics in
+// any function, GCC and Clang need them enabled per function. FMA is left
+// out on purpose: with it enabled GCC contracts a*b - c*d into fused
+// operations, and the vector paths would stop matching the scalar ones.
+#if SIMD_X86 && !defined(_MSC_VER)
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SIMD_TARGET_AVX2
+#endif
+
+namespace Simd
+{
+	enum InstructionSet
+	{
+		INSTRUCTIONS_SCALAR,
+		INSTRUCTIONS_SSE,
+		INSTRUCTIONS_AVX2
+	};
+
+	// Detected once on first use
+	InstructionSet UInstructionSet();
+
+	// Limit the instruction set for comparisons, returns what is now active
+	InstructionSet USetMaxInstructionSet(InstructionSet maximum);
+
+	const char *UInstructionSetName(InstructionSet instructions);
+}
@@ -0,0 +1,163 @@
+///////////////////////////////////////////////////////////////////////////////
+// streambuffer.cpp
+// ================
+// ring of persistently mapped buffer memory for data written every frame
+///////////////////////////////////////////////////////////////////////////////
+
+#include "streambuffer.h"
+
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+	// Forget the oldest fenced frame, waiting for it unless wait is false.
+	// Returns false when it is still in flight and wait is false.
+	bool Retire(StreamBuffer::GLStreamBuffer &stream, bool wait)
+	{
+		StreamBuffer::Segment &segment = stream.segments[stream.firstSegment];
+
+		GLenum status = glClientWaitSync(segment.fence, 0, 0);
+		if (status == GL_TIMEOUT_EXPIRED)
+		{
+			if (!wait)
+				return false;
+
+			stream.waits++;
+			do
+			{
+				status = glClientWaitSync(segment.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			} while (status == GL_TIMEOUT_EXPIRED);
+		}
+
+		glDeleteSync(segment.fence);
+		stream.firstSegment = (stream.firstSegment + 1) % StreamBuffer::MAX_SEGMENTS;
+		stream.segmentCount--;
+		return true;
+	}
+}
+
+bool StreamBuffer::UCreateStreamBuffer(GLStreamBuffer &stream, GLsizeiptr size)
+{
+	if (!GLEW_VERSION_4_4 && !GLEW_ARB_buffer_storage)
+	{
+		std::cout << "Buffer storage is not supported, dynamic data is uploaded with glBufferSubData" << std::endl;
+		return false;
+	}
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glGenBuffers(1, &stream.buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, stream.buffer);
+	glBufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, flags);
+	stream.mapped = static_cast<unsigned char *>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags));
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	if (!stream.mapped)
+	{
+		std::cout << "Failed to map the stream buffer" << std::endl;
+		UDestroyStreamBuffer(stream);
+		return false;
+	}
+	stream.size = size;
+
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &stream.storageAlignment);
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &stream.uniformAlignment);
+	return true;
+}
+
+void StreamBuffer::UDestroyStreamBuffer(GLStreamBuffer &stream)
+{
+	while (stream.segmentCount > 0)
+	{
+		glDeleteSync(stream.segments[stream.firstSegment].fence);
+		stream.firstSegment = (stream.firstSegment + 1) % MAX_SEGMENTS;
+		stream.segmentCount--;
+	}
+
+	// deleting the buffer unmaps it
+	glDeleteBuffers(1, &stream.buffer);
+	stream = GLStreamBuffer();
+}
+
+///////////////////////////////////////////////////
+//	UAllocate(GLStreamBuffer&, GLsizeiptr, GLint, Allocation&)
+//
+//	A range that would run past the end of the
+//	buffer starts over at offset 0 instead. The
+//	range must not reach back to the oldest byte
+//	still in use, older frames are retired (and
+//	waited for) until it does not.
+///////////////////////////////////////////////////
+bool StreamBuffer::UAllocate(GLStreamBuffer &stream, GLsizeiptr size, GLint alignment, Allocation &allocation)
+{
+	if (!stream.mapped || size > stream.size)
+	{
+		stream.failures++;
+		return false;
+	}
+
+	const unsigned long long ringSize = (unsigned long long)stream.size;
+	const unsigned long long bytes = (unsigned long long)size;
+	const unsigned long long align = (unsigned long long)(alignment > 0 ? alignment : 1);
+
+	unsigned long long offset = stream.head % ringSize;
+	unsigned long long aligned = (offset + align - 1) / align * align;
+	unsigned long long begin = stream.head + (aligned - offset);
+	if (aligned + bytes > ringSize)
+	{
+		begin = stream.head + (ringSize - offset);
+		aligned = 0;
+	}
+	unsigned long long end = begin + bytes;
+
+	for (;;)
+	{
+		unsigned long long oldest = stream.segmentCount > 0 ? stream.segments[stream.firstSegment].begin : stream.frameBegin;
+		if (end - oldest <= ringSize)
+			break;
+
+		// this frame alone has filled the ring
+		if (stream.segmentCount == 0)
+		{
+			stream.failures++;
+			return false;
+		}
+		Retire(stream, true);
+	}
+
+	stream.head = end;
+	stream.bytes += bytes;
+
+	allocation.buffer = stream.buffer;
+	allocation.offset = GLintptr(aligned);
+	allocation.size = size;
+	allocation.pointer = stream.mapped + aligned;
+	return true;
+}
+
+bool StreamBuffer::UWrite(GLStreamBuffer &stream, const void *data, GLsizeiptr size, GLint alignment, Allocation &allocation)
+{
+	if (!UAllocate(stream, size, alignment, allocation))
+		return false;
+
+	std::memcpy(allocation.pointer, data, size_t(size));
+	return true;
+}
+
+void StreamBuffer::UEndFrame(GLStreamBuffer &stream)
+{
+	if (stream.head == stream.frameBegin)
+		return;
+
+	// drop what already finished, then make room for one more fence
+	while (stream.segmentCount > 0 && Retire(stream, false))
+		;
+	if (stream.segmentCount == MAX_SEGMENTS)
+		Retire(stream, true);
+
+	Segment &segment = stream.segments[(stream.firstSegment + stream.segmentCount) % MAX_SEGMENTS];
+	segment.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	segment.begin = stream.frameBegin;
+	segment.end = stream.head;
+	stream.segmentCount++;
+	stream.frameBegin = stream.head;
+}
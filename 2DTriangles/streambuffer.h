@@ -0,0 +1,89 @@
+///////////////////////////////////////////////////////////////////////////////
+// streambuffer.h
+// ==============
+// ring of persistently mapped buffer memory for data written every frame
+//
+// One buffer is created with glBufferStorage and mapped once for good with
+// GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT. Dynamic data is written
+// straight into the mapping at the head of the ring and bound by range, so
+// uploads never go through glBufferData or glBufferSubData and the driver
+// never has to copy or rename a buffer the GPU is still reading.
+//
+// UEndFrame() puts a fence behind the writes of the frame. The head only
+// moves into memory of an older frame once that frame's fence is signaled;
+// with a ring a few frames deep this is normally the case already and the
+// wait is a formality. An allocation that does not fit even after every
+// older frame retired fails, and the caller falls back to a plain upload.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+class StreamBuffer
+{
+
+public:
+	static const GLsizeiptr DEFAULT_SIZE = 8 * 1024 * 1024;
+
+	// Frames in flight tracked at once, UEndFrame waits past this many
+	static const int MAX_SEGMENTS = 8;
+
+	// A range of a buffer and, for ring memory, where to write it
+	struct Allocation
+	{
+		GLuint buffer = 0;
+		GLintptr offset = 0;
+		GLsizeiptr size = 0;
+		void *pointer = nullptr;
+	};
+
+	// The writes of one frame, positions counted since creation
+	struct Segment
+	{
+		GLsync fence;
+		unsigned long long begin;
+		unsigned long long end;
+	};
+
+	struct GLStreamBuffer
+	{
+		GLuint buffer = 0;
+		unsigned char *mapped = nullptr;
+		GLsizeiptr size = 0;
+
+		// Offset alignments for binding ranges as storage or uniform buffers
+		GLint storageAlignment = 1;
+		GLint uniformAlignment = 1;
+
+		// Positions only grow, the buffer offset is position % size
+		unsigned long long head = 0;
+		unsigned long long frameBegin = 0;
+
+		// Fenced frames still in flight, oldest first
+		Segment segments[MAX_SEGMENTS];
+		int firstSegment = 0;
+		int segmentCount = 0;
+
+		// counters
+		unsigned long long waits = 0;		// fences that were not signaled when needed
+		unsigned long long failures = 0;	// allocations that did not fit
+		unsigned long long bytes = 0;		// written since creation
+	};
+
+public:
+	// Returns false when buffer storage is not available
+	static bool UCreateStreamBuffer(GLStreamBuffer &stream, GLsizeiptr size = DEFAULT_SIZE);
+	static void UDestroyStreamBuffer(GLStreamBuffer &stream);
+
+	// size bytes at an offset that is a multiple of alignment. The memory may
+	// be written until the frame ends, GL reads it from commands issued after
+	// the write. Returns false when the ring is too small for the frame.
+	static bool UAllocate(GLStreamBuffer &stream, GLsizeiptr size, GLint alignment, Allocation &allocation);
+
+	// Allocate and copy data in
+	static bool UWrite(GLStreamBuffer &stream, const void *data, GLsizeiptr size, GLint alignment, Allocation &allocation);
+
+	// Fence what the frame wrote, call once the frame's commands are issued
+	static void UEndFrame(GLStreamBuffer &stream);
+};
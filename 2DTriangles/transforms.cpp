@@ -0,0 +1,265 @@
+///////////////////////////////////////////////////////////////////////////////
+// transforms.cpp
+// ==============
+// node transforms stored as separate arrays and turned into model matrices
+// several at a time
+///////////////////////////////////////////////////////////////////////////////
+
+#include "transforms.h"
+#include "simd.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+	const size_t componentCount = 10;
+	const size_t batchSize = 8;
+
+	///////////////////////////////////////////////////
+	//	Scalar kernel, also used for the tails of the
+	//	vector loops. Column c of the rotation is the
+	//	quaternion's rotated axis c, then scaled by
+	//	scale c; the last column is the position.
+	///////////////////////////////////////////////////
+	void ModelMatricesScalar(const Transforms::Arrays &a, size_t first, size_t begin, size_t end, float *out)
+	{
+		for (size_t n = begin; n < end; n++)
+		{
+			const size_t i = first + n;
+			const float x = a.rotationX[i], y = a.rotationY[i], z = a.rotationZ[i], w = a.rotationW[i];
+			const float xx = x * x, yy = y * y, zz = z * z;
+			const float xy = x * y, xz = x * z, yz = y * z;
+			const float wx = w * x, wy = w * y, wz = w * z;
+
+			float *m = out + n * 16;
+			m[0] = (1.0f - 2.0f * (yy + zz)) * a.scaleX[i];
+			m[1] = 2.0f * (xy + wz) * a.scaleX[i];
+			m[2] = 2.0f * (xz - wy) * a.scaleX[i];
+			m[3] = 0.0f;
+			m[4] = 2.0f * (xy - wz) * a.scaleY[i];
+			m[5] = (1.0f - 2.0f * (xx + zz)) * a.scaleY[i];
+			m[6] = 2.0f * (yz + wx) * a.scaleY[i];
+			m[7] = 0.0f;
+			m[8] = 2.0f * (xz + wy) * a.scaleZ[i];
+			m[9] = 2.0f * (yz - wx) * a.scaleZ[i];
+			m[10] = (1.0f - 2.0f * (xx + yy)) * a.scaleZ[i];
+			m[11] = 0.0f;
+			m[12] = a.positionX[i];
+			m[13] = a.positionY[i];
+			m[14] = a.positionZ[i];
+			m[15] = 1.0f;
+		}
+	}
+
+#if SIMD_X86
+	// One matrix column of 4 nodes, given as its x, y, z and w rows
+	void StoreColumnSSE(__m128 x, __m128 y, __m128 z, __m128 w, float *out, int column)
+	{
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+		_mm_storeu_ps(out + 0 * 16 + column * 4, x);
+		_mm_storeu_ps(out + 1 * 16 + column * 4, y);
+		_mm_storeu_ps(out + 2 * 16 + column * 4, z);
+		_mm_storeu_ps(out + 3 * 16 + column * 4, w);
+	}
+
+	size_t ModelMatricesSSE(const Transforms::Arrays &a, size_t first, size_t count, float *out)
+	{
+		const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f), zero = _mm_setzero_ps();
+		size_t n = 0;
+		for (; n + 4 <= count; n += 4)
+		{
+			const size_t i = first + n;
+			__m128 x = _mm_loadu_ps(a.rotationX + i), y = _mm_loadu_ps(a.rotationY + i);
+			__m128 z = _mm_loadu_ps(a.rotationZ + i), w = _mm_loadu_ps(a.rotationW + i);
+			__m128 sx = _mm_loadu_ps(a.scaleX + i), sy = _mm_loadu_ps(a.scaleY + i), sz = _mm_loadu_ps(a.scaleZ + i);
+
+			__m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+			__m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+			__m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+			float *m = out + n * 16;
+			StoreColumnSSE(
+				_mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx),
+				_mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx),
+				_mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx),
+				zero, m, 0);
+			StoreColumnSSE(
+				_mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy),
+				_mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy),
+				_mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy),
+				zero, m, 1);
+			StoreColumnSSE(
+				_mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz),
+				_mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz),
+				_mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz),
+				zero, m, 2);
+			StoreColumnSSE(_mm_loadu_ps(a.positionX + i), _mm_loadu_ps(a.positionY + i), _mm_loadu_ps(a.positionZ + i), one, m, 3);
+		}
+		return n;
+	}
+
+	// Like StoreColumnSSE for 8 nodes: the transpose stays within the two
+	// 128 bit lanes, the low lane holds nodes 0 to 3 and the high lane 4 to 7
+	SIMD_TARGET_AVX2 void StoreColumnAVX2(__m256 x, __m256 y, __m256 z, __m256 w, float *out, int column)
+	{
+		__m256 t0 = _mm256_unpacklo_ps(x, y), t1 = _mm256_unpacklo_ps(z, w);
+		__m256 t2 = _mm256_unpackhi_ps(x, y), t3 = _mm256_unpackhi_ps(z, w);
+		__m256 nodes[4] = {
+			_mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0)),
+			_mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2)),
+			_mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0)),
+			_mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2))
+		};
+		for (int k = 0; k < 4; k++)
+		{
+			_mm_storeu_ps(out + k * 16 + column * 4, _mm256_castps256_ps128(nodes[k]));
+			_mm_storeu_ps(out + (k + 4) * 16 + column * 4, _mm256_extractf128_ps(nodes[k], 1));
+		}
+	}
+
+	SIMD_TARGET_AVX2 size_t ModelMatricesAVX2(const Transforms::Arrays &a, size_t first, size_t count, float *out)
+	{
+		const __m256 one = _mm256_set1_ps(1.0f), two = _mm256_set1_ps(2.0f), zero = _mm256_setzero_ps();
+		size_t n = 0;
+		for (; n + 8 <= count; n += 8)
+		{
+			const size_t i = first + n;
+			__m256 x = _mm256_loadu_ps(a.rotationX + i), y = _mm256_loadu_ps(a.rotationY + i);
+			__m256 z = _mm256_loadu_ps(a.rotationZ + i), w = _mm256_loadu_ps(a.rotationW + i);
+			__m256 sx = _mm256_loadu_ps(a.scaleX + i), sy = _mm256_loadu_ps(a.scaleY + i), sz = _mm256_loadu_ps(a.scaleZ + i);
+
+			__m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+			__m256 xy = _mm256_mul_ps(x, y), xz = _mm256_mul_ps(x, z), yz = _mm256_mul_ps(y, z);
+			__m256 wx = _mm256_mul_ps(w, x), wy = _mm256_mul_ps(w, y), wz = _mm256_mul_ps(w, z);
+
+			float *m = out + n * 16;
+			StoreColumnAVX2(
+				_mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz))), sx),
+				_mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), sx),
+				_mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), sx),
+				zero, m, 0);
+			StoreColumnAVX2(
+				_mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), sy),
+				_mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz))), sy),
+				_mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), sy),
+				zero, m, 1);
+			StoreColumnAVX2(
+				_mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), sz),
+				_mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), sz),
+				_mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy))), sz),
+				zero, m, 2);
+			StoreColumnAVX2(_mm256_loadu_ps(a.positionX + i), _mm256_loadu_ps(a.positionY + i), _mm256_loadu_ps(a.positionZ + i), one, m, 3);
+		}
+		return n;
+	}
+#endif
+}
+
+///////////////////////////////////////////////////
+//	UResize(Arrays&, size_t)
+//
+//	All ten component arrays share one block, each
+//	starting on a 32 byte boundary
+///////////////////////////////////////////////////
+void Transforms::UResize(Arrays &arrays, size_t count)
+{
+	if (count <= arrays.capacity)
+	{
+		for (size_t i = arrays.count; i < count; i++)
+			USet(arrays, i, glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f));
+		arrays.count = count;
+		return;
+	}
+
+	Arrays resized;
+	resized.capacity = (count + batchSize - 1) / batchSize * batchSize;
+	resized.block = new unsigned char[componentCount * resized.capacity * sizeof(float) + ALIGNMENT];
+
+	std::uintptr_t address = reinterpret_cast<std::uintptr_t>(resized.block);
+	float *base = reinterpret_cast<float *>(resized.block + (ALIGNMENT - address % ALIGNMENT) % ALIGNMENT);
+	float **components[componentCount] = {
+		&resized.positionX, &resized.positionY, &resized.positionZ,
+		&resized.rotationX, &resized.rotationY, &resized.rotationZ, &resized.rotationW,
+		&resized.scaleX, &resized.scaleY, &resized.scaleZ
+	};
+	float *const oldComponents[componentCount] = {
+		arrays.positionX, arrays.positionY, arrays.positionZ,
+		arrays.rotationX, arrays.rotationY, arrays.rotationZ, arrays.rotationW,
+		arrays.scaleX, arrays.scaleY, arrays.scaleZ
+	};
+	for (size_t c = 0; c < componentCount; c++)
+	{
+		*components[c] = base + c * resized.capacity;
+		if (arrays.count > 0)
+			std::memcpy(*components[c], oldComponents[c], arrays.count * sizeof(float));
+	}
+
+	resized.count = arrays.count;
+	UDestroy(arrays);
+	arrays = resized;
+	UResize(arrays, count);
+}
+
+void Transforms::UReserve(Arrays &arrays, size_t capacity)
+{
+	if (capacity <= arrays.capacity)
+		return;
+
+	size_t count = arrays.count;
+	UResize(arrays, capacity);
+	arrays.count = count;
+}
+
+void Transforms::UDestroy(Arrays &arrays)
+{
+	delete[] arrays.block;
+	arrays = Arrays();
+}
+
+void Transforms::USet(Arrays &arrays, size_t index, const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale)
+{
+	arrays.positionX[index] = position.x;
+	arrays.positionY[index] = position.y;
+	arrays.positionZ[index] = position.z;
+	arrays.rotationX[index] = rotation.x;
+	arrays.rotationY[index] = rotation.y;
+	arrays.rotationZ[index] = rotation.z;
+	arrays.rotationW[index] = rotation.w;
+	arrays.scaleX[index] = scale.x;
+	arrays.scaleY[index] = scale.y;
+	arrays.scaleZ[index] = scale.z;
+}
+
+glm::quat Transforms::UAxisRotation(float angle, const glm::vec3 &axis)
+{
+	return glm::angleAxis(angle, glm::normalize(axis));
+}
+
+///////////////////////////////////////////////////
+//	UModelMatrices(const Arrays&, size_t, size_t, glm::mat4*)
+//
+//	8 (AVX2) or 4 (SSE) matrices per step
+///////////////////////////////////////////////////
+void Transforms::UModelMatrices(const Arrays &arrays, size_t first, size_t count, glm::mat4 *models)
+{
+	if (count == 0)
+		return;
+
+	float *out = &models[0][0][0];
+	size_t done = 0;
+#if SIMD_X86
+	switch (Simd::UInstructionSet())
+	{
+	case Simd::INSTRUCTIONS_AVX2:
+		done = ModelMatricesAVX2(arrays, first, count, out);
+		break;
+	case Simd::INSTRUCTIONS_SSE:
+		done = ModelMatricesSSE(arrays, first, count, out);
+		break;
+	default:
+		break;
+	}
+#endif
+	ModelMatricesScalar(arrays, first, done, count, out);
+}
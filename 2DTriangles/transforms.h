@@ -0,0 +1,55 @@
+///////////////////////////////////////////////////////////////////////////////
+// transforms.h
+// ============
+// node transforms stored as separate arrays and turned into model matrices
+// several at a time
+//
+// Positions, rotations (unit quaternions) and scales are kept one array per
+// component (SoA) in a single 32 byte aligned block, so the kernels load 8
+// (AVX2) or 4 (SSE) nodes per register and build their translate * rotate *
+// scale matrices without the three matrix products of the glm chain. The
+// columns are transposed back into glm::mat4 on the way out. The scalar
+// path does the same operations in the same order, so all three give the
+// same matrices.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstddef>
+
+class Transforms
+{
+
+public:
+	static const size_t ALIGNMENT = 32;
+
+	struct Arrays
+	{
+		size_t count = 0;
+		size_t capacity = 0;	// rounded up to whole AVX2 batches
+		unsigned char *block = nullptr;
+
+		float *positionX = nullptr, *positionY = nullptr, *positionZ = nullptr;
+		float *rotationX = nullptr, *rotationY = nullptr, *rotationZ = nullptr, *rotationW = nullptr;
+		float *scaleX = nullptr, *scaleY = nullptr, *scaleZ = nullptr;
+	};
+
+public:
+	// New identity transforms past the old count, the old ones are kept
+	static void UResize(Arrays &arrays, size_t count);
+	// Room for capacity transforms without changing the count
+	static void UReserve(Arrays &arrays, size_t capacity);
+	static void UDestroy(Arrays &arrays);
+
+	static void USet(Arrays &arrays, size_t index, const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale);
+
+	// Rotation of angle radians around axis, which need not be unit length
+	static glm::quat UAxisRotation(float angle, const glm::vec3 &axis);
+
+	// translate * rotate * scale of transforms first .. first + count - 1
+	// into models[0] .. models[count - 1]
+	static void UModelMatrices(const Arrays &arrays, size_t first, size_t count, glm::mat4 *models);
+};